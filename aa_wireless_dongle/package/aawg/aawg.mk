@@ -1,14 +1,34 @@
 AAWG_VERSION = 1.0
 AAWG_SITE = $(BR2_EXTERNAL_AA_WIRELESS_DONGLE_PATH)/package/aawg/src
 AAWG_SITE_METHOD = local
-AAWG_DEPENDENCIES = dbus-cxx-custom protobuf
+AAWG_DEPENDENCIES = dbus-cxx-custom protobuf host-protobuf
 
 define AAWG_BUILD_CMDS
     $(MAKE) $(TARGET_CONFIGURE_OPTS) PROTOC=$(HOST_DIR)/bin/protoc -C $(@D)
+    mkdir -p $(@D)/test/host
+    $(MAKE) $(HOST_CONFIGURE_OPTS) PROTOC=$(HOST_DIR)/bin/protoc -C $(@D)/test O=host check
+    $(AAWG_BUILD_BENCHMARKS)
 endef
 
+ifeq ($(BR2_PACKAGE_AAWG_BENCHMARKS),y)
+define AAWG_BUILD_BENCHMARKS
+    mkdir -p $(@D)/test/target
+    $(MAKE) $(TARGET_CONFIGURE_OPTS) PROTOC=$(HOST_DIR)/bin/protoc -C $(@D)/test O=target all
+endef
+
+define AAWG_INSTALL_BENCHMARKS
+    $(INSTALL) -D -m 0755 $(@D)/test/target/benchEventLog $(TARGET_DIR)/usr/libexec/aawg/benchEventLog
+    $(INSTALL) -D -m 0755 $(@D)/test/target/benchFrames $(TARGET_DIR)/usr/libexec/aawg/benchFrames
+    $(INSTALL) -D -m 0755 $(@D)/test/target/benchUevent $(TARGET_DIR)/usr/libexec/aawg/benchUevent
+    $(INSTALL) -D -m 0755 $(@D)/test/target/benchAccessory $(TARGET_DIR)/usr/libexec/aawg/benchAccessory
+endef
+endif
+
 define AAWG_INSTALL_TARGET_CMDS
     $(INSTALL) -D -m 0755 $(@D)/aawgd  $(TARGET_DIR)/usr/bin
+    $(INSTALL) -D -m 0755 $(@D)/aawg-flightdump  $(TARGET_DIR)/usr/bin
+    $(INSTALL) -D -m 0755 $(@D)/aawg-channelselect  $(TARGET_DIR)/usr/bin
+    $(AAWG_INSTALL_BENCHMARKS)
 endef
 
 $(eval $(generic-package))
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Android Auto frame header, the part of every frame that stays in plain text even after TLS starts.
+ *
+ *   byte 0     channel id
+ *   byte 1     flags
+ *   byte 2-3   payload length, big endian
+ *   byte 4-7   total length of the fragmented message, only in the first frame of a fragmented message
+ */
+namespace AAFrame {
+    constexpr size_t HEADER_LENGTH = 4;
+    constexpr size_t MAX_HEADER_LENGTH = 8;
+
+    constexpr uint8_t FLAG_FIRST = 1 << 0;
+    constexpr uint8_t FLAG_LAST = 1 << 1;
+    constexpr uint8_t FLAG_CONTROL = 1 << 2;
+    constexpr uint8_t FLAG_ENCRYPTED = 1 << 3;
+    constexpr uint8_t FRAME_TYPE_MASK = FLAG_FIRST | FLAG_LAST;
+
+    constexpr uint8_t CONTROL_CHANNEL = 0;
+
+    struct Header {
+        uint8_t channel;
+        uint8_t flags;
+        // Length of the header, including the extra four bytes of a first fragment
+        size_t headerLength;
+        size_t payloadLength;
+
+        size_t frameLength() const {
+            return headerLength + payloadLength;
+        }
+    };
+
+    /**
+     * Parse a frame header from at least HEADER_LENGTH bytes.
+     */
+    inline Header parseHeader(const unsigned char* data) {
+        Header header = {
+            .channel = data[0],
+            .flags = data[1],
+            .headerLength = HEADER_LENGTH,
+            .payloadLength = static_cast<size_t>((data[2] << 8) + data[3]),
+        };
+
+        // The first frame of a fragmented message has four more bytes of header.
+        if ((header.flags & FRAME_TYPE_MASK) == FLAG_FIRST) {
+            header.headerLength += 4;
+        }
+
+        return header;
+    }
+
+    /**
+     * Follows the frame boundaries of a stream that arrives in arbitrary pieces, without buffering it.
+     */
+    class StreamTracker {
+    public:
+        /**
+         * Consume the next piece of the stream. Returns the length of the longest prefix of the piece that ends
+         * on a frame boundary, 0 if no frame was completed, and calls onFrame with the header of each completed frame.
+         */
+        template <typename OnFrame>
+        size_t consume(const unsigned char* data, size_t length, OnFrame&& onFrame) {
+            size_t complete = 0;
+            size_t offset = 0;
+
+            while (offset < length) {
+                if (m_remaining == 0) {
+                    // Collect the header, which may itself be split
+                    size_t wanted = m_headerBytes < HEADER_LENGTH ? HEADER_LENGTH : parseHeader(m_header).headerLength;
+                    size_t count = std::min(wanted - m_headerBytes, length - offset);
+                    memcpy(m_header + m_headerBytes, data + offset, count);
+                    m_headerBytes += count;
+                    offset += count;
+
+                    if (m_headerBytes < HEADER_LENGTH || m_headerBytes < parseHeader(m_header).headerLength) {
+                        continue;
+                    }
+
+                    m_remaining = parseHeader(m_header).payloadLength;
+                    m_headerBytes = 0;
+                }
+                else {
+                    size_t count = std::min(m_remaining, length - offset);
+                    m_remaining -= count;
+                    offset += count;
+                }
+
+                if (m_remaining == 0) {
+                    memcpy(m_lastHeader, m_header, HEADER_LENGTH);
+                    complete = offset;
+                    onFrame(parseHeader(m_header));
+                }
+            }
+
+            return complete;
+        }
+
+        // First HEADER_LENGTH bytes of the last completed frame
+        const unsigned char* lastHeader() const {
+            return m_lastHeader;
+        }
+
+    private:
+        unsigned char m_header[MAX_HEADER_LENGTH];
+        unsigned char m_lastHeader[HEADER_LENGTH] = {};
+        size_t m_headerBytes = 0;
+        // Payload bytes of the current frame still to come
+        size_t m_remaining = 0;
+    };
+}
@@ -1,63 +1,167 @@
 #include <stdio.h>
-#include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <future>
+#include <memory>
 
 #include "common.h"
 #include "bluetoothHandler.h"
+#include "controlServer.h"
+#include "cpuFreq.h"
+#include "flightRecorder.h"
+#include "linkMonitor.h"
+#include "eventLog.h"
+#include "eventLoop.h"
 #include "proxyHandler.h"
+#include "stats.h"
 #include "uevent.h"
 #include "usb.h"
 
-int main(void) {
-    Logger::instance()->info("AA Wireless Dongle\n");
+static const std::chrono::steady_clock::time_point s_startTime = std::chrono::steady_clock::now();
 
-    // Global init
-    std::optional<std::thread> ueventThread =  UeventMonitor::instance().start();
-    UsbManager::instance().init();
-    BluetoothHandler::instance().init();
+static long long millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
 
-    ConnectionStrategy connectionStrategy = Config::instance()->getConnectionStrategy();
-    if (connectionStrategy == ConnectionStrategy::DONGLE_MODE) {
-        BluetoothHandler::instance().powerOn();
+static void reportBootMilestone(const char* milestone) {
+    struct timespec uptime;
+    clock_gettime(CLOCK_BOOTTIME, &uptime);
+
+    Logger::instance()->info("Boot to %s: %lld ms since system boot, %lld ms since aawgd start\n", milestone, (long long)uptime.tv_sec * 1000 + uptime.tv_nsec / 1000000, millisecondsSince(s_startTime));
+}
+
+class InitStageTimer {
+public:
+    InitStageTimer(const char* name): m_name(name), m_start(std::chrono::steady_clock::now()) {};
+    ~InitStageTimer() {
+        Logger::instance()->info("Init stage %s took %lld ms\n", m_name, millisecondsSince(m_start));
     }
 
+private:
+    const char* m_name;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+template <typename Function>
+static std::future<std::invoke_result_t<Function>> startInitStage(const char* name, Function function) {
+    return std::async(std::launch::async, [name, function]() {
+        InitStageTimer timer(name);
+        return function();
+    });
+}
+
+/**
+ * Per connection setup and processing, one session after the other, on the event loop. Bluetooth calls block
+ * on D-Bus replies, they run off the loop.
+ */
+static EventLoop::Task connectionLoop(ConnectionStrategy connectionStrategy, std::unique_ptr<AAWProxy> proxy, Stats::ProcessUsage initUsage) {
+    bool firstConnection = true;
+    int sessions = 0;
     while (true) {
         Logger::instance()->info("Connection Strategy: %d\n", connectionStrategy);
 
-        // Per connection setup and processing
         if (connectionStrategy == ConnectionStrategy::USB_FIRST) {
             Logger::instance()->info("Waiting for the accessory to connect first\n");
-            UsbManager::instance().enableDefaultAndWaitForAccessory();
+            co_await UsbManager::instance().enableDefaultAndWaitForAccessory();
         }
 
-        AAWProxy proxy;
-        std::optional<std::thread> proxyThread = proxy.startServer(Config::instance()->getWifiInfo().port);
+        if (!proxy) {
+            proxy = std::make_unique<AAWProxy>();
+            if (!proxy->startServer(Config::instance()->getWifiInfo().port)) {
+                exit(1);
+            }
 
-        if (!proxyThread) {
-            return 1;
+            if (firstConnection) {
+                reportBootMilestone("listening");
+            }
         }
 
         if (connectionStrategy != ConnectionStrategy::DONGLE_MODE) {
-            BluetoothHandler::instance().powerOn();
+            co_await EventLoop::instance().blocking([]() { BluetoothHandler::instance().powerOn(); });
+
+            if (firstConnection) {
+                reportBootMilestone("advertising");
+            }
         }
+        firstConnection = false;
 
-        std::optional<std::thread> btConnectionThread = BluetoothHandler::instance().connectWithRetry();
+        BluetoothHandler::instance().connectWithRetry();
 
-        proxyThread->join();
+        co_await proxy->handleClient();
+        proxy = nullptr;
 
-        if (btConnectionThread) {
-            BluetoothHandler::instance().stopConnectWithRetry();
-            btConnectionThread->join();
-        }
+        BluetoothHandler::instance().stopConnectWithRetry();
+        co_await BluetoothHandler::instance().connectWithRetryStopped();
 
         UsbManager::instance().disableGadget();
 
-        if (connectionStrategy != ConnectionStrategy::DONGLE_MODE) {
+        Stats::ProcessUsage usage = Stats::processUsage();
+        Logger::instance()->info("Session %d ended, %d threads (%+d since init), %ld kB resident (%+ld), %d fds (%+d)\n", ++sessions,
+            usage.threads, usage.threads - initUsage.threads, usage.rssKb, usage.rssKb - initUsage.rssKb, usage.fds, usage.fds - initUsage.fds);
+
+        if (connectionStrategy == ConnectionStrategy::DONGLE_MODE) {
+            co_await EventLoop::instance().blocking([]() { BluetoothHandler::instance().sessionEnded(); });
+        }
+        else {
             // sleep for a couple of seconds before retrying
-            sleep(2);
+            co_await EventLoop::instance().sleepFor(std::chrono::seconds(2));
+        }
+    }
+}
+
+int main(void) {
+    Logger::instance()->info("AA Wireless Dongle\n");
+
+    // Writing to a socket the phone closed must fail instead of killing the daemon.
+    signal(SIGPIPE, SIG_IGN);
+
+    FlightRecorder::instance().init();
+    EventLog::instance().start();
+
+    ConnectionStrategy connectionStrategy = Config::instance()->getConnectionStrategy();
+
+    // Start listening before anything else, the phone could connect as soon as it gets the wifi details.
+    std::unique_ptr<AAWProxy> proxy;
+    if (connectionStrategy != ConnectionStrategy::USB_FIRST) {
+        proxy = std::make_unique<AAWProxy>();
+        if (!proxy->startServer(Config::instance()->getWifiInfo().port)) {
+            return 1;
         }
+        reportBootMilestone("listening");
     }
 
-    ueventThread->join();
+    // Started on the event loop once it runs
+    ControlServer::instance().start();
+    LinkController::instance().start();
+    CpuFreqManager::instance().start();
+
+    // Global init, the components are independent of each other.
+    std::future<bool> ueventInit = startInitStage("uevent", []() { return UeventMonitor::instance().start(); });
+    std::future<void> usbInit = startInitStage("usb", []() { UsbManager::instance().init(); });
+    std::future<void> bluetoothInit = startInitStage("bluetooth", []() { BluetoothHandler::instance().init(); });
+
+    usbInit.get();
+    reportBootMilestone("gadgets provisioned");
+    ueventInit.get();
+    bluetoothInit.get();
+
+    // Baseline to spot resources leaking across sessions
+    Stats::ProcessUsage initUsage = Stats::processUsage();
+    Logger::instance()->info("Init completed in %lld ms, %d threads, %ld kB resident, %d fds\n", millisecondsSince(s_startTime), initUsage.threads, initUsage.rssKb, initUsage.fds);
+
+    if (connectionStrategy == ConnectionStrategy::DONGLE_MODE) {
+        BluetoothHandler::instance().powerOn();
+        reportBootMilestone("advertising");
+    }
+
+    // The coroutine's parameters live in its frame, the proxy is handed over to it there.
+    EventLoop::instance().spawn([connectionStrategy, proxy = proxy.release(), initUsage]() {
+        return connectionLoop(connectionStrategy, std::unique_ptr<AAWProxy>(proxy), initUsage);
+    });
+
+    // The main thread runs the control plane from here on.
+    EventLoop::instance().run();
 
-    return 0;
+    return 1;
 }
@@ -15,6 +15,9 @@ BLEAdvertisement::BLEAdvertisement(DBus::Path path): DBus::Object(path) {
     type = this->create_property<std::string>(INTERFACE_BLUEZ_LE_ADVERTISEMENT, "Type", DBus::PropertyAccess::ReadOnly);
     serviceUUIDs = this->create_property<std::vector<std::string>>(INTERFACE_BLUEZ_LE_ADVERTISEMENT, "ServiceUUIDs");
     localName = this->create_property<std::string>(INTERFACE_BLUEZ_LE_ADVERTISEMENT, "LocalName");
+    minInterval = this->create_property<uint32_t>(INTERFACE_BLUEZ_LE_ADVERTISEMENT, "MinInterval");
+    maxInterval = this->create_property<uint32_t>(INTERFACE_BLUEZ_LE_ADVERTISEMENT, "MaxInterval");
+    duration = this->create_property<uint16_t>(INTERFACE_BLUEZ_LE_ADVERTISEMENT, "Duration");
 }
 
 void BLEAdvertisement::Release() {
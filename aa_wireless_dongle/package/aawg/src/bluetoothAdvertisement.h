@@ -9,6 +9,10 @@ public:
     std::shared_ptr<DBus::Property<std::string>> type;
     std::shared_ptr<DBus::Property<std::vector<std::string>>> serviceUUIDs;
     std::shared_ptr<DBus::Property<std::string>> localName;
+    // Advertising interval range in ms, and how long this advertisement is kept when the controller rotates several, in s.
+    std::shared_ptr<DBus::Property<uint32_t>> minInterval;
+    std::shared_ptr<DBus::Property<uint32_t>> maxInterval;
+    std::shared_ptr<DBus::Property<uint16_t>> duration;
 
 protected:
     BLEAdvertisement(DBus::Path path);
@@ -1,24 +1,40 @@
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
 
 #include "common.h"
+#include "stats.h"
 #include "bluetoothHandler.h"
 #include "bluetoothProfiles.h"
 #include "bluetoothAdvertisement.h"
+#include "bluetoothManagement.h"
+#include "bluetoothObjects.h"
 
 static constexpr const char* ADAPTER_ALIAS_PREFIX = "WirelessAADongle-";
 static constexpr const char* ADAPTER_ALIAS_DONGLE_PREFIX = "AndroidAuto-Dongle-";
 
 static constexpr const char* BLUEZ_BUS_NAME = "org.bluez";
-static constexpr const char* BLUEZ_ROOT_OBJECT_PATH = "/";
 static constexpr const char* BLUEZ_OBJECT_PATH = "/org/bluez";
 
-static constexpr const char* INTERFACE_BLUEZ_ADAPTER = "org.bluez.Adapter1";
-static constexpr const char* INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER = "org.bluez.LEAdvertisingManager1";
-
-static constexpr const char* INTERFACE_BLUEZ_DEVICE = "org.bluez.Device1";
 static constexpr const char* INTERFACE_BLUEZ_PROFILE_MANAGER = "org.bluez.ProfileManager1";
 
 static constexpr const char* LE_ADVERTISEMENT_OBJECT_PATH = "/com/aawgd/bluetooth/advertisement";
+// Interval limits of legacy advertising
+static constexpr std::chrono::milliseconds BLE_MIN_INTERVAL(20);
+static constexpr std::chrono::milliseconds BLE_MAX_INTERVAL(10240);
+static constexpr std::chrono::milliseconds BLE_BURST_INTERVAL = BLE_MIN_INTERVAL;
+// BlueZ default rotation time of an advertisement
+static constexpr std::chrono::milliseconds BLE_DEFAULT_DURATION(2000);
+
+// Page scan timing in 0.625 ms slots. Fast connectable scans twice per 160 ms interval instead of once per 1.28 s,
+// the window stays the same and is at most half the interval.
+static constexpr std::chrono::microseconds PAGE_SCAN_SLOT(625);
+static constexpr uint16_t PAGE_SCAN_INTERVAL_STANDARD = 0x0800;
+static constexpr uint16_t PAGE_SCAN_INTERVAL_FAST = 0x0100;
+static constexpr uint16_t PAGE_SCAN_WINDOW_DEFAULT = 0x0012;
+static constexpr uint16_t PAGE_SCAN_WINDOW_MIN = 0x0011;
+static constexpr uint16_t PAGE_SCAN_WINDOW_MAX = PAGE_SCAN_INTERVAL_FAST / 2;
 
 static constexpr const char* AAWG_PROFILE_OBJECT_PATH = "/com/aawgd/bluetooth/aawg";
 static constexpr const char* AAWG_PROFILE_UUID = "4de17a00-52cb-11e6-bdf4-0800200c9a66";
@@ -27,241 +43,562 @@ static constexpr const char* HSP_HS_PROFILE_OBJECT_PATH = "/com/aawgd/bluetooth/
 static constexpr const char* HSP_AG_UUID = "00001112-0000-1000-8000-00805f9b34fb";
 static constexpr const char* HSP_HS_UUID = "00001108-0000-1000-8000-00805f9b34fb";
 
+static constexpr std::chrono::seconds CONNECT_RETRY_INTERVAL(20);
+
 
-class BluezAdapterProxy: private DBus::ObjectProxy {
-    BluezAdapterProxy(std::shared_ptr<DBus::Connection> conn, DBus::Path path): DBus::ObjectProxy(conn, BLUEZ_BUS_NAME, path) {
-        alias = this->create_property<std::string>(INTERFACE_BLUEZ_ADAPTER, "Alias");
-        powered = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Powered");
-        discoverable = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Discoverable");
-        pairable = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Pairable");
+BluetoothHandler& BluetoothHandler::instance() {
+    static BluetoothHandler instance;
+    return instance;
+}
 
-        registerAdvertisement = this->create_method<void(DBus::Path, DBus::Properties)>(INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER, "RegisterAdvertisement");
-        unregisterAdvertisement = this->create_method<void(DBus::Path)>(INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER, "UnregisterAdvertisement");
+std::shared_ptr<BluezAdapterProxy> BluetoothHandler::currentAdapter() {
+    std::lock_guard<std::mutex> lock(m_adapterMutex);
+    return m_adapter;
+}
+
+void BluetoothHandler::initAdapter() {
+    std::optional<DBus::Path> adapterPath = m_objects->firstAdapter();
+    std::shared_ptr<BluezAdapterProxy> adapter = adapterPath ? m_objects->adapter(*adapterPath) : nullptr;
+
+    if (!adapter) {
+        Logger::instance()->info("Did not find any bluetooth adapters\n");
     }
 
-public:
-    static std::shared_ptr<BluezAdapterProxy> create(std::shared_ptr<DBus::Connection> conn, DBus::Path path)
     {
-      return std::shared_ptr<BluezAdapterProxy>(new BluezAdapterProxy(conn, path));
-    }
+        std::lock_guard<std::mutex> lock(m_adapterMutex);
+        if (adapter == m_adapter) {
+            return;
+        }
 
-    std::shared_ptr<DBus::PropertyProxy<std::string>> alias;
-    std::shared_ptr<DBus::PropertyProxy<bool>> powered;
-    std::shared_ptr<DBus::PropertyProxy<bool>> discoverable;
-    std::shared_ptr<DBus::PropertyProxy<bool>> pairable;
+        m_adapter = adapter;
+        m_adapterIndex = std::nullopt;
 
-    std::shared_ptr<DBus::MethodProxy<void(DBus::Path, DBus::Properties)>> registerAdvertisement;
-    std::shared_ptr<DBus::MethodProxy<void(DBus::Path)>> unregisterAdvertisement;
-};
+        size_t hci = adapter ? adapterPath->rfind("/hci") : std::string::npos;
+        if (hci != std::string::npos) {
+            m_adapterIndex = strtoul(adapterPath->c_str() + hci + strlen("/hci"), nullptr, 10);
+        }
+    }
 
+    if (!adapter) {
+        return;
+    }
 
-BluetoothHandler& BluetoothHandler::instance() {
-    static BluetoothHandler instance;
-    return instance;
+    Logger::instance()->info("Using bluetooth adapter at path: %s\n", adapterPath->c_str());
+    adapter->alias->set_value(m_adapterAlias);
+    Logger::instance()->info("Bluetooth adapter alias: %s\n", m_adapterAlias.c_str());
 }
 
-DBus::ManagedObjects BluetoothHandler::getBluezObjects() {
-    std::shared_ptr<DBus::ObjectProxy> m_bluezRootObject = m_connection->create_object_proxy(BLUEZ_BUS_NAME, BLUEZ_ROOT_OBJECT_PATH);
-    DBus::MethodProxy getManagedObjects = *(m_bluezRootObject->create_method<DBus::ManagedObjects(void)>("org.freedesktop.DBus.ObjectManager", "GetManagedObjects"));
+void BluetoothHandler::adaptersChanged() {
+    std::shared_ptr<BluezAdapterProxy> previous = currentAdapter();
+    initAdapter();
 
-    return getManagedObjects();
-}
+    std::shared_ptr<BluezAdapterProxy> adapter = currentAdapter();
+    if (!adapter || adapter == previous) {
+        return;
+    }
 
-void BluetoothHandler::initAdapter() {
-    DBus::ManagedObjects objects = getBluezObjects();
-
-    std::string adapter_path;
-    for (auto const& [path, interfaces]: objects) {
-        for (auto const& [interface, properties]: interfaces) {
-            if (interface == INTERFACE_BLUEZ_ADAPTER) {
-                adapter_path = path;
-                Logger::instance()->info("Using bluetooth adapter at path: %s\n", path.c_str());
-                break;
-            }
-        }
-        if (!adapter_path.empty()) {
-            break;
-        }
+    // A new adapter, or the same one after bluetoothd restarted, starts without our settings.
+    if (m_powered) {
+        setPower(true);
+        setPairable(true);
     }
 
-    if (adapter_path.empty()) {
-        Logger::instance()->info("Did not find any bluetooth adapters\n");
+    {
+        std::lock_guard<std::mutex> lock(m_advertisementCallMutex);
+        m_advertisementRegistered = false;
     }
-    else {
-        m_adapter = BluezAdapterProxy::create(m_connection, adapter_path);
-        m_adapter->alias->set_value(m_adapterAlias);
-        Logger::instance()->info("Bluetooth adapter alias: %s\n", m_adapterAlias.c_str());
+    if (m_advertising) {
+        scheduleAdvertising(AdvertisingPhase::FAST);
     }
 }
 
+void BluetoothHandler::bluezRestarted() {
+    // A new bluetoothd knows neither the objects of the old one nor our profiles. The adapter, with the
+    // advertisement, follows with adaptersChanged().
+    try {
+        m_objects->reload();
+    } catch (DBus::Error& e) {
+        Logger::instance()->info("Bluetooth: %s is not available: %s\n", BLUEZ_BUS_NAME, e.what());
+        return;
+    }
+
+    registerProfiles();
+}
+
 void BluetoothHandler::setPower(bool on) {
-    if (!m_adapter) {
+    std::shared_ptr<BluezAdapterProxy> adapter = currentAdapter();
+    if (!adapter) {
         return;
     }
 
-    m_adapter->powered->set_value(on);
+    m_powered = on;
+    adapter->powered->set_value(on);
+    Stats::instance().setBluetoothState(on ? BluetoothState::POWERED : BluetoothState::OFF);
     Logger::instance()->info("Bluetooth adapter was powered %s\n", on ? "on" : "off");
 }
 
 void BluetoothHandler::setPairable(bool pairable) {
-    if (!m_adapter) {
+    std::shared_ptr<BluezAdapterProxy> adapter = currentAdapter();
+    if (!adapter) {
         return;
     }
 
-    m_adapter->discoverable->set_value(pairable);
-    m_adapter->pairable->set_value(pairable);
+    adapter->discoverable->set_value(pairable);
+    adapter->pairable->set_value(pairable);
     Logger::instance()->info("Bluetooth adapter is now discoverable and pairable\n");
 }
 
 void BluetoothHandler::exportProfiles() {
-    std::shared_ptr<DBus::ObjectProxy> bluezObject = m_connection->create_object_proxy(BLUEZ_BUS_NAME, BLUEZ_OBJECT_PATH);
-    DBus::MethodProxy registerProfile = *(bluezObject->create_method<void(DBus::Path, std::string, DBus::Properties)>(INTERFACE_BLUEZ_PROFILE_MANAGER, "RegisterProfile"));
-
     // Register AA Wireless Profile
     m_aawProfile = AAWirelessProfile::create(AAWG_PROFILE_OBJECT_PATH);
     if (m_connection->register_object(m_aawProfile, DBus::ThreadForCalling::DispatcherThread) != DBus::RegistrationStatus::Success) {
         Logger::instance()->info("Failed to register AA Wireless profile\n");
     }
 
-    registerProfile(AAWG_PROFILE_OBJECT_PATH, AAWG_PROFILE_UUID, {
-        {"Name", DBus::Variant("AA Wireless")},
-        {"Role", DBus::Variant("server")},
-        {"Channel", DBus::Variant(uint16_t(8))},
-    });
-    Logger::instance()->info("Bluetooth AA Wireless profile active\n");
-
     if (Config::instance()->getConnectionStrategy() != ConnectionStrategy::DONGLE_MODE) {
         // Register HSP Handset profile
         m_hspProfile = HSPHSProfile::create(HSP_HS_PROFILE_OBJECT_PATH);
         if (m_connection->register_object(m_hspProfile, DBus::ThreadForCalling::DispatcherThread) != DBus::RegistrationStatus::Success) {
             Logger::instance()->info("Failed to register HSP Handset profile\n");
         }
-        registerProfile(HSP_HS_PROFILE_OBJECT_PATH, HSP_HS_UUID, {
-            {"Name", DBus::Variant("HSP HS")},
+    }
+
+    registerProfiles();
+}
+
+void BluetoothHandler::registerProfiles() {
+    std::shared_ptr<DBus::ObjectProxy> bluezObject = m_connection->create_object_proxy(BLUEZ_BUS_NAME, BLUEZ_OBJECT_PATH);
+    DBus::MethodProxy registerProfile = *(bluezObject->create_method<void(DBus::Path, std::string, DBus::Properties)>(INTERFACE_BLUEZ_PROFILE_MANAGER, "RegisterProfile"));
+
+    try {
+        registerProfile(AAWG_PROFILE_OBJECT_PATH, AAWG_PROFILE_UUID, {
+            {"Name", DBus::Variant("AA Wireless")},
+            {"Role", DBus::Variant("server")},
+            {"Channel", DBus::Variant(uint16_t(8))},
         });
-        Logger::instance()->info("HSP Handset profile active\n");
+        Logger::instance()->info("Bluetooth AA Wireless profile active\n");
+
+        if (m_hspProfile) {
+            registerProfile(HSP_HS_PROFILE_OBJECT_PATH, HSP_HS_UUID, {
+                {"Name", DBus::Variant("HSP HS")},
+            });
+            Logger::instance()->info("HSP Handset profile active\n");
+        }
+    } catch (DBus::Error& e) {
+        Logger::instance()->info("Failed to register the bluetooth profiles: %s\n", e.what());
     }
 }
 
 void BluetoothHandler::startAdvertising() {
-    if (!m_adapter) {
+    if (!currentAdapter()) {
         return;
     }
 
-    // Register Advertisement Object
-    m_leAdvertisement = BLEAdvertisement::create(LE_ADVERTISEMENT_OBJECT_PATH);
+    if (!m_leAdvertisement) {
+        // Register Advertisement Object
+        m_leAdvertisement = BLEAdvertisement::create(LE_ADVERTISEMENT_OBJECT_PATH);
 
-    m_leAdvertisement->type->set_value("peripheral");
-    m_leAdvertisement->serviceUUIDs->set_value(std::vector<std::string>{AAWG_PROFILE_UUID});
-    m_leAdvertisement->localName->set_value(m_adapterAlias);
+        m_leAdvertisement->type->set_value("peripheral");
+        m_leAdvertisement->serviceUUIDs->set_value(std::vector<std::string>{AAWG_PROFILE_UUID});
+        m_leAdvertisement->localName->set_value(m_adapterAlias);
 
-    if (m_connection->register_object(m_leAdvertisement, DBus::ThreadForCalling::DispatcherThread) != DBus::RegistrationStatus::Success) {
-        Logger::instance()->info("Failed to register BLE Advertisement\n");
+        if (m_connection->register_object(m_leAdvertisement, DBus::ThreadForCalling::DispatcherThread) != DBus::RegistrationStatus::Success) {
+            Logger::instance()->info("Failed to register BLE Advertisement\n");
+        }
     }
 
-    (*m_adapter->registerAdvertisement)(LE_ADVERTISEMENT_OBJECT_PATH, {});
-    Logger::instance()->info("BLE Advertisement started\n");
+    scheduleAdvertising(AdvertisingPhase::FAST);
 }
 
 void BluetoothHandler::stopAdvertising() {
-    if (!m_adapter) {
+    std::shared_ptr<BluezAdapterProxy> adapter = currentAdapter();
+    if (!adapter) {
         return;
     }
 
-    (*m_adapter->unregisterAdvertisement)(LE_ADVERTISEMENT_OBJECT_PATH);
+    {
+        std::lock_guard<std::mutex> lock(m_advertisingMutex);
+        m_advertisingGeneration++;
+        m_advertising = false;
+    }
+
+    std::lock_guard<std::mutex> callLock(m_advertisementCallMutex);
+    if (m_advertisementRegistered) {
+        try {
+            (*adapter->unregisterAdvertisement)(LE_ADVERTISEMENT_OBJECT_PATH);
+        } catch (DBus::Error& e) {
+            Logger::instance()->info("Failed to unregister BLE Advertisement: %s\n", e.what());
+        }
+        m_advertisementRegistered = false;
+    }
+
     Logger::instance()->info("BLE Advertisement stopped\n");
 }
 
-void BluetoothHandler::connectDevice() {
-    DBus::ManagedObjects objects = getBluezObjects();
+void BluetoothHandler::scheduleAdvertising(AdvertisingPhase phase) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(m_advertisingMutex);
+        generation = ++m_advertisingGeneration;
+        m_advertising = true;
+        m_advertisingScheduleStart = std::chrono::steady_clock::now();
+    }
+
+    // Start advertising right away, the loop only takes care of the later phases.
+    if (advertise(phase, generation) && phase != AdvertisingPhase::SLOW) {
+        EventLoop::instance().spawn([this, phase, generation]() { return advertisingSchedule(phase, generation); });
+    }
+}
+
+bool BluetoothHandler::advertise(AdvertisingPhase phase, uint64_t generation) {
+    std::lock_guard<std::mutex> callLock(m_advertisementCallMutex);
+
+    // The schedule was restarted or advertising stopped in the meantime
+    std::shared_ptr<BluezAdapterProxy> adapter = currentAdapter();
+    {
+        std::lock_guard<std::mutex> lock(m_advertisingMutex);
+        if (generation != m_advertisingGeneration || !adapter) {
+            return false;
+        }
+    }
+
+    std::chrono::milliseconds interval = BLE_BURST_INTERVAL;
+    std::chrono::milliseconds period = Config::instance()->getBleBurstPeriod();
+    if (phase == AdvertisingPhase::FAST) {
+        interval = Config::instance()->getBleFastInterval();
+        period = Config::instance()->getBleFastPeriod();
+    }
+    else if (phase == AdvertisingPhase::SLOW) {
+        interval = Config::instance()->getBleSlowInterval();
+        period = BLE_DEFAULT_DURATION;
+    }
+    interval = std::clamp(interval, BLE_MIN_INTERVAL, BLE_MAX_INTERVAL);
+
+    // BlueZ only reads the parameters when the advertisement is registered
+    try {
+        if (m_advertisementRegistered) {
+            (*adapter->unregisterAdvertisement)(LE_ADVERTISEMENT_OBJECT_PATH);
+            m_advertisementRegistered = false;
+        }
+
+        m_leAdvertisement->minInterval->set_value(interval.count());
+        m_leAdvertisement->maxInterval->set_value(interval.count());
+        m_leAdvertisement->duration->set_value(std::clamp<long long>(std::chrono::duration_cast<std::chrono::seconds>(period).count(), 1, UINT16_MAX));
+
+        (*adapter->registerAdvertisement)(LE_ADVERTISEMENT_OBJECT_PATH, {});
+        m_advertisementRegistered = true;
+    } catch (DBus::Error& e) {
+        Logger::instance()->info("Failed to start BLE Advertisement: %s\n", e.what());
+        return false;
+    }
+
+    m_advertisingPhase = phase;
+    Logger::instance()->info("BLE Advertisement started, %s phase, interval %lld ms\n", phaseName(phase), (long long)interval.count());
+    return true;
+}
+
+EventLoop::Task BluetoothHandler::advertisingSchedule(AdvertisingPhase phase, uint64_t generation) {
+    while (phase != AdvertisingPhase::SLOW) {
+        co_await EventLoop::instance().sleepFor(phase == AdvertisingPhase::BURST ? Config::instance()->getBleBurstPeriod() : Config::instance()->getBleFastPeriod());
+
+        phase = phase == AdvertisingPhase::BURST ? AdvertisingPhase::FAST : AdvertisingPhase::SLOW;
+        if (!co_await EventLoop::instance().blocking([this, phase, generation]() { return advertise(phase, generation); })) {
+            co_return;
+        }
+    }
+}
 
-    std::vector<std::string> device_paths;
-    for (auto const& [path, interfaces]: objects) {
-        for (auto const& [interface, properties]: interfaces) {
-            if (interface == INTERFACE_BLUEZ_DEVICE) {
-                device_paths.push_back(path);
+/*static*/ const char* BluetoothHandler::phaseName(AdvertisingPhase phase) {
+    switch (phase) {
+        case AdvertisingPhase::BURST:
+            return "burst";
+        case AdvertisingPhase::FAST:
+            return "fast";
+        case AdvertisingPhase::SLOW:
+            return "slow";
+    }
+    return "unknown";
+}
+
+void BluetoothHandler::sessionEnded() {
+    if (!m_advertising) {
+        return;
+    }
+
+    scheduleAdvertising(Config::instance()->getBleBurstPeriod() > std::chrono::milliseconds(0) ? AdvertisingPhase::BURST : AdvertisingPhase::FAST);
+}
+
+void BluetoothHandler::profileConnected() {
+    auto now = std::chrono::steady_clock::now();
+
+    // On the dispatcher thread, which the advertising calls wait on, so without the advertising locks
+    if (m_advertising) {
+        // Time to discovery, as seen from the dongle
+        Logger::instance()->info("BLE: Profile connected %lld ms after advertising (re)started, in %s phase\n",
+            (long long)std::chrono::duration_cast<std::chrono::milliseconds>(now - m_advertisingScheduleStart.load()).count(),
+            phaseName(m_advertisingPhase));
+    }
+
+    std::lock_guard<std::mutex> lock(m_standbyMutex);
+    if (!m_sessionLostTime) {
+        return;
+    }
+
+    m_standbyGeneration++;
+    m_standby = false;
+    setFastConnectable(false);
+
+    // Extra radio time spent page scanning compared to the standard scan, the main power cost of staying reachable.
+    double fastDuty = 2.0 * m_fastPageScanWindow / PAGE_SCAN_INTERVAL_FAST;
+    double standardDuty = (double)m_savedPageScanWindow.value_or(PAGE_SCAN_WINDOW_DEFAULT) / PAGE_SCAN_INTERVAL_STANDARD;
+    long long fastMs = std::chrono::duration_cast<std::chrono::milliseconds>(m_fastConnectableTime).count();
+
+    Logger::instance()->info("Bluetooth: Reconnected %lld ms after the session ended, adapter %s, fast connectable for %lld ms, estimated %lld ms of extra page scanning\n",
+        (long long)std::chrono::duration_cast<std::chrono::milliseconds>(now - *m_sessionLostTime).count(),
+        m_keptPowered ? "kept powered" : "power cycled",
+        fastMs, (long long)(fastMs * std::max(0.0, fastDuty - standardDuty)));
+
+    m_sessionLostTime.reset();
+}
+
+void BluetoothHandler::standby() {
+    std::chrono::milliseconds window = Config::instance()->getBluetoothReconnectWindow();
+
+    {
+        std::lock_guard<std::mutex> lock(m_standbyMutex);
+        m_sessionLostTime = std::chrono::steady_clock::now();
+        m_fastConnectableTime = std::chrono::steady_clock::duration::zero();
+        m_keptPowered = window > std::chrono::milliseconds(0) && setFastConnectable(true);
+
+        if (m_keptPowered) {
+            m_standby = true;
+            uint64_t generation = ++m_standbyGeneration;
+            EventLoop::instance().spawn([this, window, generation]() { return standbyTimeout(window, generation); });
+
+            Logger::instance()->info("Bluetooth: Staying powered and fast connectable for %lld ms\n", (long long)window.count());
+            return;
+        }
+    }
+
+    powerOff();
+}
+
+EventLoop::Task BluetoothHandler::standbyTimeout(std::chrono::milliseconds window, uint64_t generation) {
+    co_await EventLoop::instance().sleepFor(window);
+
+    co_await EventLoop::instance().blocking([this, generation]() {
+        bool shouldPowerOff;
+        {
+            std::lock_guard<std::mutex> lock(m_standbyMutex);
+            if (generation != m_standbyGeneration) {
+                return;
+            }
+
+            setFastConnectable(false);
+            shouldPowerOff = m_standby;
+            m_standby = false;
+        }
+
+        Logger::instance()->info("Bluetooth: Reconnect window ended\n");
+        if (shouldPowerOff) {
+            powerOff();
+        }
+    });
+}
+
+bool BluetoothHandler::setFastConnectable(bool enable) {
+    std::optional<uint16_t> adapterIndex;
+    {
+        std::lock_guard<std::mutex> lock(m_adapterMutex);
+        adapterIndex = m_adapterIndex;
+    }
+
+    if (!adapterIndex) {
+        return false;
+    }
+
+    if (m_fastConnectable == enable) {
+        return true;
+    }
+
+    BluetoothManagement management(*adapterIndex);
+    auto now = std::chrono::steady_clock::now();
+
+    if (enable) {
+        // The controller uses the same window for the fast scan, widening it makes a page hit sooner.
+        m_savedPageScanWindow = management.readPageScanWindow();
+        m_fastPageScanWindow = m_savedPageScanWindow.value_or(PAGE_SCAN_WINDOW_DEFAULT);
+
+        long long slots = Config::instance()->getBluetoothReconnectScanWindow() / PAGE_SCAN_SLOT;
+        if (slots > 0 && m_savedPageScanWindow) {
+            uint16_t window = std::clamp<long long>(slots, PAGE_SCAN_WINDOW_MIN, PAGE_SCAN_WINDOW_MAX);
+            if (management.setPageScanWindow(window)) {
+                m_fastPageScanWindow = window;
+            }
+        }
+
+        if (!management.setFastConnectable(true)) {
+            if (m_savedPageScanWindow) {
+                management.setPageScanWindow(*m_savedPageScanWindow);
             }
+            return false;
         }
+
+        m_fastConnectableSince = now;
     }
+    else {
+        // Restore the window first, turning fast connectable off writes the scan parameters to the controller.
+        if (m_savedPageScanWindow && m_fastPageScanWindow != *m_savedPageScanWindow) {
+            management.setPageScanWindow(*m_savedPageScanWindow);
+        }
+
+        if (!management.setFastConnectable(false)) {
+            return false;
+        }
 
-    if (!device_paths.size()) {
+        m_fastConnectableTime += now - m_fastConnectableSince;
+    }
+
+    m_fastConnectable = enable;
+    Logger::instance()->info("Bluetooth: Fast connectable %s, page scan window %.2f ms\n", enable ? "enabled" : "disabled",
+        (enable ? m_fastPageScanWindow : m_savedPageScanWindow.value_or(PAGE_SCAN_WINDOW_DEFAULT)) * PAGE_SCAN_SLOT.count() / 1000.0);
+    return true;
+}
+
+void BluetoothHandler::connectDevice() {
+    std::vector<BluezObjectMirror::Device> devices = m_objects->devices();
+
+    if (!devices.size()) {
         Logger::instance()->info("Did not find any connected bluetooth device\n");
         return;
     }
 
     const bool isDongleMode = (Config::instance()->getConnectionStrategy() == ConnectionStrategy::DONGLE_MODE);
 
-    Logger::instance()->info("Found %d bluetooth devices\n", device_paths.size());
-
-    for (const std::string &device_path: device_paths) {
-        Logger::instance()->info("Trying to connect bluetooth device at path: %s\n", device_path.c_str());
+    Logger::instance()->info("Found %d bluetooth devices\n", devices.size());
+    Stats::instance().setBluetoothState(BluetoothState::CONNECTING);
 
-        std::shared_ptr<DBus::ObjectProxy> bluezDevice = m_connection->create_object_proxy(BLUEZ_BUS_NAME, device_path);
-        DBus::MethodProxy connectProfile = *(bluezDevice->create_method<void(std::string)>(INTERFACE_BLUEZ_DEVICE, "ConnectProfile"));
-        DBus::MethodProxy disconnect = *(bluezDevice->create_method<void()>(INTERFACE_BLUEZ_DEVICE, "Disconnect"));
+    bool connected = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    auto elapsedMs = [&start]() {
+        return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
 
-        std::shared_ptr<DBus::PropertyProxy<bool>> deviceConnected = bluezDevice->create_property<bool>(INTERFACE_BLUEZ_DEVICE, "Connected");
+    for (const BluezObjectMirror::Device& device: devices) {
+        Logger::instance()->info("Trying to connect bluetooth device at path: %s\n", device.path.c_str());
 
         try {
-            if (deviceConnected) {
+            // Every device is disconnected first, not only the ones that look connected. The phone connects the
+            // AA Wireless profile back on a fresh connection, and the Connected state may lag behind.
+            if (device.connected) {
                 Logger::instance()->info("Bluetooth device already connected, disconnecting\n");
-                disconnect();
             }
-            connectProfile(isDongleMode ? "" : HSP_AG_UUID);
-            Logger::instance()->info("Bluetooth connected to the device\n");
+            (*device.proxy->disconnect)();
+            (*device.proxy->connectProfile)(isDongleMode ? "" : HSP_AG_UUID);
+            Logger::instance()->info("Bluetooth connected to the device after %lld ms\n", elapsedMs());
+            Stats::instance().setBluetoothState(BluetoothState::CONNECTED);
+            connected = true;
             if (!isDongleMode) {
+                Stats::instance().addBluetoothConnect(std::chrono::steady_clock::now() - start, true);
                 return;
             }
         } catch (DBus::Error& e) {
             if (!isDongleMode) {
-                Logger::instance()->info("Failed to connect device at path: %s\n", device_path.c_str());
+                Logger::instance()->info("Failed to connect device at path: %s after %lld ms\n", device.path.c_str(), elapsedMs());
             }
         }
     }
 
+    Stats::instance().addBluetoothConnect(std::chrono::steady_clock::now() - start, connected);
+    if (!connected) {
+        Stats::instance().setBluetoothState(BluetoothState::POWERED);
+    }
+
     if (!isDongleMode) {
         Logger::instance()->info("Failed to connect to any known bluetooth device\n");
     }
 }
 
-void BluetoothHandler::retryConnectLoop() {
-    bool should_exit = false;
-    std::future<void> connectWithRetryFuture = connectWithRetryPromise->get_future();
-
-    while (!should_exit) {
-        connectDevice();
+EventLoop::Task BluetoothHandler::retryConnectLoop(EventLoop::Signal stop) {
+    // A stop requested during an attempt ends the wait after it right away.
+    do {
+        co_await EventLoop::instance().blocking([this]() { connectDevice(); });
+    } while (!co_await stop.wait(CONNECT_RETRY_INTERVAL));
 
-        if (connectWithRetryFuture.wait_for(std::chrono::seconds(20)) == std::future_status::ready) {
-            should_exit = true;
-            connectWithRetryPromise = nullptr;
-        }
+    if (Config::instance()->getConnectionStrategy() != ConnectionStrategy::DONGLE_MODE) {
+        co_await EventLoop::instance().blocking([this]() { standby(); });
     }
 
-    if (Config::instance()->getConnectionStrategy() != ConnectionStrategy::DONGLE_MODE) {
-        BluetoothHandler::instance().powerOff();
+    m_connecting = false;
+    m_connectingStopped.notify();
+}
+
+EventLoop::Task BluetoothHandler::refreshAdapters(bool ownerChanged) {
+    m_ownerChanged = m_ownerChanged || ownerChanged;
+
+    // Changes signalled while the adapters are refreshed are handled by one more refresh after it.
+    if (m_refreshingAdapters) {
+        m_adaptersChangedAgain = true;
+        co_return;
     }
+
+    m_refreshingAdapters = true;
+    do {
+        m_adaptersChangedAgain = false;
+        bool restarted = std::exchange(m_ownerChanged, false);
+        co_await EventLoop::instance().blocking([this, restarted]() {
+            if (restarted) {
+                bluezRestarted();
+            }
+            adaptersChanged();
+        });
+    } while (m_adaptersChangedAgain);
+    m_refreshingAdapters = false;
 }
 
 void BluetoothHandler::init() {
     // DBus::set_logging_function( DBus::log_std_err );
     // DBus::set_log_level( SL_TRACE );
 
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // A private bus lets a mock of org.bluez stand in for bluetoothd
+    std::string dbusAddress = Config::instance()->getDbusAddress();
+
     m_dispatcher = DBus::StandaloneDispatcher::create();
-    m_connection = m_dispatcher->create_connection( DBus::BusType::SYSTEM );
+    m_connection = dbusAddress.empty() ? m_dispatcher->create_connection( DBus::BusType::SYSTEM ) : m_dispatcher->create_connection(dbusAddress);
 
     std::string adapterAliasPrefix = (Config::instance()->getConnectionStrategy() == ConnectionStrategy::DONGLE_MODE) ? ADAPTER_ALIAS_DONGLE_PREFIX : ADAPTER_ALIAS_PREFIX;
 
     m_adapterAlias = adapterAliasPrefix + Config::instance()->getUniqueSuffix();
 
+    // The dispatcher thread cannot wait for replies, adapter changes are serialized on the event loop and handled off it.
+    m_objects = std::make_shared<BluezObjectMirror>(m_connection, [this]() {
+        EventLoop::instance().spawn([this]() { return refreshAdapters(false); });
+    }, [this]() {
+        EventLoop::instance().spawn([this]() { return refreshAdapters(true); });
+    });
+    m_objects->start();
+
     initAdapter();
     exportProfiles();
+
+    std::chrono::steady_clock::duration duration = std::chrono::steady_clock::now() - start;
+    Stats::instance().setBluetoothInitTime(duration);
+    Logger::instance()->info("Bluetooth initialized in %lld ms\n", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
 }
 
 void BluetoothHandler::powerOn() {
-    if (!m_adapter) {
+    if (!currentAdapter()) {
         return;
     }
 
+    {
+        // Whatever is left of the reconnect window keeps running, only the power off at its end is not needed anymore.
+        std::lock_guard<std::mutex> lock(m_standbyMutex);
+        m_standby = false;
+    }
+
     setPower(true);
     setPairable(true);
 
@@ -270,23 +607,32 @@ void BluetoothHandler::powerOn() {
     }
 }
 
-std::optional<std::thread> BluetoothHandler::connectWithRetry() {
-    if (!m_adapter) {
-        return std::nullopt;
+void BluetoothHandler::connectWithRetry() {
+    if (m_connecting || !currentAdapter()) {
+        return;
     }
 
-    connectWithRetryPromise = std::make_shared<std::promise<void>>();
-    return std::thread(&BluetoothHandler::retryConnectLoop, this);
+    // New signals, a notification left over from the previous retries must not end these.
+    m_connecting = true;
+    m_stopConnecting = EventLoop::Signal();
+    m_connectingStopped = EventLoop::Signal();
+    EventLoop::instance().spawn([this, stop = m_stopConnecting]() { return retryConnectLoop(stop); });
 }
 
 void BluetoothHandler::stopConnectWithRetry() {
-    if (connectWithRetryPromise) {
-        connectWithRetryPromise->set_value();
+    if (m_connecting) {
+        m_stopConnecting.notify();
+    }
+}
+
+EventLoop::Async<void> BluetoothHandler::connectWithRetryStopped() {
+    if (m_connecting) {
+        co_await m_connectingStopped.wait();
     }
 }
 
 void BluetoothHandler::powerOff() {
-    if (!m_adapter) {
+    if (!currentAdapter()) {
         return;
     }
 
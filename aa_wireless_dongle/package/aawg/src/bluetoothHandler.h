@@ -1,11 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <optional>
-#include <thread>
 
 #include "bluetoothCommon.h"
+#include "eventLoop.h"
 
 class BluezAdapterProxy;
+class BluezObjectMirror;
 class AAWirelessProfile;
 class HSPHSProfile;
 class BLEAdvertisement;
@@ -14,41 +18,112 @@ class BluetoothHandler {
 public:
     static BluetoothHandler& instance();
 
+    // Blocking, call off the event loop
     void init();
     void powerOn();
     void powerOff();
 
-    std::optional<std::thread> connectWithRetry();
+    // Keep trying to connect the known devices on the event loop, until stopped.
+    void connectWithRetry();
+    // Called on the event loop
     void stopConnectWithRetry();
+    // Wait for the retries to end after stopConnectWithRetry, including the standby that follows them.
+    EventLoop::Async<void> connectWithRetryStopped();
+
+    // In dongle mode, advertise aggressively again to be found quickly by the next connection. Blocking.
+    void sessionEnded();
+    // A device connected the AA Wireless profile
+    void profileConnected();
 
 private:
+    enum class AdvertisingPhase {
+        BURST,  // Shortest interval, for a while right after a session ended
+        FAST,   // After power on and after each session
+        SLOW,   // Low duty cycle once nobody connected for a while
+    };
+
     BluetoothHandler() {};
     BluetoothHandler(BluetoothHandler const&);
     BluetoothHandler& operator=(BluetoothHandler const&);
 
-    DBus::ManagedObjects getBluezObjects();
-
+    std::shared_ptr<BluezAdapterProxy> currentAdapter();
+    // Use the first adapter, if it changed
     void initAdapter();
+    void adaptersChanged();
+    // bluetoothd restarted: fetch its objects and register the profiles with it again
+    void bluezRestarted();
+    EventLoop::Task refreshAdapters(bool ownerChanged);
     void setPower(bool on);
     void setPairable(bool pairable);
     void exportProfiles();
+    void registerProfiles();
     void connectDevice();
 
     void startAdvertising();
     void stopAdvertising();
+    void scheduleAdvertising(AdvertisingPhase phase);
+    bool advertise(AdvertisingPhase phase, uint64_t generation);
+    EventLoop::Task advertisingSchedule(AdvertisingPhase phase, uint64_t generation);
+    static const char* phaseName(AdvertisingPhase phase);
 
-    void retryConnectLoop();
+    EventLoop::Task retryConnectLoop(EventLoop::Signal stop);
 
-    std::shared_ptr<std::promise<void>> connectWithRetryPromise;
+    // After a session outside of dongle mode: power off, or stay fast connectable for the reconnect window.
+    void standby();
+    EventLoop::Task standbyTimeout(std::chrono::milliseconds window, uint64_t generation);
+    bool setFastConnectable(bool enable);
 
     std::shared_ptr<DBus::Dispatcher> m_dispatcher;
     std::shared_ptr<DBus::Connection> m_connection;
+    std::shared_ptr<BluezObjectMirror> m_objects;
+
+    // Only used on the event loop
+    bool m_refreshingAdapters = false;
+    bool m_adaptersChangedAgain = false;
+    bool m_ownerChanged = false;
+    bool m_connecting = false;
+    EventLoop::Signal m_stopConnecting;
+    EventLoop::Signal m_connectingStopped;
+
+    // Guards the adapter, which changes when adapters are plugged in or removed
+    std::mutex m_adapterMutex;
     std::shared_ptr<BluezAdapterProxy> m_adapter;
+    // Controller index for the management API, hciN
+    std::optional<uint16_t> m_adapterIndex;
+    // Last power state requested, restored on a new adapter
+    std::atomic<bool> m_powered = false;
 
     std::shared_ptr<AAWirelessProfile> m_aawProfile;
     std::shared_ptr<HSPHSProfile> m_hspProfile;
 
     std::shared_ptr<BLEAdvertisement> m_leAdvertisement;
 
+    // Guards the schedule, never held across D-Bus calls
+    std::mutex m_advertisingMutex;
+    // Incremented whenever the schedule restarts or stops, to end the previous one.
+    uint64_t m_advertisingGeneration = 0;
+    // Read without the lock by profileConnected() on the dispatcher thread
+    std::atomic<bool> m_advertising = false;
+    std::atomic<AdvertisingPhase> m_advertisingPhase = AdvertisingPhase::FAST;
+    std::atomic<std::chrono::steady_clock::time_point> m_advertisingScheduleStart{};
+
+    // Serializes registering and unregistering the advertisement, so the calls for an older schedule cannot
+    // undo the registration of a newer one. Never taken on the dispatcher thread, which the calls wait on.
+    std::mutex m_advertisementCallMutex;
+    bool m_advertisementRegistered = false;
+
+    std::mutex m_standbyMutex;
+    uint64_t m_standbyGeneration = 0;
+    // Kept powered after a session and nobody asked to power on since
+    bool m_standby = false;
+    bool m_fastConnectable = false;
+    std::optional<uint16_t> m_savedPageScanWindow;
+    uint16_t m_fastPageScanWindow = 0;
+    std::chrono::steady_clock::time_point m_fastConnectableSince;
+    std::chrono::steady_clock::duration m_fastConnectableTime{};
+    // Set from the end of a session until the next connection, to report the reconnect latency
+    std::optional<std::chrono::steady_clock::time_point> m_sessionLostTime;
+    bool m_keptPowered = false;
+
     std::string m_adapterAlias;
 };
@@ -0,0 +1,147 @@
+#include <unistd.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "bluetoothManagement.h"
+
+// From the kernel headers, to not depend on libbluetooth for a handful of constants.
+static constexpr int BTPROTO_HCI = 1;
+static constexpr uint16_t HCI_DEV_NONE = 0xFFFF;
+static constexpr uint16_t HCI_CHANNEL_CONTROL = 3;
+
+struct sockaddr_hci {
+    sa_family_t hci_family;
+    uint16_t hci_dev;
+    uint16_t hci_channel;
+};
+
+static constexpr uint16_t MGMT_OP_SET_FAST_CONNECTABLE = 0x0019;
+static constexpr uint16_t MGMT_OP_READ_DEF_SYSTEM_CONFIG = 0x004B;
+static constexpr uint16_t MGMT_OP_SET_DEF_SYSTEM_CONFIG = 0x004C;
+
+static constexpr uint16_t MGMT_EV_CMD_COMPLETE = 0x0001;
+static constexpr uint16_t MGMT_EV_CMD_STATUS = 0x0002;
+
+static constexpr uint16_t SYSTEM_CONFIG_PAGE_SCAN_WINDOW = 0x0002;
+
+// Commands and events start with opcode or event code, controller index and parameter length, all little endian.
+static constexpr size_t MGMT_HEADER_SIZE = 6;
+
+static void putLe16(std::vector<uint8_t>& buffer, uint16_t value) {
+    buffer.push_back(value & 0xFF);
+    buffer.push_back(value >> 8);
+}
+
+static uint16_t getLe16(const uint8_t* data) {
+    return data[0] | (data[1] << 8);
+}
+
+BluetoothManagement::BluetoothManagement(uint16_t index): m_index(index) {
+    int sock = socket(AF_BLUETOOTH, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI);
+    if (sock < 0) {
+        Logger::instance()->info("Bluetooth management: Error creating socket: %s\n", strerror(errno));
+        return;
+    }
+
+    struct sockaddr_hci address = {
+        .hci_family = AF_BLUETOOTH,
+        .hci_dev = HCI_DEV_NONE,
+        .hci_channel = HCI_CHANNEL_CONTROL,
+    };
+    if (bind(sock, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        Logger::instance()->info("Bluetooth management: Error binding control channel: %s\n", strerror(errno));
+        close(sock);
+        return;
+    }
+
+    m_sock = sock;
+}
+
+BluetoothManagement::~BluetoothManagement() {
+    if (m_sock >= 0) {
+        close(m_sock);
+    }
+}
+
+bool BluetoothManagement::setFastConnectable(bool enable) {
+    return command(MGMT_OP_SET_FAST_CONNECTABLE, {enable ? uint8_t(1) : uint8_t(0)}).has_value();
+}
+
+std::optional<uint16_t> BluetoothManagement::readPageScanWindow() {
+    std::optional<std::vector<uint8_t>> reply = command(MGMT_OP_READ_DEF_SYSTEM_CONFIG, {});
+    if (!reply) {
+        return std::nullopt;
+    }
+
+    // A list of type (2 bytes), length (1 byte) and value
+    const std::vector<uint8_t>& values = *reply;
+    for (size_t offset = 0; offset + 3 <= values.size(); offset += 3 + values[offset + 2]) {
+        uint16_t type = getLe16(&values[offset]);
+        uint8_t length = values[offset + 2];
+        if (type == SYSTEM_CONFIG_PAGE_SCAN_WINDOW && length == 2 && offset + 5 <= values.size()) {
+            return getLe16(&values[offset + 3]);
+        }
+    }
+
+    return std::nullopt;
+}
+
+bool BluetoothManagement::setPageScanWindow(uint16_t slots) {
+    std::vector<uint8_t> parameters;
+    putLe16(parameters, SYSTEM_CONFIG_PAGE_SCAN_WINDOW);
+    parameters.push_back(2);
+    putLe16(parameters, slots);
+
+    return command(MGMT_OP_SET_DEF_SYSTEM_CONFIG, parameters).has_value();
+}
+
+std::optional<std::vector<uint8_t>> BluetoothManagement::command(uint16_t opcode, const std::vector<uint8_t>& parameters) {
+    if (m_sock < 0) {
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> request;
+    putLe16(request, opcode);
+    putLe16(request, m_index);
+    putLe16(request, parameters.size());
+    request.insert(request.end(), parameters.begin(), parameters.end());
+
+    if (write(m_sock, request.data(), request.size()) != (ssize_t)request.size()) {
+        Logger::instance()->info("Bluetooth management: Error sending command 0x%04x: %s\n", opcode, strerror(errno));
+        return std::nullopt;
+    }
+
+    // Other events are broadcast on the control channel too, skip them until the reply to this command.
+    while (true) {
+        struct pollfd pfd = {
+            .fd = m_sock,
+            .events = POLLIN,
+        };
+        if (poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0) {
+            Logger::instance()->info("Bluetooth management: No reply to command 0x%04x\n", opcode);
+            return std::nullopt;
+        }
+
+        uint8_t buffer[512];
+        ssize_t len = read(m_sock, buffer, sizeof(buffer));
+        if (len < (ssize_t)MGMT_HEADER_SIZE + 3) {
+            continue;
+        }
+
+        uint16_t event = getLe16(buffer);
+        uint16_t index = getLe16(buffer + 2);
+        if ((event != MGMT_EV_CMD_COMPLETE && event != MGMT_EV_CMD_STATUS) || index != m_index || getLe16(buffer + MGMT_HEADER_SIZE) != opcode) {
+            continue;
+        }
+
+        uint8_t status = buffer[MGMT_HEADER_SIZE + 2];
+        if (status != 0) {
+            Logger::instance()->info("Bluetooth management: Command 0x%04x failed with status 0x%02x\n", opcode, status);
+            return std::nullopt;
+        }
+
+        return std::vector<uint8_t>(buffer + MGMT_HEADER_SIZE + 3, buffer + len);
+    }
+}
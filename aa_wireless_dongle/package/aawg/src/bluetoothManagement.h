@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/**
+ * Minimal client of the kernel Bluetooth management API, for the controller settings BlueZ does not expose on
+ * D-Bus. Talks to the control channel directly, so it needs no library and the same privileges as bluetoothd.
+ */
+class BluetoothManagement {
+public:
+    explicit BluetoothManagement(uint16_t index);
+    ~BluetoothManagement();
+
+    /**
+     * Fast connectable switches page scan to interlaced at a short interval, so the controller answers a page
+     * sooner at the cost of scanning more often.
+     */
+    bool setFastConnectable(bool enable);
+
+    // Default page scan window in 0.625 ms slots, used both in normal and fast connectable page scan.
+    std::optional<uint16_t> readPageScanWindow();
+    bool setPageScanWindow(uint16_t slots);
+
+private:
+    static constexpr int REPLY_TIMEOUT_MS = 1000;
+
+    // Parameters of the command complete event, or nothing if the command failed.
+    std::optional<std::vector<uint8_t>> command(uint16_t opcode, const std::vector<uint8_t>& parameters);
+
+    uint16_t m_index;
+    int m_sock = -1;
+};
@@ -0,0 +1,226 @@
+#include "common.h"
+#include "bluetoothObjects.h"
+
+static constexpr const char* BLUEZ_BUS_NAME = "org.bluez";
+static constexpr const char* BLUEZ_ROOT_OBJECT_PATH = "/";
+
+static constexpr const char* DBUS_BUS_NAME = "org.freedesktop.DBus";
+static constexpr const char* DBUS_OBJECT_PATH = "/org/freedesktop/DBus";
+
+static constexpr const char* INTERFACE_OBJECT_MANAGER = "org.freedesktop.DBus.ObjectManager";
+static constexpr const char* INTERFACE_PROPERTIES = "org.freedesktop.DBus.Properties";
+static constexpr const char* INTERFACE_DBUS = "org.freedesktop.DBus";
+
+static constexpr const char* INTERFACE_BLUEZ_ADAPTER = "org.bluez.Adapter1";
+static constexpr const char* INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER = "org.bluez.LEAdvertisingManager1";
+static constexpr const char* INTERFACE_BLUEZ_DEVICE = "org.bluez.Device1";
+
+#pragma region BluezAdapterProxy
+BluezAdapterProxy::BluezAdapterProxy(std::shared_ptr<DBus::Connection> conn, DBus::Path path): DBus::ObjectProxy(conn, BLUEZ_BUS_NAME, path) {
+    alias = this->create_property<std::string>(INTERFACE_BLUEZ_ADAPTER, "Alias");
+    powered = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Powered");
+    discoverable = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Discoverable");
+    pairable = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Pairable");
+
+    registerAdvertisement = this->create_method<void(DBus::Path, DBus::Properties)>(INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER, "RegisterAdvertisement");
+    unregisterAdvertisement = this->create_method<void(DBus::Path)>(INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER, "UnregisterAdvertisement");
+
+    propertiesChanged = this->create_signal<void(std::string, DBus::Properties, std::vector<std::string>)>(INTERFACE_PROPERTIES, "PropertiesChanged");
+}
+
+/* static */ std::shared_ptr<BluezAdapterProxy> BluezAdapterProxy::create(std::shared_ptr<DBus::Connection> conn, DBus::Path path) {
+    return std::shared_ptr<BluezAdapterProxy>(new BluezAdapterProxy(conn, path));
+}
+#pragma endregion BluezAdapterProxy
+
+#pragma region BluezDeviceProxy
+BluezDeviceProxy::BluezDeviceProxy(std::shared_ptr<DBus::Connection> conn, DBus::Path path): DBus::ObjectProxy(conn, BLUEZ_BUS_NAME, path) {
+    connectProfile = this->create_method<void(std::string)>(INTERFACE_BLUEZ_DEVICE, "ConnectProfile");
+    disconnect = this->create_method<void()>(INTERFACE_BLUEZ_DEVICE, "Disconnect");
+
+    propertiesChanged = this->create_signal<void(std::string, DBus::Properties, std::vector<std::string>)>(INTERFACE_PROPERTIES, "PropertiesChanged");
+}
+
+/* static */ std::shared_ptr<BluezDeviceProxy> BluezDeviceProxy::create(std::shared_ptr<DBus::Connection> conn, DBus::Path path) {
+    return std::shared_ptr<BluezDeviceProxy>(new BluezDeviceProxy(conn, path));
+}
+#pragma endregion BluezDeviceProxy
+
+#pragma region BluezObjectMirror
+BluezObjectMirror::BluezObjectMirror(std::shared_ptr<DBus::Connection> connection, std::function<void()> adaptersChanged, std::function<void()> ownerChanged):
+    m_connection(connection), m_adaptersChanged(adaptersChanged), m_ownerChanged(ownerChanged) {}
+
+void BluezObjectMirror::start() {
+    m_root = m_connection->create_object_proxy(BLUEZ_BUS_NAME, BLUEZ_ROOT_OBJECT_PATH);
+    m_bus = m_connection->create_object_proxy(DBUS_BUS_NAME, DBUS_OBJECT_PATH);
+
+    // Subscribe first, an object added in between is then seen twice rather than never.
+    m_root->create_signal<void(DBus::Path, DBus::Interfaces)>(INTERFACE_OBJECT_MANAGER, "InterfacesAdded")
+        ->connect(sigc::mem_fun(*this, &BluezObjectMirror::interfacesAdded));
+    m_root->create_signal<void(DBus::Path, std::vector<std::string>)>(INTERFACE_OBJECT_MANAGER, "InterfacesRemoved")
+        ->connect(sigc::mem_fun(*this, &BluezObjectMirror::interfacesRemoved));
+    m_bus->create_signal<void(std::string, std::string, std::string)>(INTERFACE_DBUS, "NameOwnerChanged")
+        ->connect(sigc::mem_fun(*this, &BluezObjectMirror::nameOwnerChanged));
+
+    reload();
+}
+
+void BluezObjectMirror::reload() {
+    DBus::MethodProxy getManagedObjects = *(m_root->create_method<DBus::ManagedObjects(void)>(INTERFACE_OBJECT_MANAGER, "GetManagedObjects"));
+    DBus::ManagedObjects objects = getManagedObjects();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto const& [path, interfaces]: objects) {
+        add(path, interfaces);
+    }
+
+    Logger::instance()->info("Bluetooth: Found %zu adapters and %zu devices\n", m_adapters.size(), m_devices.size());
+}
+
+std::optional<DBus::Path> BluezObjectMirror::firstAdapter() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_adapters.empty()) {
+        return std::nullopt;
+    }
+
+    return m_adapters.begin()->first;
+}
+
+std::shared_ptr<BluezAdapterProxy> BluezObjectMirror::adapter(DBus::Path path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_adapters.find(path);
+    return it != m_adapters.end() ? it->second.proxy : nullptr;
+}
+
+std::vector<BluezObjectMirror::Device> BluezObjectMirror::devices() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<Device> devices;
+    for (auto const& [path, entry]: m_devices) {
+        auto connected = entry.properties.find("Connected");
+        devices.push_back({
+            path,
+            connected != entry.properties.end() && connected->second.to_type<bool>(),
+            entry.proxy,
+        });
+    }
+
+    return devices;
+}
+
+bool BluezObjectMirror::add(DBus::Path path, const DBus::Interfaces& interfaces) {
+    bool adapterAdded = false;
+
+    for (auto const& [interface, properties]: interfaces) {
+        if (interface == INTERFACE_BLUEZ_ADAPTER) {
+            auto [it, inserted] = m_adapters.try_emplace(path);
+            if (inserted) {
+                it->second.proxy = BluezAdapterProxy::create(m_connection, path);
+                subscribe(path, it->second.proxy);
+                adapterAdded = true;
+            }
+            it->second.properties = properties;
+        }
+        else if (interface == INTERFACE_BLUEZ_DEVICE) {
+            auto [it, inserted] = m_devices.try_emplace(path);
+            if (inserted) {
+                it->second.proxy = BluezDeviceProxy::create(m_connection, path);
+                subscribe(path, it->second.proxy);
+            }
+            it->second.properties = properties;
+        }
+    }
+
+    return adapterAdded;
+}
+
+template <typename Proxy>
+void BluezObjectMirror::subscribe(DBus::Path path, std::shared_ptr<Proxy> proxy) {
+    if (!proxy->propertiesChanged) {
+        Logger::instance()->info("Bluetooth: Cannot follow property changes of %s\n", path.c_str());
+        return;
+    }
+
+    proxy->propertiesChanged->connect([this, path](std::string interface, DBus::Properties changed, std::vector<std::string> invalidated) {
+        propertiesChanged(path, interface, changed, invalidated);
+    });
+}
+
+void BluezObjectMirror::interfacesAdded(DBus::Path path, DBus::Interfaces interfaces) {
+    bool adapterAdded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        adapterAdded = add(path, interfaces);
+    }
+
+    if (adapterAdded) {
+        Logger::instance()->info("Bluetooth: Adapter added at path: %s\n", path.c_str());
+        m_adaptersChanged();
+    }
+}
+
+void BluezObjectMirror::interfacesRemoved(DBus::Path path, std::vector<std::string> interfaces) {
+    bool adapterRemoved = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::string& interface: interfaces) {
+            if (interface == INTERFACE_BLUEZ_ADAPTER) {
+                adapterRemoved = m_adapters.erase(path) > 0;
+            }
+            else if (interface == INTERFACE_BLUEZ_DEVICE) {
+                m_devices.erase(path);
+            }
+        }
+    }
+
+    if (adapterRemoved) {
+        Logger::instance()->info("Bluetooth: Adapter removed at path: %s\n", path.c_str());
+        m_adaptersChanged();
+    }
+}
+
+void BluezObjectMirror::nameOwnerChanged(std::string name, std::string oldOwner, std::string newOwner) {
+    if (name != BLUEZ_BUS_NAME) {
+        return;
+    }
+
+    // The proxies would keep talking to objects that are gone, a new owner starts from scratch.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_adapters.clear();
+        m_devices.clear();
+    }
+
+    Logger::instance()->info("Bluetooth: %s %s\n", BLUEZ_BUS_NAME, newOwner.empty() ? "went away" : "has a new owner");
+    m_ownerChanged();
+}
+
+void BluezObjectMirror::propertiesChanged(DBus::Path path, std::string interface, DBus::Properties changed, std::vector<std::string> invalidated) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    DBus::Properties* properties = nullptr;
+    if (interface == INTERFACE_BLUEZ_ADAPTER) {
+        if (auto it = m_adapters.find(path); it != m_adapters.end()) {
+            properties = &it->second.properties;
+        }
+    }
+    else if (interface == INTERFACE_BLUEZ_DEVICE) {
+        if (auto it = m_devices.find(path); it != m_devices.end()) {
+            properties = &it->second.properties;
+        }
+    }
+
+    if (!properties) {
+        return;
+    }
+
+    for (auto const& [name, value]: changed) {
+        (*properties)[name] = value;
+    }
+    for (const std::string& name: invalidated) {
+        properties->erase(name);
+    }
+}
+#pragma endregion BluezObjectMirror
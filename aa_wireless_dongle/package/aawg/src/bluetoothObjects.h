@@ -0,0 +1,100 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "bluetoothCommon.h"
+
+typedef DBus::SignalProxy<void(std::string, DBus::Properties, std::vector<std::string>)> PropertiesChangedSignal;
+
+class BluezAdapterProxy: private DBus::ObjectProxy {
+    BluezAdapterProxy(std::shared_ptr<DBus::Connection> conn, DBus::Path path);
+
+public:
+    static std::shared_ptr<BluezAdapterProxy> create(std::shared_ptr<DBus::Connection> conn, DBus::Path path);
+
+    std::shared_ptr<DBus::PropertyProxy<std::string>> alias;
+    std::shared_ptr<DBus::PropertyProxy<bool>> powered;
+    std::shared_ptr<DBus::PropertyProxy<bool>> discoverable;
+    std::shared_ptr<DBus::PropertyProxy<bool>> pairable;
+
+    std::shared_ptr<DBus::MethodProxy<void(DBus::Path, DBus::Properties)>> registerAdvertisement;
+    std::shared_ptr<DBus::MethodProxy<void(DBus::Path)>> unregisterAdvertisement;
+
+    std::shared_ptr<PropertiesChangedSignal> propertiesChanged;
+};
+
+class BluezDeviceProxy: private DBus::ObjectProxy {
+    BluezDeviceProxy(std::shared_ptr<DBus::Connection> conn, DBus::Path path);
+
+public:
+    static std::shared_ptr<BluezDeviceProxy> create(std::shared_ptr<DBus::Connection> conn, DBus::Path path);
+
+    std::shared_ptr<DBus::MethodProxy<void(std::string)>> connectProfile;
+    std::shared_ptr<DBus::MethodProxy<void()>> disconnect;
+
+    std::shared_ptr<PropertiesChangedSignal> propertiesChanged;
+};
+
+/**
+ * Local copy of the BlueZ adapters and devices with their properties.
+ *
+ * Fetched once with GetManagedObjects, then kept current from the InterfacesAdded, InterfacesRemoved and
+ * PropertiesChanged signals, so lookups need no round trip to bluetoothd and the proxies are only built once
+ * per object. The signals are handled on the dispatcher thread, lookups are safe from any thread.
+ *
+ * bluetoothd sends no InterfacesRemoved when it crashes. When org.bluez changes owner, the copy is dropped
+ * and has to be fetched again from the new owner with reload().
+ */
+class BluezObjectMirror {
+public:
+    struct Device {
+        DBus::Path path;
+        bool connected;
+        std::shared_ptr<BluezDeviceProxy> proxy;
+    };
+
+    // The callbacks run on the dispatcher thread, whenever an adapter appears or disappears, and whenever
+    // bluetoothd stopped or started.
+    BluezObjectMirror(std::shared_ptr<DBus::Connection> connection, std::function<void()> adaptersChanged, std::function<void()> ownerChanged);
+
+    // Subscribe and fetch the objects. Blocking, like reload().
+    void start();
+    // Fetch the objects again. Blocking, not on the dispatcher thread. Throws DBus::Error if bluetoothd does not answer.
+    void reload();
+
+    // First adapter in path order, like the order of GetManagedObjects
+    std::optional<DBus::Path> firstAdapter();
+    std::shared_ptr<BluezAdapterProxy> adapter(DBus::Path path);
+    std::vector<Device> devices();
+
+private:
+    template <typename Proxy>
+    struct Entry {
+        DBus::Properties properties;
+        std::shared_ptr<Proxy> proxy;
+    };
+
+    void interfacesAdded(DBus::Path path, DBus::Interfaces interfaces);
+    void interfacesRemoved(DBus::Path path, std::vector<std::string> interfaces);
+    void propertiesChanged(DBus::Path path, std::string interface, DBus::Properties changed, std::vector<std::string> invalidated);
+    void nameOwnerChanged(std::string name, std::string oldOwner, std::string newOwner);
+
+    // Needs the mutex held, returns true if an adapter was added.
+    bool add(DBus::Path path, const DBus::Interfaces& interfaces);
+    template <typename Proxy>
+    void subscribe(DBus::Path path, std::shared_ptr<Proxy> proxy);
+
+    std::shared_ptr<DBus::Connection> m_connection;
+    std::function<void()> m_adaptersChanged;
+    std::function<void()> m_ownerChanged;
+    std::shared_ptr<DBus::ObjectProxy> m_root;
+    std::shared_ptr<DBus::ObjectProxy> m_bus;
+
+    std::mutex m_mutex;
+    std::map<DBus::Path, Entry<BluezAdapterProxy>> m_adapters;
+    std::map<DBus::Path, Entry<BluezDeviceProxy>> m_devices;
+};
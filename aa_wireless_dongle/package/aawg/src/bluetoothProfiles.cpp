@@ -5,8 +5,10 @@
 #include <arpa/inet.h>
 
 #include "common.h"
+#include "stats.h"
 #include "bluetoothHandler.h"
 #include "bluetoothProfiles.h"
+#include "wirelessMessage.h"
 
 #include <google/protobuf/message_lite.h>
 #include "proto/WifiStartRequest.pb.h"
@@ -29,7 +31,7 @@ class AAWirelessLauncher {
 public:
     AAWirelessLauncher(int fd): m_fd(fd) {};
 
-    void launch() {
+    bool launch() {
         // Make fd blocking
         int fd_flags = fcntl(m_fd, F_GETFL);
         fcntl(m_fd, F_SETFL, fd_flags & ~O_NONBLOCK);
@@ -47,7 +49,7 @@ public:
 
         if (messageId != MessageId::WifiInfoRequest) {
             Logger::instance()->info("Expected WifiInfoRequest, got %s (%d). Abort.\n", MessageName(messageId), messageId);
-            return;
+            return false;
         }
 
         Logger::instance()->info("Sending WifiInfoResponse (ssid: %s, bssid: %s)\n", wifiInfo.ssid.c_str(), wifiInfo.bssid.c_str());
@@ -62,6 +64,7 @@ public:
 
         ReadMessage();
         ReadMessage();
+        return true;
     }
 
 private:
@@ -97,29 +100,15 @@ private:
     }
 
     void SendMessage(MessageId messageId, google::protobuf::MessageLite* message) {
-        uint16_t messageSize = (uint16_t)message->ByteSizeLong();
-        uint16_t length = messageSize + 4;
+        std::vector<unsigned char> buffer = WirelessMessage::encode(static_cast<uint16_t>(messageId), *message);
 
-        unsigned char* buffer = new unsigned char[length];
-
-        uint16_t networkShort = 0;
-        networkShort = htons(messageSize);
-        memcpy(buffer, &networkShort, sizeof(networkShort));
-
-        networkShort = htons(static_cast<uint16_t>(messageId));
-        memcpy(buffer + 2, &networkShort, sizeof(networkShort));
-
-        message->SerializeToArray(buffer + 4, messageSize);
-
-        ssize_t wrote = write(m_fd, buffer, length);
+        ssize_t wrote = write(m_fd, buffer.data(), buffer.size());
         if (wrote < 0) {
             Logger::instance()->info("Error sending %s, messageId: %d\n", MessageName(messageId).c_str(), messageId);
         }
         else {
             Logger::instance()->info("Sent %s, messageId: %d, wrote %d bytes\n", MessageName(messageId).c_str(), messageId, wrote);
         }
-
-        delete[] buffer;
     }
 
     MessageId ReadMessage() {
@@ -164,9 +153,16 @@ void AAWirelessProfile::Release() {
 void AAWirelessProfile::NewConnection(DBus::Path path, std::shared_ptr<DBus::FileDescriptor> fd, DBus::Properties fdProperties) {
     Logger::instance()->info("AA Wireless NewConnection\n");
     Logger::instance()->info("Path: %s, fd: %d\n", path.c_str(), fd->descriptor());
+    BluetoothHandler::instance().profileConnected();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!AAWirelessLauncher(fd->descriptor()).launch()) {
+        return;
+    }
 
-    AAWirelessLauncher(fd->descriptor()).launch();
-    Logger::instance()->info("Bluetooth launch sequence completed\n");
+    std::chrono::steady_clock::duration duration = std::chrono::steady_clock::now() - start;
+    Stats::instance().addBluetoothHandshake(duration);
+    Logger::instance()->info("Bluetooth launch sequence completed in %lld ms\n", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
 }
 
 void AAWirelessProfile::RequestDisconnection(DBus::Path path) {
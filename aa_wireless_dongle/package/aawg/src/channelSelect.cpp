@@ -0,0 +1,154 @@
+/*
+ * Picks the least congested wifi channel for the access point and writes it into the hostapd configuration.
+ *
+ * Usage: aawg-channelselect [-i interface] [-r recorded_dir] [-c channel] hostapd.conf
+ *
+ * With -c the given channel is used if the radio allows it, otherwise the channel is chosen from a scan on
+ * the interface. With -r, iw output recorded into recorded_dir stands in for the interface.
+ * The configuration is left untouched if no channel can be chosen.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "wifiChannel.h"
+
+static std::optional<int> selectChannel(ScanSource& source) {
+    std::vector<WifiChannel::Channel> channels = source.channels();
+    if (channels.empty()) {
+        fprintf(stderr, "No channels reported by the radio\n");
+        return std::nullopt;
+    }
+
+    // The scan holds back hostapd at boot, so its duration is worth keeping an eye on.
+    auto start = std::chrono::steady_clock::now();
+    std::vector<WifiChannel::Survey> surveys = source.survey();
+    std::vector<WifiChannel::Bss> bssList = source.scan();
+    long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    printf("Found %zu networks, survey data for %zu channels, in %lld ms\n", bssList.size(), surveys.size(), elapsed);
+
+    std::vector<WifiChannel::Score> scores = WifiChannel::scoreChannels(channels, surveys, bssList);
+    if (scores.empty()) {
+        fprintf(stderr, "No usable channels\n");
+        return std::nullopt;
+    }
+
+    for (const WifiChannel::Score& score: scores) {
+        printf("channel=%d freq=%d networks=%d interference=%.1f dBm busy=%.0f%% score=%.1f\n",
+            score.channel.number, score.channel.frequency, score.bssCount, score.interference, score.busyFraction * 100, score.score);
+    }
+
+    return scores.front().channel.number;
+}
+
+static bool writeConfig(const std::string& path, int channel) {
+    std::ifstream input(path);
+    if (!input) {
+        fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    bool band5GHz = channel > 14;
+
+    std::stringstream output;
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.rfind("channel=", 0) == 0) {
+            line = "channel=" + std::to_string(channel);
+        }
+        else if (line.rfind("hw_mode=", 0) == 0) {
+            line = band5GHz ? "hw_mode=a" : "hw_mode=g";
+        }
+        else if (line.rfind("ieee80211ac=", 0) == 0 && !band5GHz) {
+            // VHT is only available on 5 GHz
+            line = "ieee80211ac=0";
+        }
+        output << line << '\n';
+    }
+    input.close();
+
+    // Replace the file in one step, hostapd must never see a partial configuration.
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath);
+    file << output.str();
+    file.close();
+
+    if (!file || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string interface = "wlan0";
+    std::string recordedDirectory;
+    std::string channelOption = "auto";
+
+    int option;
+    while ((option = getopt(argc, argv, "i:r:c:")) != -1) {
+        switch (option) {
+            case 'i':
+                interface = optarg;
+                break;
+            case 'r':
+                recordedDirectory = optarg;
+                break;
+            case 'c':
+                channelOption = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-i interface] [-r recorded_dir] [-c channel] hostapd.conf\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-i interface] [-r recorded_dir] [-c channel] hostapd.conf\n", argv[0]);
+        return 2;
+    }
+
+    std::unique_ptr<ScanSource> source;
+    if (!recordedDirectory.empty()) {
+        source = std::make_unique<RecordedScanSource>(recordedDirectory);
+    }
+    else {
+        source = std::make_unique<IwScanSource>(interface);
+    }
+
+    std::optional<int> channel;
+    if (channelOption != "auto") {
+        channel = WifiChannel::parseChannelNumber(channelOption);
+        if (!channel) {
+            fprintf(stderr, "Invalid channel %s\n", channelOption.c_str());
+        }
+        else if (!WifiChannel::isAllowed(*channel, source->channels())) {
+            fprintf(stderr, "Channel %d is not allowed by the radio\n", *channel);
+            channel = std::nullopt;
+        }
+    }
+    else {
+        channel = selectChannel(*source);
+    }
+
+    if (!channel) {
+        fprintf(stderr, "Keeping the configured channel\n");
+        return 1;
+    }
+
+    if (!writeConfig(argv[optind], *channel)) {
+        return 1;
+    }
+
+    printf("Using channel %d\n", *channel);
+    return 0;
+}
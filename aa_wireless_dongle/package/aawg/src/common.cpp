@@ -5,6 +5,7 @@
 #include <syslog.h>
 
 #include "common.h"
+#include "eventLog.h"
 #include "proto/WifiInfoResponse.pb.h"
 
 #pragma region Config
@@ -88,6 +89,86 @@ ConnectionStrategy Config::getConnectionStrategy() {
 
     return connectionStrategy.value();
 }
+
+std::string Config::getControlSocketPath() {
+    return getenv("AAWG_CONTROL_SOCKET", "/run/aawgd.sock");
+}
+
+std::string Config::getDbusAddress() {
+    return getenv("AAWG_DBUS_ADDRESS", "");
+}
+
+std::string Config::getFlightRecorderFile() {
+    return getenv("AAWG_FLIGHT_RECORDER_FILE", "/persist/aawgd.flight");
+}
+
+std::string Config::getHostapdCtrlPath() {
+    return getenv("AAWG_HOSTAPD_CTRL", "/var/run/hostapd/wlan0");
+}
+
+std::string Config::getCpuActiveGovernor() {
+    return getenv("AAWG_CPU_ACTIVE_GOVERNOR", "performance");
+}
+
+std::string Config::getCpuActiveMinFrequency() {
+    return getenv("AAWG_CPU_ACTIVE_MIN_FREQ", "");
+}
+
+std::chrono::milliseconds Config::getCpuIdleDelay() {
+    return std::chrono::milliseconds(getenv("AAWG_CPU_IDLE_DELAY_MS", 30000));
+}
+
+std::chrono::milliseconds Config::getBleFastInterval() {
+    return std::chrono::milliseconds(getenv("AAWG_BLE_FAST_INTERVAL_MS", 30));
+}
+
+std::chrono::milliseconds Config::getBleFastPeriod() {
+    return std::chrono::milliseconds(getenv("AAWG_BLE_FAST_PERIOD_MS", 30000));
+}
+
+std::chrono::milliseconds Config::getBleSlowInterval() {
+    return std::chrono::milliseconds(getenv("AAWG_BLE_SLOW_INTERVAL_MS", 1000));
+}
+
+std::chrono::milliseconds Config::getBleBurstPeriod() {
+    return std::chrono::milliseconds(getenv("AAWG_BLE_BURST_PERIOD_MS", 0));
+}
+
+std::chrono::milliseconds Config::getBluetoothReconnectWindow() {
+    return std::chrono::milliseconds(getenv("AAWG_BT_RECONNECT_WINDOW_MS", 0));
+}
+
+std::chrono::microseconds Config::getBluetoothReconnectScanWindow() {
+    return std::chrono::microseconds(getenv("AAWG_BT_RECONNECT_SCAN_WINDOW_US", 0));
+}
+
+std::chrono::milliseconds Config::getUsbMinimumDetachTime() {
+    return std::chrono::milliseconds(getenv("AAWG_USB_MIN_DETACH_MS", 100));
+}
+
+std::string Config::getConfigfsRoot() {
+    return getenv("AAWG_CONFIGFS_ROOT", "/sys/kernel/config");
+}
+
+std::string Config::getSysfsRoot() {
+    return getenv("AAWG_SYSFS_ROOT", "/sys");
+}
+
+std::string Config::getDevRoot() {
+    return getenv("AAWG_DEV_ROOT", "/dev");
+}
+
+std::string Config::getRunRoot() {
+    return getenv("AAWG_RUN_ROOT", "/var/run");
+}
+
+std::string Config::getUeventRecordFile() {
+    return getenv("AAWG_UEVENT_RECORD_FILE", "");
+}
+
+std::string Config::getUeventReplayFile() {
+    return getenv("AAWG_UEVENT_REPLAY_FILE", "");
+}
 #pragma endregion Config
 
 #pragma region Logger
@@ -105,6 +186,9 @@ Logger::~Logger() {
 }
 
 void Logger::info(const char *format, ...) {
+    // Events logged before this line must not come out after it.
+    EventLog::instance().flush();
+
     va_list args;
     va_start(args, format);
     vsyslog(LOG_INFO, format, args);
@@ -3,6 +3,7 @@
 #include <string>
 #include <cstdint>
 #include <optional>
+#include <chrono>
 
 enum SecurityMode: int;
 enum AccessPointType: int;
@@ -29,8 +30,34 @@ public:
 
     WifiInfo getWifiInfo();
     ConnectionStrategy getConnectionStrategy();
+    std::string getControlSocketPath();
+    std::string getDbusAddress();
+    std::string getFlightRecorderFile();
+    std::string getHostapdCtrlPath();
+
+    std::string getCpuActiveGovernor();
+    std::string getCpuActiveMinFrequency();
+    std::chrono::milliseconds getCpuIdleDelay();
+
+    std::chrono::milliseconds getBleFastInterval();
+    std::chrono::milliseconds getBleFastPeriod();
+    std::chrono::milliseconds getBleSlowInterval();
+    std::chrono::milliseconds getBleBurstPeriod();
+
+    std::chrono::milliseconds getBluetoothReconnectWindow();
+    std::chrono::microseconds getBluetoothReconnectScanWindow();
+
+    std::chrono::milliseconds getUsbMinimumDetachTime();
 
     std::string getUniqueSuffix();
+
+    std::string getConfigfsRoot();
+    std::string getSysfsRoot();
+    std::string getDevRoot();
+    std::string getRunRoot();
+
+    std::string getUeventRecordFile();
+    std::string getUeventReplayFile();
 private:
     Config() = default;
 
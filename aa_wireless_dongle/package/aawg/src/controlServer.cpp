@@ -0,0 +1,154 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "stats.h"
+#include "controlServer.h"
+#include "cpuFreq.h"
+#include "linkMonitor.h"
+
+ControlServer& ControlServer::instance() {
+    static ControlServer instance;
+    return instance;
+}
+
+void ControlServer::setReconnectHandler(std::function<void()> handler) {
+    std::lock_guard<std::mutex> lock(m_reconnectHandlerMutex);
+    m_reconnectHandler = handler;
+}
+
+std::string ControlServer::handleCommand(std::string command) {
+    if (command.empty() || command == "stats") {
+        return Stats::instance().summary();
+    }
+    else if (command == "timelines") {
+        return Stats::instance().timelines();
+    }
+    else if (command == "cpu") {
+        return CpuFreqManager::instance().summary();
+    }
+    else if (command == "link") {
+        return LinkController::instance().summary();
+    }
+    else if (command == "trace") {
+        return Stats::instance().trace();
+    }
+    else if (command == "capture") {
+        bool capture = !Stats::instance().getCapture();
+        Stats::instance().setCapture(capture);
+        Logger::instance()->info("Control: Capture %s\n", capture ? "enabled" : "disabled");
+        return std::string("capture=") + (capture ? "1" : "0") + "\n";
+    }
+    else if (command == "reconnect") {
+        std::lock_guard<std::mutex> lock(m_reconnectHandlerMutex);
+        if (!m_reconnectHandler) {
+            return "error=no_session\n";
+        }
+
+        Logger::instance()->info("Control: Forcing reconnect\n");
+        m_reconnectHandler();
+        return "ok\n";
+    }
+
+    return "error=unknown_command\n";
+}
+
+EventLoop::Task ControlServer::handleClient(int client_sock) {
+    // Do not keep the socket of a client that sends nothing
+    if (!co_await EventLoop::instance().readable(client_sock, CLIENT_TIMEOUT)) {
+        close(client_sock);
+        co_return;
+    }
+
+    char buffer[64];
+    ssize_t len = read(client_sock, buffer, sizeof(buffer) - 1);
+    if (len < 0) {
+        close(client_sock);
+        co_return;
+    }
+
+    std::string command(buffer, len);
+    command.erase(command.find_last_not_of(" \r\n") + 1);
+
+    std::string response = handleCommand(command);
+
+    // Responses fit in the socket buffer, a client that does not read them only loses them.
+    const char* data = response.c_str();
+    size_t remaining = response.size();
+    while (remaining > 0) {
+        ssize_t wlen = write(client_sock, data, remaining);
+        if (wlen <= 0) {
+            break;
+        }
+        data += wlen;
+        remaining -= wlen;
+    }
+
+    close(client_sock);
+}
+
+EventLoop::Task ControlServer::serve(int server_sock) {
+    while (true) {
+        co_await EventLoop::instance().readable(server_sock);
+
+        int client_sock = accept4(server_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sock < 0) {
+            continue;
+        }
+
+        // Runs until it waits for the command, then accepting continues.
+        handleClient(client_sock);
+    }
+}
+
+EventLoop::Task ControlServer::sampleStats() {
+    std::chrono::steady_clock::time_point nextSample = std::chrono::steady_clock::now();
+
+    while (true) {
+        nextSample += std::chrono::seconds(1);
+        co_await EventLoop::instance().sleepUntil(nextSample);
+
+        Stats::instance().sample();
+    }
+}
+
+bool ControlServer::start() {
+    std::string path = Config::instance()->getControlSocketPath();
+    if (path.empty()) {
+        return false;
+    }
+
+    int server_sock;
+    if ((server_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        Logger::instance()->info("Control: creating socket failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    struct sockaddr_un address = {
+        .sun_family = AF_UNIX,
+    };
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    unlink(path.c_str());
+    if (bind(server_sock, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        Logger::instance()->info("Control: bind failed for %s: %s\n", path.c_str(), strerror(errno));
+        close(server_sock);
+        return false;
+    }
+
+    if (listen(server_sock, 4) < 0) {
+        Logger::instance()->info("Control: listen failed: %s\n", strerror(errno));
+        close(server_sock);
+        return false;
+    }
+
+    Logger::instance()->info("Control: listening on %s\n", path.c_str());
+
+    EventLoop::instance().spawn([this, server_sock]() { return serve(server_sock); });
+    EventLoop::instance().spawn([this]() { return sampleStats(); });
+
+    return true;
+}
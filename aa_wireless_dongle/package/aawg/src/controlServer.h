@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "eventLoop.h"
+
+/**
+ * Serves stats and accepts a few commands on a local unix socket, on the event loop.
+ *
+ * Each connection sends a single command line and gets the response back before the socket is closed:
+ *   stats (or empty)  Single line summary of the current state
+ *   timelines         State changes of the last few sessions
+ *   cpu               CPU frequency state and usage of the last session
+ *   link              Wifi link quality of the phone and the adjustments made for it
+ *   trace             Captured frame headers
+ *   capture           Toggle capturing frame headers
+ *   reconnect         Drop the current phone connection
+ */
+class ControlServer {
+public:
+    static ControlServer& instance();
+
+    bool start();
+
+    void setReconnectHandler(std::function<void()> handler);
+
+private:
+    // Longest wait for the command of a client
+    static constexpr std::chrono::milliseconds CLIENT_TIMEOUT = std::chrono::milliseconds(100);
+
+    ControlServer() {};
+    ControlServer(ControlServer const&);
+    ControlServer& operator=(ControlServer const&);
+
+    EventLoop::Task serve(int server_sock);
+    EventLoop::Task handleClient(int client_sock);
+    EventLoop::Task sampleStats();
+    std::string handleCommand(std::string command);
+
+    std::function<void()> m_reconnectHandler;
+    std::mutex m_reconnectHandlerMutex;
+};
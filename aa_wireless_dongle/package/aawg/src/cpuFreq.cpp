@@ -0,0 +1,271 @@
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "common.h"
+#include "cpuFreq.h"
+
+static std::optional<std::string> readFile(const std::string& path) {
+    std::ifstream file(path);
+    std::string value;
+    if (!std::getline(file, value)) {
+        return std::nullopt;
+    }
+
+    return value;
+}
+
+static bool writeFile(const std::string& path, const std::string& value) {
+    std::ofstream file(path);
+    file << value;
+    file.close();
+
+    if (!file) {
+        Logger::instance()->info("CPU: Writing %s to %s failed\n", value.c_str(), path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*static*/ CpuFreqManager& CpuFreqManager::instance() {
+    static CpuFreqManager instance;
+    return instance;
+}
+
+void CpuFreqManager::start() {
+    m_activeGovernor = Config::instance()->getCpuActiveGovernor();
+    m_activeMinFrequency = Config::instance()->getCpuActiveMinFrequency();
+    m_idleDelay = Config::instance()->getCpuIdleDelay();
+    m_sysfsRoot = Config::instance()->getSysfsRoot();
+
+    std::string cpufreqPath = m_sysfsRoot + "/devices/system/cpu/cpufreq";
+    if (DIR* dir = opendir(cpufreqPath.c_str())) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (strncmp(entry->d_name, "policy", strlen("policy")) != 0) {
+                continue;
+            }
+
+            std::string path = cpufreqPath + "/" + entry->d_name;
+            m_policies.push_back({
+                path,
+                readFile(path + "/scaling_governor").value_or(""),
+                readFile(path + "/scaling_min_freq").value_or(""),
+                readFile(path + "/cpuinfo_max_freq").value_or(""),
+            });
+        }
+        closedir(dir);
+    }
+
+    if (m_activeGovernor.empty() && m_activeMinFrequency.empty()) {
+        Logger::instance()->info("CPU: Frequency management disabled\n");
+        m_policies.clear();
+    }
+    else {
+        Logger::instance()->info("CPU: Managing %zu cpufreq policies, active governor '%s', active min frequency '%s'\n",
+            m_policies.size(), m_activeGovernor.c_str(), m_activeMinFrequency.c_str());
+    }
+
+    EventLoop::instance().spawn([this]() { return managerLoop(); });
+}
+
+void CpuFreqManager::applyActive() {
+    for (const Policy& policy: m_policies) {
+        if (!m_activeGovernor.empty()) {
+            writeFile(policy.path + "/scaling_governor", m_activeGovernor);
+        }
+
+        if (!m_activeMinFrequency.empty()) {
+            writeFile(policy.path + "/scaling_min_freq", m_activeMinFrequency == "max" ? policy.maxFrequency : m_activeMinFrequency);
+        }
+    }
+}
+
+void CpuFreqManager::applyIdle() {
+    for (const Policy& policy: m_policies) {
+        if (!m_activeGovernor.empty() && !policy.governor.empty()) {
+            writeFile(policy.path + "/scaling_governor", policy.governor);
+        }
+
+        if (!m_activeMinFrequency.empty() && !policy.minFrequency.empty()) {
+            writeFile(policy.path + "/scaling_min_freq", policy.minFrequency);
+        }
+    }
+}
+
+void CpuFreqManager::setActive(bool active) {
+    if (m_active == active) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    (m_active ? m_activeTime : m_idleTime) += now - m_stateChangeTime;
+    m_stateChangeTime = now;
+    m_active = active;
+    m_transitions++;
+
+    if (active) {
+        applyActive();
+    }
+    else {
+        applyIdle();
+    }
+
+    Logger::instance()->info("CPU: Switched to %s settings\n", active ? "active" : "idle");
+}
+
+void CpuFreqManager::setForwarding(bool forwarding) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_forwarding == forwarding) {
+        return;
+    }
+    m_forwarding = forwarding;
+
+    auto now = std::chrono::steady_clock::now();
+    if (forwarding) {
+        // Never wait to speed up, the first frames of a session are the most latency sensitive.
+        setActive(true);
+
+        m_sessionStartTime = now;
+        m_sessionStartTimes = readCpuTimes();
+        m_lastThrottled = readThrottled().value_or(0);
+        m_throttleEvents = 0;
+        m_maxTemperature = readTemperature().value_or(0);
+        return;
+    }
+
+    m_forwardingEndTime = now;
+
+    CpuTimes end = readCpuTimes();
+    uint64_t total = end.total - m_sessionStartTimes.total;
+    long cpus = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    SessionReport report = {
+        now - m_sessionStartTime,
+        total > 0 ? 100.0 * (end.process - m_sessionStartTimes.process) * cpus / total : 0,
+        total > 0 ? 100.0 * (end.busy - m_sessionStartTimes.busy) / total : 0,
+        m_throttleEvents,
+        m_maxTemperature,
+    };
+    m_lastSession = report;
+    m_sessions++;
+
+    Logger::instance()->info("CPU: Session took %lld s, aawgd used %.1f%% of a CPU, system %.1f%%, %llu throttle events, max temperature %.1f C\n",
+        (long long)std::chrono::duration_cast<std::chrono::seconds>(report.duration).count(),
+        report.processCpu, report.systemCpu, (unsigned long long)report.throttleEvents, report.maxTemperature);
+}
+
+EventLoop::Task CpuFreqManager::managerLoop() {
+    while (true) {
+        co_await EventLoop::instance().sleepFor(SAMPLE_INTERVAL);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_forwarding) {
+            sample();
+        }
+        else if (m_active && std::chrono::steady_clock::now() - m_forwardingEndTime >= m_idleDelay) {
+            setActive(false);
+        }
+    }
+}
+
+void CpuFreqManager::sample() {
+    // Count each time the firmware starts limiting the CPU, e.g. for under-voltage or temperature.
+    if (std::optional<uint32_t> throttled = readThrottled()) {
+        constexpr uint32_t CURRENT_THROTTLING_MASK = 0xF;
+        if ((*throttled & CURRENT_THROTTLING_MASK) & ~(m_lastThrottled & CURRENT_THROTTLING_MASK)) {
+            m_throttleEvents++;
+            Logger::instance()->info("CPU: Throttled, firmware reports 0x%x\n", *throttled);
+        }
+        m_lastThrottled = *throttled;
+    }
+
+    if (std::optional<double> temperature = readTemperature(); temperature && *temperature > m_maxTemperature) {
+        m_maxTemperature = *temperature;
+    }
+}
+
+/*static*/ CpuFreqManager::CpuTimes CpuFreqManager::readCpuTimes() {
+    CpuTimes times;
+
+    // Fields after the command name, which may contain spaces, utime and stime are the 12th and 13th of them.
+    if (std::optional<std::string> stat = readFile("/proc/self/stat")) {
+        size_t end = stat->rfind(')');
+        std::istringstream fields(end != std::string::npos ? stat->substr(end + 2) : "");
+        std::string field;
+        uint64_t utime = 0, stime = 0;
+        for (int index = 0; index < 13 && fields >> field; index++) {
+            if (index == 11) {
+                utime = strtoull(field.c_str(), nullptr, 10);
+            }
+            else if (index == 12) {
+                stime = strtoull(field.c_str(), nullptr, 10);
+            }
+        }
+        times.process = utime + stime;
+    }
+
+    // cpu user nice system idle iowait irq softirq steal
+    if (std::optional<std::string> cpu = readFile("/proc/stat")) {
+        std::istringstream fields(*cpu);
+        std::string name;
+        fields >> name;
+
+        uint64_t value;
+        for (int index = 0; index < 8 && fields >> value; index++) {
+            times.total += value;
+            if (index != 3 && index != 4) {
+                times.busy += value;
+            }
+        }
+    }
+
+    return times;
+}
+
+std::optional<uint32_t> CpuFreqManager::readThrottled() {
+    // Only available on Raspberry Pi
+    std::optional<std::string> value = readFile(m_sysfsRoot + "/devices/platform/soc/soc:firmware/get_throttled");
+    if (!value) {
+        return std::nullopt;
+    }
+
+    return strtoul(value->c_str(), nullptr, 16);
+}
+
+std::optional<double> CpuFreqManager::readTemperature() {
+    std::optional<std::string> value = readFile(m_sysfsRoot + "/class/thermal/thermal_zone0/temp");
+    if (!value) {
+        return std::nullopt;
+    }
+
+    return strtol(value->c_str(), nullptr, 10) / 1000.0;
+}
+
+std::string CpuFreqManager::summary() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto activeTime = m_activeTime;
+    auto idleTime = m_idleTime;
+    (m_active ? activeTime : idleTime) += std::chrono::steady_clock::now() - m_stateChangeTime;
+
+    char buffer[512];
+    int len = snprintf(buffer, sizeof(buffer), "cpu_state=%s active_s=%lld idle_s=%lld transitions=%llu sessions=%llu",
+        m_active ? "active" : "idle",
+        (long long)std::chrono::duration_cast<std::chrono::seconds>(activeTime).count(),
+        (long long)std::chrono::duration_cast<std::chrono::seconds>(idleTime).count(),
+        (unsigned long long)m_transitions, (unsigned long long)m_sessions);
+
+    if (m_lastSession && len < (int)sizeof(buffer)) {
+        snprintf(buffer + len, sizeof(buffer) - len, " last_session_s=%lld last_process_cpu=%.1f last_system_cpu=%.1f last_throttle_events=%llu last_max_temp=%.1f",
+            (long long)std::chrono::duration_cast<std::chrono::seconds>(m_lastSession->duration).count(),
+            m_lastSession->processCpu, m_lastSession->systemCpu,
+            (unsigned long long)m_lastSession->throttleEvents, m_lastSession->maxTemperature);
+    }
+
+    return std::string(buffer) + "\n";
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "eventLoop.h"
+
+/**
+ * Runs the CPU at full speed only while a session is forwarding. The active governor and minimum frequency
+ * are applied as soon as forwarding starts, and the original settings are restored once the dongle was
+ * idle for a while, so a phone reconnecting does not bounce the frequency.
+ *
+ * Also samples CPU usage and throttling during each session, to check the power saving costs no latency.
+ */
+class CpuFreqManager {
+public:
+    static CpuFreqManager& instance();
+
+    // Discover the cpufreq policies and start sampling on the event loop.
+    void start();
+
+    void setForwarding(bool forwarding);
+
+    // Time spent in each state and the report of the last session, as key=value pairs.
+    std::string summary();
+
+private:
+    static constexpr std::chrono::seconds SAMPLE_INTERVAL = std::chrono::seconds(1);
+
+    struct Policy {
+        std::string path;
+        std::string governor;
+        std::string minFrequency;
+        std::string maxFrequency;
+    };
+
+    struct CpuTimes {
+        uint64_t process = 0;   // clock ticks used by aawgd
+        uint64_t busy = 0;      // clock ticks used by the whole system
+        uint64_t total = 0;
+    };
+
+    struct SessionReport {
+        std::chrono::steady_clock::duration duration;
+        double processCpu;      // percent of one CPU
+        double systemCpu;       // percent of all CPUs
+        uint64_t throttleEvents;
+        double maxTemperature;  // degrees Celsius, 0 if unknown
+    };
+
+    CpuFreqManager() {};
+    CpuFreqManager(CpuFreqManager const&);
+    CpuFreqManager& operator=(CpuFreqManager const&);
+
+    EventLoop::Task managerLoop();
+
+    void applyActive();
+    void applyIdle();
+    void setActive(bool active);
+
+    void sample();
+    static CpuTimes readCpuTimes();
+    std::optional<uint32_t> readThrottled();
+    std::optional<double> readTemperature();
+
+    std::string m_activeGovernor;
+    std::string m_activeMinFrequency;
+    std::chrono::milliseconds m_idleDelay;
+    std::string m_sysfsRoot;
+    std::vector<Policy> m_policies;
+
+    std::mutex m_mutex;
+
+    bool m_forwarding = false;
+    std::chrono::steady_clock::time_point m_forwardingEndTime;
+
+    // Whether the active settings are applied, and the time spent in each
+    bool m_active = false;
+    std::chrono::steady_clock::time_point m_stateChangeTime = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration m_activeTime {};
+    std::chrono::steady_clock::duration m_idleTime {};
+    uint64_t m_transitions = 0;
+
+    // Current session
+    std::chrono::steady_clock::time_point m_sessionStartTime;
+    CpuTimes m_sessionStartTimes;
+    uint32_t m_lastThrottled = 0;
+    uint64_t m_throttleEvents = 0;
+    double m_maxTemperature = 0;
+
+    uint64_t m_sessions = 0;
+    std::optional<SessionReport> m_lastSession;
+};
@@ -0,0 +1,180 @@
+#include <string.h>
+#include <time.h>
+#include <syslog.h>
+#include <algorithm>
+#include <cstdlib>
+
+#include "common.h"
+#include "eventLog.h"
+
+static constexpr const char* s_eventFormats[] = {
+#define AAWG_LOG_EVENT_FORMAT(id, flush, format) format,
+    AAWG_LOG_EVENTS(AAWG_LOG_EVENT_FORMAT)
+#undef AAWG_LOG_EVENT_FORMAT
+};
+
+// How often the sink formats the buffered events
+static constexpr std::chrono::milliseconds SINK_INTERVAL(50);
+
+/*static*/ EventLog& EventLog::instance() {
+    static EventLog instance;
+    return instance;
+}
+
+EventLog::ThreadBufferHandle::~ThreadBufferHandle() {
+    // The sink removes the buffer once everything in it is formatted.
+    buffer->orphaned = true;
+}
+
+EventLog::ThreadBuffer& EventLog::threadBuffer() {
+    thread_local ThreadBufferHandle handle;
+
+    if (!handle.buffer) {
+        handle.buffer = std::make_shared<ThreadBuffer>();
+
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        m_buffers.push_back(handle.buffer);
+    }
+
+    return *handle.buffer;
+}
+
+void EventLog::append(Record& record) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    record.timeNs = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+    ThreadBuffer& buffer = threadBuffer();
+
+    size_t head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) >= BUFFER_CAPACITY) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer.records[head % BUFFER_CAPACITY] = record;
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+std::string EventLog::format(const Record& record) {
+    const char* format = record.event < sizeof(s_eventFormats) / sizeof(s_eventFormats[0]) ? s_eventFormats[record.event] : "Unknown event";
+
+    std::string result;
+    size_t argument = 0;
+    for (const char* current = format; *current; current++) {
+        if (*current != '%') {
+            result += *current;
+            continue;
+        }
+
+        // Skip the conversion specification, the stored argument type decides the formatting.
+        const char* end = current + 1;
+        while (*end && !strchr("diouxXeEfFgGcsp%", *end)) {
+            end++;
+        }
+        if (*end == '%' || !*end) {
+            result += '%';
+            current = *end ? end : end - 1;
+            continue;
+        }
+        current = end;
+
+        if (argument >= record.count) {
+            result += "?";
+            continue;
+        }
+
+        char buffer[64];
+        switch (record.types[argument]) {
+            case ArgumentType::INT:
+                snprintf(buffer, sizeof(buffer), "%lld", (long long)record.values[argument].i);
+                break;
+            case ArgumentType::UINT:
+                snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)record.values[argument].u);
+                break;
+            case ArgumentType::DOUBLE:
+                snprintf(buffer, sizeof(buffer), "%f", record.values[argument].d);
+                break;
+            case ArgumentType::STRING:
+                snprintf(buffer, sizeof(buffer), "%s", record.values[argument].s ? record.values[argument].s : "(null)");
+                break;
+            case ArgumentType::ERRNO:
+                snprintf(buffer, sizeof(buffer), "%s", strerror(record.values[argument].i));
+                break;
+        }
+        result += buffer;
+        argument++;
+    }
+
+    return result;
+}
+
+void EventLog::drain() {
+    std::lock_guard<std::mutex> drainLock(m_drainMutex);
+
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(m_buffersMutex);
+        buffers = m_buffers;
+    }
+
+    std::vector<Record> records;
+    uint64_t dropped = 0;
+    for (const std::shared_ptr<ThreadBuffer>& buffer: buffers) {
+        size_t tail = buffer->tail.load(std::memory_order_relaxed);
+        size_t head = buffer->head.load(std::memory_order_acquire);
+
+        for (; tail != head; tail++) {
+            records.push_back(buffer->records[tail % BUFFER_CAPACITY]);
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+
+        dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    // Keep the order of events across threads
+    std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.timeNs < b.timeNs;
+    });
+
+    // Not through Logger::info, which flushes the event log itself.
+    for (const Record& record: records) {
+        syslog(LOG_INFO, "%s\n", format(record).c_str());
+    }
+
+    if (dropped) {
+        Record record = {};
+        record.event = static_cast<uint16_t>(LogEvent::EVENTS_DROPPED);
+        record.count = 1;
+        record.types[0] = ArgumentType::UINT;
+        record.values[0].u = dropped;
+        syslog(LOG_INFO, "%s\n", format(record).c_str());
+    }
+
+    // Forget the buffers of exited threads once they are empty
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(), [](const std::shared_ptr<ThreadBuffer>& buffer) {
+        return buffer->orphaned && buffer->tail.load() == buffer->head.load();
+    }), m_buffers.end());
+}
+
+EventLoop::Task EventLog::sinkLoop() {
+    while (true) {
+        co_await EventLoop::instance().sleepFor(SINK_INTERVAL);
+        drain();
+    }
+}
+
+void EventLog::flush() {
+    drain();
+}
+
+void EventLog::start() {
+    // The syslog is opened by the logger
+    Logger::instance();
+
+    // Do not lose the events of the last moments on exit
+    std::atexit([]() { EventLog::instance().flush(); });
+
+    EventLoop::instance().spawn([this]() { return sinkLoop(); });
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "eventLoop.h"
+
+/*
+ * Events logged from latency sensitive threads. Each event has a format string which is only applied
+ * by the sink on the event loop. Arguments can be integers, floating point numbers, EventLog::Errno, and strings
+ * that live for the whole lifetime of the process, e.g. string literals.
+ *
+ * Events marked FLUSH are errors, they are written out by the logging thread right away instead of
+ * waiting for the sink, so they are not lost if the daemon dies next.
+ */
+#define AAWG_LOG_EVENTS(EVENT) \
+    EVENT(BYTES_READ, QUEUE, "%lld bytes read from %s") \
+    EVENT(BYTES_WRITTEN, QUEUE, "%lld bytes written to %s") \
+    EVENT(READ_FAILED, FLUSH, "Read from %s failed: %s") \
+    EVENT(WRITE_FAILED, FLUSH, "Write to %s failed: %s") \
+    EVENT(FIRST_BYTES_FORWARDED, QUEUE, "First bytes forwarded to USB %lld ms after accessory start request") \
+    EVENT(STOP_FORWARDING, QUEUE, "Interrupting threads to stop forwarding") \
+    EVENT(ACCESSORY_START_REQUEST, QUEUE, "USB Manager: Received accessory start request") \
+    EVENT(GADGET_SWITCHED, QUEUE, "USB Manager: Switched to accessory gadget from default in %lld us, unbind took %lld us") \
+    EVENT(GADGET_SWITCHED_WITHOUT_DETACH, QUEUE, "USB Manager: Switched to accessory gadget from default in %lld us, UDC did not report the unbind") \
+    EVENT(EVENTS_DROPPED, QUEUE, "Event log: %llu events dropped")
+
+enum class LogEvent: uint16_t {
+#define AAWG_LOG_EVENT_ID(id, flush, format) id,
+    AAWG_LOG_EVENTS(AAWG_LOG_EVENT_ID)
+#undef AAWG_LOG_EVENT_ID
+};
+
+/**
+ * Low overhead structured log. Logging an event only stores a timestamp, the event id and the raw
+ * arguments into a buffer owned by the calling thread, a coroutine on the event loop formats them into the syslog.
+ *
+ * Logger::info flushes the buffered events first, so events and plain log lines come out in the order
+ * they were logged in.
+ */
+class EventLog {
+public:
+    struct Errno {
+        int value;
+    };
+
+    static EventLog& instance();
+
+    // Start formatting the buffered events periodically on the event loop.
+    void start();
+
+    // Format all buffered events into the syslog now, from the calling thread.
+    void flush();
+
+    template <LogEvent event, typename... Args>
+    static void log(Args... args) {
+        static_assert(sizeof...(Args) <= MAX_ARGUMENTS, "Too many arguments for an event");
+
+        Record record;
+        record.event = static_cast<uint16_t>(event);
+        record.count = sizeof...(Args);
+
+        [[maybe_unused]] size_t index = 0;
+        (encode(record, index++, args), ...);
+
+        instance().append(record);
+
+        if constexpr (s_flushed[static_cast<size_t>(event)]) {
+            instance().flush();
+        }
+    }
+
+private:
+    static constexpr size_t MAX_ARGUMENTS = 4;
+    static constexpr size_t BUFFER_CAPACITY = 1024;
+
+    static constexpr bool QUEUE = false;
+    static constexpr bool FLUSH = true;
+    static constexpr bool s_flushed[] = {
+#define AAWG_LOG_EVENT_FLUSH(id, flush, format) flush,
+        AAWG_LOG_EVENTS(AAWG_LOG_EVENT_FLUSH)
+#undef AAWG_LOG_EVENT_FLUSH
+    };
+
+    enum class ArgumentType: uint8_t {
+        INT,
+        UINT,
+        DOUBLE,
+        STRING,
+        ERRNO,
+    };
+
+    struct Record {
+        uint64_t timeNs;
+        uint16_t event;
+        uint8_t count;
+        ArgumentType types[MAX_ARGUMENTS];
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+            const char* s;
+        } values[MAX_ARGUMENTS];
+    };
+
+    // Single producer, single consumer ring of records
+    struct ThreadBuffer {
+        Record records[BUFFER_CAPACITY];
+        std::atomic<size_t> head = 0;
+        std::atomic<size_t> tail = 0;
+        std::atomic<uint64_t> dropped = 0;
+        std::atomic<bool> orphaned = false;
+    };
+
+    struct ThreadBufferHandle {
+        std::shared_ptr<ThreadBuffer> buffer;
+        ~ThreadBufferHandle();
+    };
+
+    EventLog() {};
+    EventLog(EventLog const&);
+    EventLog& operator=(EventLog const&);
+
+    template <typename T>
+    static void encode(Record& record, size_t index, T value) {
+        if constexpr (std::is_same_v<T, Errno>) {
+            record.types[index] = ArgumentType::ERRNO;
+            record.values[index].i = value.value;
+        } else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+            record.types[index] = ArgumentType::STRING;
+            record.values[index].s = value;
+        } else if constexpr (std::is_floating_point_v<T>) {
+            record.types[index] = ArgumentType::DOUBLE;
+            record.values[index].d = value;
+        } else if constexpr (std::is_signed_v<T> || std::is_enum_v<T>) {
+            record.types[index] = ArgumentType::INT;
+            record.values[index].i = static_cast<int64_t>(value);
+        } else {
+            static_assert(std::is_unsigned_v<T>, "Unsupported event argument type");
+            record.types[index] = ArgumentType::UINT;
+            record.values[index].u = value;
+        }
+    }
+
+    void append(Record& record);
+    ThreadBuffer& threadBuffer();
+
+    EventLoop::Task sinkLoop();
+    void drain();
+    std::string format(const Record& record);
+
+    std::mutex m_buffersMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+
+    // Only one thread at a time consumes the buffers, the sink or a flushing thread.
+    std::mutex m_drainMutex;
+};
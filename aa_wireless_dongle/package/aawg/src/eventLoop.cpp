@@ -0,0 +1,249 @@
+#include <unistd.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "common.h"
+#include "eventLoop.h"
+
+/*static*/ EventLoop& EventLoop::instance() {
+    static EventLoop instance;
+    return instance;
+}
+
+EventLoop::EventLoop() {
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data = {.u64 = WAKE_REGISTRATION},
+    };
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event);
+}
+
+void EventLoop::post(std::function<void()> function) {
+    {
+        std::lock_guard<std::mutex> lock(m_postedMutex);
+        m_posted.push_back(std::move(function));
+    }
+
+    uint64_t value = 1;
+    write(m_wakeFd, &value, sizeof(value));
+}
+
+void EventLoop::spawn(std::function<Task()> coroutine) {
+    post([coroutine]() { coroutine(); });
+}
+
+#pragma region Awaitables
+EventLoop::SleepAwaiter EventLoop::sleepUntil(std::chrono::steady_clock::time_point deadline) {
+    return SleepAwaiter(deadline);
+}
+
+EventLoop::SleepAwaiter EventLoop::sleepFor(std::chrono::steady_clock::duration duration) {
+    return SleepAwaiter(std::chrono::steady_clock::now() + duration);
+}
+
+EventLoop::FdAwaiter EventLoop::readable(int fd, std::chrono::milliseconds timeout) {
+    return FdAwaiter(fd, EPOLLIN, timeout);
+}
+
+EventLoop::FdAwaiter EventLoop::changed(int fd, std::chrono::milliseconds timeout) {
+    return FdAwaiter(fd, EPOLLPRI, timeout);
+}
+
+void EventLoop::SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    std::shared_ptr<Waiter> waiter = std::make_shared<Waiter>();
+    waiter->handle = handle;
+    EventLoop::instance().addTimer(m_deadline, waiter);
+}
+
+void EventLoop::FdAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    m_waiter = std::make_shared<Waiter>();
+    m_waiter->handle = handle;
+    m_waiter->fd = m_fd;
+    m_waiter->events = m_events;
+
+    EventLoop::instance().watch(m_waiter);
+    if (m_timeout > std::chrono::milliseconds(0)) {
+        EventLoop::instance().addTimer(std::chrono::steady_clock::now() + m_timeout, m_waiter);
+    }
+}
+
+bool EventLoop::FdAwaiter::await_resume() {
+    return !m_waiter->timedOut;
+}
+#pragma endregion Awaitables
+
+#pragma region Signal
+EventLoop::Signal::Signal(): m_state(std::make_shared<SignalState>()) {}
+
+void EventLoop::Signal::notify() {
+    EventLoop::instance().post([state = m_state]() {
+        // The waiter may have timed out in the meantime, then the notification is kept for the next wait.
+        if (!state->waiter || state->waiter->done) {
+            state->notified = true;
+            return;
+        }
+
+        std::shared_ptr<Waiter> waiter = std::move(state->waiter);
+        waiter->done = true;
+        waiter->handle.resume();
+    });
+}
+
+EventLoop::Signal::WaitAwaiter EventLoop::Signal::wait(std::chrono::milliseconds timeout) {
+    return WaitAwaiter(m_state, timeout);
+}
+
+bool EventLoop::Signal::WaitAwaiter::await_ready() {
+    return m_state->notified;
+}
+
+void EventLoop::Signal::WaitAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    m_waiter = std::make_shared<Waiter>();
+    m_waiter->handle = handle;
+    m_state->waiter = m_waiter;
+
+    if (m_timeout > std::chrono::milliseconds(0)) {
+        EventLoop::instance().addTimer(std::chrono::steady_clock::now() + m_timeout, m_waiter);
+    }
+}
+
+bool EventLoop::Signal::WaitAwaiter::await_resume() {
+    if (m_waiter && m_waiter->timedOut) {
+        m_state->waiter = nullptr;
+        return false;
+    }
+
+    m_state->notified = false;
+    return true;
+}
+#pragma endregion Signal
+
+void EventLoop::addTimer(std::chrono::steady_clock::time_point deadline, std::shared_ptr<Waiter> waiter) {
+    m_timers.push({deadline, m_timerSequence++, waiter});
+}
+
+void EventLoop::watch(std::shared_ptr<Waiter> waiter) {
+    waiter->registration = m_nextRegistration++;
+
+    // The fd of an earlier wait was closed under it and the number reused, that wait cannot end otherwise.
+    if (auto it = m_fdRegistrations.find(waiter->fd); it != m_fdRegistrations.end()) {
+        if (auto previous = m_fdWaiters.find(it->second); previous != m_fdWaiters.end()) {
+            std::shared_ptr<Waiter> orphaned = previous->second;
+            m_fdWaiters.erase(previous);
+
+            orphaned->done = true;
+            orphaned->timedOut = true;
+            post([orphaned]() { orphaned->handle.resume(); });
+        }
+    }
+
+    struct epoll_event event = {
+        .events = waiter->events,
+        .data = {.u64 = waiter->registration},
+    };
+    int result = epoll_ctl(m_epollFd, EPOLL_CTL_ADD, waiter->fd, &event);
+    if (result < 0 && errno == EEXIST) {
+        result = epoll_ctl(m_epollFd, EPOLL_CTL_MOD, waiter->fd, &event);
+    }
+    if (result < 0) {
+        Logger::instance()->info("Event loop: watching fd %d failed: %s\n", waiter->fd, strerror(errno));
+    }
+
+    m_fdWaiters[waiter->registration] = waiter;
+    m_fdRegistrations[waiter->fd] = waiter->registration;
+}
+
+void EventLoop::unwatch(const Waiter& waiter) {
+    m_fdWaiters.erase(waiter.registration);
+
+    // Unless the fd was closed and another wait registered it again in the meantime
+    if (auto it = m_fdRegistrations.find(waiter.fd); it != m_fdRegistrations.end() && it->second == waiter.registration) {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, waiter.fd, nullptr);
+        m_fdRegistrations.erase(it);
+    }
+}
+
+void EventLoop::runPosted() {
+    uint64_t value;
+    read(m_wakeFd, &value, sizeof(value));
+
+    std::vector<std::function<void()>> posted;
+    {
+        std::lock_guard<std::mutex> lock(m_postedMutex);
+        posted.swap(m_posted);
+    }
+
+    for (std::function<void()>& function: posted) {
+        function();
+    }
+}
+
+void EventLoop::runTimers() {
+    auto now = std::chrono::steady_clock::now();
+
+    while (!m_timers.empty() && m_timers.top().deadline <= now) {
+        std::shared_ptr<Waiter> waiter = m_timers.top().waiter;
+        m_timers.pop();
+
+        // The fd this waiter also waits on may have become ready first.
+        if (waiter->done) {
+            continue;
+        }
+
+        waiter->done = true;
+        waiter->timedOut = true;
+        if (waiter->fd >= 0) {
+            unwatch(*waiter);
+        }
+        waiter->handle.resume();
+    }
+}
+
+void EventLoop::run() {
+    if (m_epollFd < 0 || m_wakeFd < 0) {
+        Logger::instance()->info("Event loop: creating epoll or eventfd failed\n");
+        return;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int timeout = -1;
+        if (!m_timers.empty()) {
+            // Round up, waking up early would only spin until the deadline.
+            auto remaining = std::chrono::ceil<std::chrono::milliseconds>(m_timers.top().deadline - std::chrono::steady_clock::now());
+            timeout = std::max<int>(remaining.count(), 0);
+        }
+
+        int count = epoll_wait(m_epollFd, events, MAX_EVENTS, timeout);
+        if (count < 0 && errno != EINTR) {
+            Logger::instance()->info("Event loop: epoll_wait failed: %s\n", strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint64_t registration = events[i].data.u64;
+            if (registration == WAKE_REGISTRATION) {
+                runPosted();
+                continue;
+            }
+
+            // A coroutine resumed earlier in this batch may have closed the fd, the event is stale then.
+            auto it = m_fdWaiters.find(registration);
+            if (it == m_fdWaiters.end()) {
+                continue;
+            }
+
+            std::shared_ptr<Waiter> waiter = it->second;
+            unwatch(*waiter);
+            waiter->done = true;
+            waiter->handle.resume();
+        }
+
+        runTimers();
+    }
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace EventLoopDetail {
+    // Result of an EventLoop::Async, a promise cannot have both return_value and return_void.
+    template <typename T>
+    struct AsyncResult {
+        std::optional<T> value;
+
+        void return_value(T result) { value = std::move(result); }
+        T take() { return std::move(*value); }
+    };
+
+    template <>
+    struct AsyncResult<void> {
+        void return_void() {}
+        void take() {}
+    };
+}
+
+/**
+ * Single thread running the control plane as C++20 coroutines.
+ *
+ * Coroutines suspend on awaitables for fd readiness and timers, so a component waiting for something costs no
+ * thread of its own. Everything runs on the loop thread, only post(), spawn() and Signal::notify() may be called
+ * from other threads. Calls that can only block, like synchronous D-Bus calls, are awaited with blocking().
+ */
+class EventLoop {
+public:
+    /**
+     * Return type of the coroutines run on the loop. A task starts right away, runs until it returns and
+     * nobody waits for it.
+     */
+    struct Task {
+        struct promise_type {
+            Task get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    /**
+     * Return type of the coroutines other coroutines wait for with co_await, for their result or their
+     * completion. It only starts once awaited, and resumes the awaiting coroutine when it returns. An exception
+     * is thrown again in the awaiting coroutine.
+     */
+    template <typename T = void>
+    class Async {
+    public:
+        struct promise_type: EventLoopDetail::AsyncResult<T> {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept { return handle.promise().continuation; }
+                void await_resume() noexcept {}
+            };
+
+            Async get_return_object() { return Async(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            FinalAwaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() { exception = std::current_exception(); }
+        };
+
+        Async(Async&& other): m_handle(std::exchange(other.m_handle, nullptr)) {};
+        ~Async() {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+        }
+
+        bool await_ready() { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+            m_handle.promise().continuation = awaiting;
+            return m_handle;
+        }
+        T await_resume() {
+            if (m_handle.promise().exception) {
+                std::rethrow_exception(m_handle.promise().exception);
+            }
+            return m_handle.promise().take();
+        }
+
+    private:
+        explicit Async(std::coroutine_handle<promise_type> handle): m_handle(handle) {};
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    static EventLoop& instance();
+
+    // Run the loop on the calling thread, only returns if the loop could not be set up or failed.
+    void run();
+
+    // Run the function on the loop thread, safe to call from any thread.
+    void post(std::function<void()> function);
+
+    /**
+     * Start a coroutine on the loop thread, safe to call from any thread. The function is called on the loop
+     * and should return the task of a member coroutine, a lambda with captures would not outlive its first
+     * suspension.
+     */
+    void spawn(std::function<Task()> coroutine);
+
+    // Coroutine suspended on an awaitable
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        int fd = -1;
+        uint32_t events = 0;
+        // Identifies the fd registration in the epoll events, fds are reused as soon as they are closed.
+        uint64_t registration = 0;
+        bool done = false;
+        bool timedOut = false;
+    };
+
+    struct SignalState;
+
+    /**
+     * Wakes a coroutine from any thread, or from code on the loop that is not a coroutine. A notification
+     * nobody waits for is kept for the next wait. Copies share the same state.
+     */
+    class Signal {
+    public:
+        class WaitAwaiter {
+        public:
+            bool await_ready();
+            void await_suspend(std::coroutine_handle<> handle);
+            // false if the timeout expired first
+            bool await_resume();
+
+        private:
+            friend class Signal;
+            WaitAwaiter(std::shared_ptr<SignalState> state, std::chrono::milliseconds timeout): m_state(state), m_timeout(timeout) {};
+
+            std::shared_ptr<SignalState> m_state;
+            std::chrono::milliseconds m_timeout;
+            std::shared_ptr<Waiter> m_waiter;
+        };
+
+        Signal();
+
+        // Safe to call from any thread, the waiting coroutine is resumed on the loop.
+        void notify();
+        // Only one coroutine may wait at a time. Waits forever if the timeout is zero.
+        WaitAwaiter wait(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    private:
+        std::shared_ptr<SignalState> m_state;
+    };
+
+    // Only used on the loop thread
+    struct SignalState {
+        bool notified = false;
+        std::shared_ptr<Waiter> waiter;
+    };
+
+    class SleepAwaiter {
+    public:
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        void await_resume() {}
+
+    private:
+        friend class EventLoop;
+        SleepAwaiter(std::chrono::steady_clock::time_point deadline): m_deadline(deadline) {};
+
+        std::chrono::steady_clock::time_point m_deadline;
+    };
+
+    class FdAwaiter {
+    public:
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        // false if the timeout expired first
+        bool await_resume();
+
+    private:
+        friend class EventLoop;
+        FdAwaiter(int fd, uint32_t events, std::chrono::milliseconds timeout): m_fd(fd), m_events(events), m_timeout(timeout) {};
+
+        int m_fd;
+        uint32_t m_events;
+        std::chrono::milliseconds m_timeout;
+        std::shared_ptr<Waiter> m_waiter;
+    };
+
+    template <typename Function>
+    class BlockingAwaiter {
+    public:
+        typedef std::invoke_result_t<Function> Result;
+
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            // The awaiter lives in the frame of the suspended coroutine until the thread resumes it.
+            std::thread([this, handle]() {
+                try {
+                    if constexpr (std::is_void_v<Result>) {
+                        m_function();
+                    } else {
+                        m_result.emplace(m_function());
+                    }
+                } catch (...) {
+                    m_exception = std::current_exception();
+                }
+
+                EventLoop::instance().post([handle]() { handle.resume(); });
+            }).detach();
+        }
+        Result await_resume() {
+            if (m_exception) {
+                std::rethrow_exception(m_exception);
+            }
+            if constexpr (!std::is_void_v<Result>) {
+                return std::move(*m_result);
+            }
+        }
+
+    private:
+        friend class EventLoop;
+        BlockingAwaiter(Function function): m_function(std::move(function)) {};
+
+        Function m_function;
+        std::optional<std::conditional_t<std::is_void_v<Result>, bool, Result>> m_result;
+        std::exception_ptr m_exception;
+    };
+
+    // Awaitables, only for coroutines running on the loop.
+    SleepAwaiter sleepUntil(std::chrono::steady_clock::time_point deadline);
+    SleepAwaiter sleepFor(std::chrono::steady_clock::duration duration);
+    // Wait for the fd to become readable, or for the timeout to expire if not zero. A wait on an fd that got closed
+    // and reused by another wait ends as if it timed out.
+    FdAwaiter readable(int fd, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    // Wait for a sysfs attribute to notify a change with POLLPRI, or for the timeout to expire if not zero.
+    FdAwaiter changed(int fd, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    /**
+     * Run a call that blocks, like a synchronous D-Bus call, on a thread that only lives for the call, and
+     * resume with its result or exception once it returned. The call must not use the loop's state.
+     */
+    template <typename Function>
+    BlockingAwaiter<Function> blocking(Function function) {
+        return BlockingAwaiter<Function>(std::move(function));
+    }
+
+private:
+    struct Timer {
+        std::chrono::steady_clock::time_point deadline;
+        uint64_t sequence;
+        std::shared_ptr<Waiter> waiter;
+
+        // Earliest deadline first, in the order the timers were added.
+        bool operator>(const Timer& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    static constexpr int MAX_EVENTS = 16;
+    // Registration of the eventfd waking up the loop for posted functions
+    static constexpr uint64_t WAKE_REGISTRATION = 0;
+
+    EventLoop();
+    EventLoop(EventLoop const&);
+    EventLoop& operator=(EventLoop const&);
+
+    void addTimer(std::chrono::steady_clock::time_point deadline, std::shared_ptr<Waiter> waiter);
+    void watch(std::shared_ptr<Waiter> waiter);
+    void unwatch(const Waiter& waiter);
+    void runPosted();
+    void runTimers();
+
+    int m_epollFd = -1;
+    int m_wakeFd = -1;
+
+    std::mutex m_postedMutex;
+    std::vector<std::function<void()>> m_posted;
+
+    // Only used on the loop thread
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> m_timers;
+    uint64_t m_timerSequence = 0;
+    uint64_t m_nextRegistration = WAKE_REGISTRATION + 1;
+    // By registration, an event still pending for a closed fd must not wake the next waiter of the same fd.
+    std::unordered_map<uint64_t, std::shared_ptr<Waiter>> m_fdWaiters;
+    // Current registration of each watched fd
+    std::unordered_map<int, uint64_t> m_fdRegistrations;
+};
@@ -0,0 +1,129 @@
+/*
+ * Offline decoder for the aawgd flight recorder file.
+ *
+ * Usage: aawg-flightdump [file]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <vector>
+
+#include "flightRecorder.h"
+
+static const char* sessionStateName(uint32_t state) {
+    static const char* names[] = {"idle", "waiting_for_accessory", "forwarding"};
+    return state < sizeof(names) / sizeof(names[0]) ? names[state] : "unknown";
+}
+
+static const char* resetReasonName(uint32_t reason) {
+    static const char* names[] = {"none", "phone_lost", "reconnect_requested"};
+    return reason < sizeof(names) / sizeof(names[0]) ? names[reason] : "unknown";
+}
+
+static const char* bluetoothStateName(uint32_t state) {
+    static const char* names[] = {"off", "powered", "connecting", "connected"};
+    return state < sizeof(names) / sizeof(names[0]) ? names[state] : "unknown";
+}
+
+static const char* directionName(uint32_t direction) {
+    return direction == 0 ? "tcp>usb" : "usb>tcp";
+}
+
+static const char* errorName(uint32_t error) {
+    switch (static_cast<FlightRecord::Error>(error)) {
+        case FlightRecord::Error::TCP_READ:
+            return "tcp_read";
+        case FlightRecord::Error::TCP_WRITE:
+            return "tcp_write";
+        case FlightRecord::Error::USB_READ:
+            return "usb_read";
+        case FlightRecord::Error::USB_WRITE:
+            return "usb_write";
+        case FlightRecord::Error::ACCESSORY_TIMEOUT:
+            return "accessory_timeout";
+        case FlightRecord::Error::ACCESSORY_OPEN:
+            return "accessory_open";
+        default:
+            return "unknown";
+    }
+}
+
+static void printRecord(const FlightRecord::Record& record) {
+    printf("boot=%u t=%llu.%06llu ", record.bootCount, (unsigned long long)(record.timeUs / 1000000), (unsigned long long)(record.timeUs % 1000000));
+
+    switch (static_cast<FlightRecord::Type>(record.type)) {
+        case FlightRecord::Type::DAEMON_START:
+            printf("daemon_start\n");
+            break;
+        case FlightRecord::Type::SESSION_STATE:
+            printf("session state=%s\n", sessionStateName(record.arg0));
+            break;
+        case FlightRecord::Type::BLUETOOTH_STATE:
+            printf("bluetooth state=%s\n", bluetoothStateName(record.arg0));
+            break;
+        case FlightRecord::Type::ERROR:
+            printf("error %s: %s\n", errorName(record.arg0), record.arg1 ? strerror(record.arg1) : "none");
+            break;
+        case FlightRecord::Type::THROUGHPUT:
+            printf("throughput tcp>usb=%u B/s usb>tcp=%u B/s\n", record.arg0, record.arg1);
+            break;
+        case FlightRecord::Type::STALL:
+            printf("stall %s no traffic for %u ms\n", directionName(record.arg0), record.arg1);
+            break;
+        case FlightRecord::Type::SESSION_RESET:
+            printf("session reset, not resumable: %s\n", resetReasonName(record.arg0));
+            break;
+        default:
+            printf("type=%u arg0=%u arg1=%u\n", record.type, record.arg0, record.arg1);
+            break;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "/persist/aawgd.flight";
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+
+    FlightRecord::Header header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || memcmp(header.magic, FlightRecord::MAGIC, sizeof(header.magic)) != 0
+        || header.version != FlightRecord::VERSION
+        || header.recordSize != sizeof(FlightRecord::Record)) {
+        fprintf(stderr, "%s is not a flight recorder file\n", path);
+        return 1;
+    }
+
+    // The capacity comes from the file, it must match what the file actually holds.
+    file.seekg(0, std::ios::end);
+    uint64_t recordBytes = static_cast<uint64_t>(file.tellg()) - sizeof(header);
+    file.seekg(sizeof(header));
+    if (header.capacity == 0 || recordBytes / sizeof(FlightRecord::Record) < header.capacity) {
+        fprintf(stderr, "%s has an invalid capacity of %u records\n", path, header.capacity);
+        return 1;
+    }
+
+    std::vector<FlightRecord::Record> records(header.capacity);
+    if (!file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(FlightRecord::Record))) {
+        fprintf(stderr, "%s is truncated\n", path);
+        return 1;
+    }
+
+    uint64_t first = header.writeIndex > header.capacity ? header.writeIndex - header.capacity : 0;
+    for (uint64_t index = first; index < header.writeIndex; index++) {
+        const FlightRecord::Record& record = records[index % header.capacity];
+
+        // Skip records torn by a crash while writing
+        if (record.sequence != index + 1) {
+            continue;
+        }
+
+        printRecord(record);
+    }
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "flightRecorder.h"
+
+/*static*/ FlightRecorder& FlightRecorder::instance() {
+    static FlightRecorder instance;
+    return instance;
+}
+
+void FlightRecorder::init() {
+    std::string path = Config::instance()->getFlightRecorderFile();
+    if (path.empty()) {
+        return;
+    }
+
+    if (!map(path)) {
+        return;
+    }
+
+    m_header->bootCount++;
+    Logger::instance()->info("Flight recorder: Recording to %s, boot %u\n", path.c_str(), m_header->bootCount);
+
+    record(FlightRecord::Type::DAEMON_START, m_header->bootCount);
+}
+
+bool FlightRecorder::map(std::string path) {
+    size_t size = sizeof(FlightRecord::Header) + CAPACITY * sizeof(FlightRecord::Record);
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Logger::instance()->info("Flight recorder: Error opening %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    // Allocate the whole file upfront, so writes to the mapping never need new blocks.
+    if (int err = posix_fallocate(fd, 0, size); err != 0) {
+        Logger::instance()->info("Flight recorder: Error allocating %s: %s\n", path.c_str(), strerror(err));
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        Logger::instance()->info("Flight recorder: Error mapping %s: %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    FlightRecord::Header* header = static_cast<FlightRecord::Header*>(mapping);
+    if (memcmp(header->magic, FlightRecord::MAGIC, sizeof(header->magic)) != 0
+        || header->version != FlightRecord::VERSION
+        || header->recordSize != sizeof(FlightRecord::Record)
+        || header->capacity != CAPACITY) {
+        // New or incompatible file, start over.
+        memset(mapping, 0, size);
+        memcpy(header->magic, FlightRecord::MAGIC, sizeof(header->magic));
+        header->version = FlightRecord::VERSION;
+        header->recordSize = sizeof(FlightRecord::Record);
+        header->capacity = CAPACITY;
+    }
+
+    m_header = header;
+    m_records = reinterpret_cast<FlightRecord::Record*>(static_cast<char*>(mapping) + sizeof(FlightRecord::Header));
+    m_size = size;
+    m_fd = fd;
+
+    return true;
+}
+
+void FlightRecorder::record(FlightRecord::Type type, uint32_t arg0, uint32_t arg1) {
+    if (!m_header) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+
+    uint64_t index = __atomic_fetch_add(&m_header->writeIndex, 1, __ATOMIC_RELAXED);
+    FlightRecord::Record* record = &m_records[index % CAPACITY];
+
+    // Invalidate the slot first, so a crash in the middle leaves no record rather than a torn one.
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->timeUs = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    record->bootCount = m_header->bootCount;
+    record->type = static_cast<uint16_t>(type);
+    record->reserved = 0;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+
+    __atomic_store_n(&record->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+void FlightRecorder::flush() {
+    if (!m_header) {
+        return;
+    }
+
+    // Only queues the dirty pages for writeback, the sampler must not block on the storage.
+    if (sync_file_range(m_fd, 0, m_size, SYNC_FILE_RANGE_WRITE) != 0) {
+        Logger::instance()->info("Flight recorder: Error flushing: %s\n", strerror(errno));
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/*
+ * Layout of the flight recorder file, shared with the offline decoder.
+ *
+ * The file is a fixed size header followed by a ring of fixed size records. Writers claim a slot by
+ * incrementing writeIndex and write the sequence number last, so a record whose sequence does not match
+ * its slot was torn by a crash and is skipped by the decoder.
+ */
+namespace FlightRecord {
+    constexpr char MAGIC[8] = {'A', 'A', 'W', 'G', 'F', 'L', 'T', '1'};
+    constexpr uint32_t VERSION = 1;
+
+    enum class Type: uint16_t {
+        DAEMON_START = 1,       // arg0: boot count
+        SESSION_STATE = 2,      // arg0: SessionState
+        BLUETOOTH_STATE = 3,    // arg0: BluetoothState
+        ERROR = 4,              // arg0: Error, arg1: errno
+        THROUGHPUT = 5,         // arg0: TCP to USB bytes per second, arg1: USB to TCP bytes per second
+        STALL = 6,              // arg0: TrafficDirection, arg1: milliseconds since the last traffic
+        SESSION_RESET = 7,      // arg0: SessionResetReason
+    };
+
+    enum class Error: uint32_t {
+        TCP_READ = 1,
+        TCP_WRITE = 2,
+        USB_READ = 3,
+        USB_WRITE = 4,
+        ACCESSORY_TIMEOUT = 5,
+        ACCESSORY_OPEN = 6,
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint32_t capacity;
+        uint32_t bootCount;
+        uint64_t writeIndex;
+        uint8_t reserved[32];
+    };
+    static_assert(sizeof(Header) == 64);
+
+    struct Record {
+        uint64_t sequence;      // writeIndex + 1 of this record, 0 if never written
+        uint64_t timeUs;        // CLOCK_BOOTTIME
+        uint32_t bootCount;
+        uint16_t type;
+        uint16_t reserved;
+        uint32_t arg0;
+        uint32_t arg1;
+    };
+    static_assert(sizeof(Record) == 32);
+}
+
+/**
+ * Records important events into a memory mapped ring in persistent storage, to be decoded after a crash or power loss.
+ * Recording is lock free and never waits for the storage. Dirty pages of a shared mapping are otherwise only written
+ * back after dirty_expire_centisecs, so the stats sampler flushes them about once per second.
+ */
+class FlightRecorder {
+public:
+    static FlightRecorder& instance();
+
+    void init();
+
+    void record(FlightRecord::Type type, uint32_t arg0 = 0, uint32_t arg1 = 0);
+
+    /**
+     * Start writing back the recorded events with sync_file_range, without waiting for the write to complete.
+     * Not msync(MS_ASYNC), which does nothing on Linux.
+     */
+    void flush();
+
+private:
+    static constexpr uint32_t CAPACITY = 8192;
+
+    FlightRecorder() {};
+    FlightRecorder(FlightRecorder const&);
+    FlightRecorder& operator=(FlightRecorder const&);
+
+    bool map(std::string path);
+
+    FlightRecord::Header* m_header = nullptr;
+    FlightRecord::Record* m_records = nullptr;
+    size_t m_size = 0;
+    // Kept open for flush
+    int m_fd = -1;
+};
@@ -0,0 +1,226 @@
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "common.h"
+#include "forwarder.h"
+#include "frameBuffer.h"
+#include "stats.h"
+#include "flightRecorder.h"
+#include "eventLog.h"
+#include "rttEstimator.h"
+
+Forwarder::Forwarder(int tcp_fd, int usb_fd, std::optional<std::chrono::steady_clock::time_point> accessory_start):
+    m_usb_fd(usb_fd), m_tcp_fd(tcp_fd), m_accessory_start(accessory_start) {}
+
+Forwarder::~Forwarder() {
+    m_io.setStopFd(-1);
+
+    if (m_stop_fd >= 0) {
+        close(m_stop_fd);
+    }
+}
+
+bool Forwarder::run() {
+    if ((m_stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        Logger::instance()->info("creating stop event failed: %s\n", strerror(errno));
+        return false;
+    }
+    m_io.setStopFd(m_stop_fd);
+
+    std::thread usb_tcp_thread(&Forwarder::forward, this, ProxyDirection::USB_to_TCP);
+    forward(ProxyDirection::TCP_to_USB);
+
+    usb_tcp_thread.join();
+
+    return true;
+}
+
+void Forwarder::stop() {
+    if (m_should_exit.exchange(true)) {
+        return;
+    }
+
+    EventLog::log<LogEvent::STOP_FORWARDING>();
+
+    uint64_t value = 1;
+    write(m_stop_fd, &value, sizeof(value));
+
+    // The stop event only wakes up the accessory, the other thread may be blocked on the TCP socket.
+    shutdown(m_tcp_fd, SHUT_RDWR);
+}
+
+ssize_t Forwarder::sendFrames(int fd, const unsigned char *buffer, size_t nbyte, std::chrono::steady_clock::time_point read_time, size_t& frames, const std::atomic<bool>* should_exit) {
+    m_usb_frames.clear();
+    size_t complete = m_usb_stream.consume(buffer, nbyte, [this, read_time](const AAFrame::Header& header) {
+        RttEstimator::instance().frameReceived(TrafficDirection::USB_to_TCP, header, read_time);
+        m_usb_frames.push_back(header);
+    });
+    frames = m_usb_frames.size();
+
+    // Push out the frames completed by this read right away.
+    if (complete > 0) {
+        if (ssize_t len = m_io.sendFully(fd, buffer, complete, 0, should_exit); len < 0) {
+            return len;
+        }
+
+        auto sent_time = std::chrono::steady_clock::now();
+        Stats::instance().addUsbFlushLatency(sent_time - read_time);
+        for (const AAFrame::Header& header: m_usb_frames) {
+            RttEstimator::instance().frameSent(TrafficDirection::USB_to_TCP, header, sent_time);
+        }
+    }
+
+    // The start of the next frame is only queued, so its segments are not sent before the frame is complete.
+    if (complete < nbyte) {
+        if (ssize_t len = m_io.sendFully(fd, buffer + complete, nbyte - complete, MSG_MORE, should_exit); len < 0) {
+            return len;
+        }
+        Stats::instance().addUsbHeldWrite();
+    }
+
+    return nbyte;
+}
+
+void Forwarder::forward(ProxyDirection direction) {
+    std::atomic<bool>& should_exit = m_should_exit;
+
+    size_t buffer_len = 16384;
+    unsigned char buffer[buffer_len];
+    std::optional<FrameBuffer> frames;
+
+    bool read_message = false;
+    int read_fd = -1, write_fd = -1;
+    const char* read_name = "";
+    const char* write_name = "";
+    switch (direction) {
+        case ProxyDirection::TCP_to_USB:
+            read_message = true;
+            frames.emplace();
+
+            read_fd = m_tcp_fd;
+            read_name = "TCP";
+
+            write_fd = m_usb_fd;
+            write_name = "USB";
+            break;
+        case ProxyDirection::USB_to_TCP:
+            read_message = false;
+
+            read_fd = m_usb_fd;
+            read_name = "USB";
+
+            write_fd = m_tcp_fd;
+            write_name = "TCP";
+            break;
+        default:
+            return;
+    }
+
+    bool first_write = true;
+    while (!should_exit) {
+        // Read
+        const unsigned char* data = buffer;
+        ssize_t len;
+        if (read_message) {
+            len = m_io.readFrame(read_fd, *frames, &data, &should_exit);
+        }
+        else {
+            len = m_io.readSome(read_fd, buffer, buffer_len, &should_exit);
+            Stats::instance().addReadCall(TrafficDirection::USB_to_TCP);
+        }
+        auto read_time = std::chrono::steady_clock::now();
+
+        if (len <= 0) {
+            // Start logging read/write details if there is an error.
+            m_log_communication = true;
+        }
+        if (m_log_communication) {
+            EventLog::log<LogEvent::BYTES_READ>(len, read_name);
+        }
+
+        if (len < 0) {
+            if (!should_exit) {
+                markFailed(read_fd, true);
+                EventLog::log<LogEvent::READ_FAILED>(read_name, EventLog::Errno{errno});
+            }
+            break;
+        }
+        else if (len == 0) {
+            if (!should_exit) {
+                errno = 0;
+                markFailed(read_fd, true);
+            }
+            break;
+        }
+        else if (should_exit) {
+            break;
+        }
+
+        // Write, a frame must never be cut short by a partial write.
+        ssize_t wlen;
+        size_t frame_count = 1;
+        const unsigned char* header = data;
+        if (read_message) {
+            AAFrame::Header frame_header = AAFrame::parseHeader(data);
+            RttEstimator::instance().frameReceived(TrafficDirection::TCP_to_USB, frame_header, read_time);
+
+            wlen = m_io.writeFully(write_fd, data, len, &should_exit);
+            if (wlen > 0) {
+                RttEstimator::instance().frameSent(TrafficDirection::TCP_to_USB, frame_header, std::chrono::steady_clock::now());
+            }
+        }
+        else {
+            wlen = sendFrames(write_fd, data, len, read_time, frame_count, &should_exit);
+            header = m_usb_stream.lastHeader();
+        }
+
+        if (wlen <= 0) {
+            // Start logging read/write details if there is an error.
+            m_log_communication = true;
+        }
+        if (m_log_communication) {
+            EventLog::log<LogEvent::BYTES_WRITTEN>(wlen, write_name);
+        }
+
+        if (wlen > 0) {
+            Stats::instance().addTraffic(direction == ProxyDirection::TCP_to_USB ? TrafficDirection::TCP_to_USB : TrafficDirection::USB_to_TCP, wlen, header, frame_count);
+        }
+
+        if (wlen < 0) {
+            if (!should_exit) {
+                markFailed(write_fd, false);
+                EventLog::log<LogEvent::WRITE_FAILED>(write_name, EventLog::Errno{errno});
+            }
+            break;
+        }
+        else if (first_write && direction == ProxyDirection::TCP_to_USB) {
+            first_write = false;
+
+            if (m_accessory_start) {
+                auto latency = std::chrono::steady_clock::now() - *m_accessory_start;
+                EventLog::log<LogEvent::FIRST_BYTES_FORWARDED>(std::chrono::duration_cast<std::chrono::milliseconds>(latency).count());
+            }
+        }
+        else if (should_exit) {
+            break;
+        }
+    }
+
+    stop();
+}
+
+void Forwarder::markFailed(int fd, bool reading) {
+    int none = -1;
+    m_failed_fd.compare_exchange_strong(none, fd);
+
+    FlightRecord::Error error;
+    if (fd == m_tcp_fd) {
+        error = reading ? FlightRecord::Error::TCP_READ : FlightRecord::Error::TCP_WRITE;
+    } else {
+        error = reading ? FlightRecord::Error::USB_READ : FlightRecord::Error::USB_WRITE;
+    }
+
+    FlightRecorder::instance().record(FlightRecord::Type::ERROR, static_cast<uint32_t>(error), errno);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "aaFrame.h"
+#include "proxyIo.h"
+
+/**
+ * Forwards the frames of one session between the phone's TCP socket and the USB accessory, one thread per
+ * direction, the calling thread being one of them. Knows nothing about how the fds were obtained, so it can also be driven over socketpairs.
+ */
+class Forwarder {
+public:
+    /**
+     * @param tcp_fd Blocking socket connected to the phone.
+     * @param usb_fd Accessory, blocking or non blocking.
+     * @param accessory_start When the phone requested accessory mode, to log the latency to the first forwarded bytes.
+     */
+    Forwarder(int tcp_fd, int usb_fd, std::optional<std::chrono::steady_clock::time_point> accessory_start = std::nullopt);
+    ~Forwarder();
+
+    /**
+     * Forward until either side fails or stop is called. The fds stay open.
+     *
+     * @return false if forwarding could not be started.
+     */
+    bool run();
+
+    // Make run return, from any thread.
+    void stop();
+
+    // Whether forwarding ended because the phone's socket failed before the accessory did.
+    bool phoneFailed() const { return m_failed_fd == m_tcp_fd; }
+
+private:
+    enum class ProxyDirection {
+        TCP_to_USB,
+        USB_to_TCP
+    };
+
+    void forward(ProxyDirection direction);
+    void markFailed(int fd, bool reading);
+
+    // Send data read from USB, flushing each time a frame is complete. Sets frames to the number of frames completed.
+    ssize_t sendFrames(int fd, const unsigned char *buf, size_t nbyte, std::chrono::steady_clock::time_point read_time, size_t& frames, const std::atomic<bool>* should_exit = nullptr);
+
+    int m_usb_fd;
+    int m_tcp_fd;
+    std::optional<std::chrono::steady_clock::time_point> m_accessory_start;
+
+    // eventfd signalled by stop, to wake up threads waiting for the accessory
+    int m_stop_fd = -1;
+    ProxyIo m_io;
+    std::atomic<bool> m_should_exit = false;
+    // The fd whose failure ended forwarding, -1 while none did
+    std::atomic<int> m_failed_fd = -1;
+
+    std::atomic<bool> m_log_communication = false;
+
+    // Frame boundaries of the data read from USB
+    AAFrame::StreamTracker m_usb_stream;
+    // Frames completed by the last read from USB
+    std::vector<AAFrame::Header> m_usb_frames;
+};
@@ -0,0 +1,46 @@
+#include <string.h>
+#include <algorithm>
+
+#include "frameBuffer.h"
+
+FrameBuffer::FrameBuffer(size_t capacity): m_buffer(std::max(capacity, 2 * MAX_FRAME_LENGTH)) {}
+
+unsigned char* FrameBuffer::space() {
+    if (m_start == m_end) {
+        m_start = m_end = 0;
+    }
+    else if (m_buffer.size() - m_end < MAX_FRAME_LENGTH) {
+        // Only the tail of a partial frame is left, move it to the front.
+        memmove(m_buffer.data(), m_buffer.data() + m_start, m_end - m_start);
+        m_end -= m_start;
+        m_start = 0;
+    }
+
+    return m_buffer.data() + m_end;
+}
+
+size_t FrameBuffer::spaceLength() const {
+    return m_buffer.size() - m_end;
+}
+
+void FrameBuffer::commit(size_t len) {
+    m_end += len;
+}
+
+size_t FrameBuffer::nextFrame(const unsigned char** frame) {
+    size_t available = m_end - m_start;
+    if (available < AAFrame::HEADER_LENGTH) {
+        return 0;
+    }
+
+    AAFrame::Header header = AAFrame::parseHeader(m_buffer.data() + m_start);
+    size_t length = header.frameLength();
+    if (available < length) {
+        return 0;
+    }
+
+    *frame = m_buffer.data() + m_start;
+    m_start += length;
+
+    return length;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "aaFrame.h"
+
+/**
+ * Buffer for a stream of Android Auto frames. Data is read into it in large chunks, and complete frames
+ * are handed out in place, so several frames can be parsed out of a single read without copying them.
+ */
+class FrameBuffer {
+public:
+    static constexpr size_t MAX_FRAME_LENGTH = AAFrame::MAX_HEADER_LENGTH + 0xFFFF;
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+    explicit FrameBuffer(size_t capacity = DEFAULT_CAPACITY);
+
+    /**
+     * Free space to read more data into, always room for at least one full frame.
+     * Invalidates the frames returned so far.
+     */
+    unsigned char* space();
+    size_t spaceLength() const;
+
+    // Mark len bytes read into space() as buffered.
+    void commit(size_t len);
+
+    /**
+     * Set frame to the next complete buffered frame and return its length, or return 0 if there is none.
+     * The frame stays valid until the next call to space().
+     */
+    size_t nextFrame(const unsigned char** frame);
+
+private:
+    std::vector<unsigned char> m_buffer;
+    // Buffered data not yet handed out is in [m_start, m_end)
+    size_t m_start = 0;
+    size_t m_end = 0;
+};
@@ -0,0 +1,296 @@
+#include <unistd.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <sstream>
+
+#include "common.h"
+#include "linkMonitor.h"
+
+#pragma region HostapdStationSource
+HostapdStationSource::HostapdStationSource(std::string ctrlPath): m_ctrlPath(ctrlPath) {}
+
+HostapdStationSource::~HostapdStationSource() {
+    disconnect();
+}
+
+void HostapdStationSource::disconnect() {
+    if (m_sock >= 0) {
+        close(m_sock);
+        m_sock = -1;
+    }
+}
+
+bool HostapdStationSource::connect() {
+    if (m_sock >= 0) {
+        return true;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return false;
+    }
+
+    // hostapd replies to the address of the sender, let the kernel pick an abstract one.
+    struct sockaddr_un local = {
+        .sun_family = AF_UNIX,
+    };
+    if (bind(sock, (struct sockaddr*)&local, sizeof(sa_family_t)) < 0) {
+        close(sock);
+        return false;
+    }
+
+    struct sockaddr_un remote = {
+        .sun_family = AF_UNIX,
+    };
+    strncpy(remote.sun_path, m_ctrlPath.c_str(), sizeof(remote.sun_path) - 1);
+    if (::connect(sock, (struct sockaddr*)&remote, sizeof(remote)) < 0) {
+        close(sock);
+        return false;
+    }
+
+    m_sock = sock;
+    return true;
+}
+
+int HostapdStationSource::request() {
+    // hostapd may not be running yet, or may have been restarted.
+    if (!connect()) {
+        return -1;
+    }
+
+    const char command[] = "STA-FIRST";
+    if (send(m_sock, command, sizeof(command) - 1, 0) < 0) {
+        disconnect();
+        return -1;
+    }
+
+    return m_sock;
+}
+
+std::optional<StationInfo> HostapdStationSource::reply(bool ready) {
+    // A late reply would be taken for the reply to the next request, start over with a new socket.
+    if (!ready || m_sock < 0) {
+        disconnect();
+        return std::nullopt;
+    }
+
+    char buffer[4096];
+    ssize_t len = recv(m_sock, buffer, sizeof(buffer), 0);
+    if (len <= 0) {
+        disconnect();
+        return std::nullopt;
+    }
+
+    return parse(std::string(buffer, len));
+}
+
+/*static*/ std::optional<StationInfo> HostapdStationSource::parse(const std::string& reply) {
+    std::istringstream lines(reply);
+    std::string line;
+
+    // The first line is the address of the station, nothing is returned without a station.
+    if (!std::getline(lines, line) || line.empty() || line.find('=') != std::string::npos || line.rfind("FAIL", 0) == 0) {
+        return std::nullopt;
+    }
+
+    StationInfo info = {line, 0, 0, 0, 0, std::nullopt, std::nullopt};
+    bool hasSignal = false;
+
+    while (std::getline(lines, line)) {
+        size_t split = line.find('=');
+        if (split == std::string::npos) {
+            continue;
+        }
+
+        std::string key = line.substr(0, split);
+        const char* value = line.c_str() + split + 1;
+
+        if (key == "signal") {
+            info.signal = atoi(value);
+            hasSignal = true;
+        }
+        else if (key == "tx_rate_info") {
+            // In units of 100 kbps, followed by the MCS details
+            info.txBitrate = strtol(value, nullptr, 10) / 10.0;
+        }
+        else if (key == "rx_rate_info") {
+            info.rxBitrate = strtol(value, nullptr, 10) / 10.0;
+        }
+        else if (key == "tx_packets") {
+            info.txPackets = strtoull(value, nullptr, 10);
+        }
+        else if (key == "tx_retry_count") {
+            info.txRetries = strtoull(value, nullptr, 10);
+        }
+        else if (key == "tx_retry_failed") {
+            info.txFailed = strtoull(value, nullptr, 10);
+        }
+    }
+
+    if (!hasSignal) {
+        return std::nullopt;
+    }
+
+    return info;
+}
+#pragma endregion HostapdStationSource
+
+#pragma region LinkController
+/*static*/ LinkController& LinkController::instance() {
+    static LinkController instance;
+    return instance;
+}
+
+void LinkController::start(std::unique_ptr<StationInfoSource> source) {
+    if (!source) {
+        std::string ctrlPath = Config::instance()->getHostapdCtrlPath();
+        if (ctrlPath.empty()) {
+            return;
+        }
+
+        source = std::make_unique<HostapdStationSource>(ctrlPath);
+    }
+
+    m_source = std::move(source);
+    EventLoop::instance().spawn([this]() { return monitorLoop(); });
+}
+
+EventLoop::Task LinkController::monitorLoop() {
+    while (true) {
+        if (int fd = m_source->request(); fd >= 0) {
+            bool ready = co_await EventLoop::instance().readable(fd, REPLY_TIMEOUT);
+            if (std::optional<StationInfo> info = m_source->reply(ready)) {
+                update(*info);
+            }
+        }
+
+        co_await EventLoop::instance().sleepFor(POLL_INTERVAL);
+    }
+}
+
+void LinkController::setSocket(int fd) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_fd = fd;
+    m_notsentLowat = 0;
+    if (fd < 0) {
+        return;
+    }
+
+    if (m_quality == LinkQuality::DEGRADED) {
+        applyDegraded("new connection on a degraded link");
+    }
+}
+
+int LinkController::notsentLowatFor(const StationInfo& info) {
+    double bytesPerSecond = info.txBitrate * 1000 * 1000 / 8;
+    int notsentLowat = bytesPerSecond * std::chrono::duration<double>(TARGET_QUEUE_DELAY).count();
+    return std::clamp(notsentLowat, MIN_NOTSENT_LOWAT, MAX_NOTSENT_LOWAT);
+}
+
+void LinkController::applyDegraded(const char* reason) {
+    if (m_fd < 0 || !m_lastInfo) {
+        return;
+    }
+
+    // Only follow the rate when it changed noticeably, to not churn the socket on every sample.
+    int notsentLowat = notsentLowatFor(*m_lastInfo);
+    if (m_notsentLowat != 0 && abs(notsentLowat - m_notsentLowat) < m_notsentLowat / 4) {
+        return;
+    }
+
+    if (m_notsentLowat == 0) {
+        // 0 unless set on the socket before, the system wide net.ipv4.tcp_notsent_lowat applies then.
+        int defaultNotsentLowat = 0;
+        socklen_t len = sizeof(defaultNotsentLowat);
+        getsockopt(m_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &defaultNotsentLowat, &len);
+        m_defaultNotsentLowat = defaultNotsentLowat;
+    }
+
+    if (setsockopt(m_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &notsentLowat, sizeof(notsentLowat)) < 0) {
+        Logger::instance()->info("Link: Limiting unsent data failed: %s\n", strerror(errno));
+        return;
+    }
+
+    int tos = DEGRADED_TOS;
+    setsockopt(m_fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+    m_notsentLowat = notsentLowat;
+    m_notsentLowatChanges++;
+    Logger::instance()->info("Link: %s, unsent data limited to %d bytes for %.1f Mbps, signal %d dBm\n", reason, notsentLowat, m_lastInfo->txBitrate, m_lastInfo->signal);
+}
+
+void LinkController::applyGood() {
+    if (m_fd < 0 || m_notsentLowat == 0) {
+        return;
+    }
+
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &m_defaultNotsentLowat, sizeof(m_defaultNotsentLowat));
+
+    int tos = 0;
+    setsockopt(m_fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+    m_notsentLowat = 0;
+    m_notsentLowatChanges++;
+    Logger::instance()->info("Link: Unsent data limit restored to %d bytes\n", m_defaultNotsentLowat);
+}
+
+void LinkController::update(const StationInfo& info) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lastInfo = info;
+
+    bool degraded = info.signal < DEGRADED_SIGNAL || info.txBitrate < DEGRADED_TX_BITRATE;
+    bool recovered = info.signal >= RECOVERED_SIGNAL && info.txBitrate >= RECOVERED_TX_BITRATE;
+
+    if (m_quality == LinkQuality::GOOD) {
+        m_pendingSamples = degraded ? m_pendingSamples + 1 : 0;
+        if (m_pendingSamples < DEGRADE_SAMPLES) {
+            return;
+        }
+
+        m_quality = LinkQuality::DEGRADED;
+        m_pendingSamples = 0;
+        m_degradedCount++;
+        Logger::instance()->info("Link: Degraded, signal %d dBm, tx rate %.1f Mbps\n", info.signal, info.txBitrate);
+        applyDegraded("link degraded");
+    }
+    else {
+        m_pendingSamples = recovered ? m_pendingSamples + 1 : 0;
+        if (m_pendingSamples < RECOVER_SAMPLES) {
+            applyDegraded("tx rate changed");
+            return;
+        }
+
+        m_quality = LinkQuality::GOOD;
+        m_pendingSamples = 0;
+        m_recoveredCount++;
+        Logger::instance()->info("Link: Recovered, signal %d dBm, tx rate %.1f Mbps\n", info.signal, info.txBitrate);
+        applyGood();
+    }
+}
+
+std::string LinkController::summary() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    char buffer[512];
+    int len = snprintf(buffer, sizeof(buffer), "link=%s degraded_count=%llu recovered_count=%llu notsent_lowat_changes=%llu notsent_lowat=%d",
+        m_quality == LinkQuality::GOOD ? "good" : "degraded",
+        (unsigned long long)m_degradedCount, (unsigned long long)m_recoveredCount, (unsigned long long)m_notsentLowatChanges,
+        m_notsentLowat != 0 ? m_notsentLowat : m_defaultNotsentLowat);
+
+    if (m_lastInfo && len < (int)sizeof(buffer)) {
+        snprintf(buffer + len, sizeof(buffer) - len, " station=%s signal=%d tx_mbps=%.1f rx_mbps=%.1f tx_packets=%llu tx_retries=%lld tx_failed=%lld",
+            m_lastInfo->address.c_str(), m_lastInfo->signal, m_lastInfo->txBitrate, m_lastInfo->rxBitrate,
+            (unsigned long long)m_lastInfo->txPackets,
+            m_lastInfo->txRetries ? (long long)*m_lastInfo->txRetries : -1LL,
+            m_lastInfo->txFailed ? (long long)*m_lastInfo->txFailed : -1LL);
+    }
+
+    return std::string(buffer) + "\n";
+}
+#pragma endregion LinkController
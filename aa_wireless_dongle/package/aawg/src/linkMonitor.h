@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "eventLoop.h"
+
+/*
+ * Link quality of the phone's wifi connection, as seen by the access point.
+ */
+struct StationInfo {
+    std::string address;
+    int signal;                     // dBm
+    double txBitrate;               // Mbps, from the dongle to the phone
+    double rxBitrate;               // Mbps, from the phone to the dongle
+    uint64_t txPackets;
+    // Only reported by some drivers
+    std::optional<uint64_t> txRetries;
+    std::optional<uint64_t> txFailed;
+};
+
+/**
+ * Asynchronous source of station info, queried from the event loop without blocking it.
+ */
+class StationInfoSource {
+public:
+    virtual ~StationInfoSource() = default;
+
+    /**
+     * Ask for the current info of the connected phone.
+     *
+     * @return fd the reply arrives on, or -1 if the request could not be sent.
+     */
+    virtual int request() = 0;
+
+    /**
+     * Read the reply once the fd is readable, or give up on it after a timeout.
+     *
+     * @param ready false if the reply timed out.
+     * @return The info, or nothing if no phone is connected or there was no reply.
+     */
+    virtual std::optional<StationInfo> reply(bool ready) = 0;
+};
+
+/**
+ * Reads station info from the hostapd control interface.
+ */
+class HostapdStationSource: public StationInfoSource {
+public:
+    explicit HostapdStationSource(std::string ctrlPath);
+    ~HostapdStationSource();
+
+    int request() override;
+    std::optional<StationInfo> reply(bool ready) override;
+
+    // Parse the reply to a STA-FIRST or STA command.
+    static std::optional<StationInfo> parse(const std::string& reply);
+
+private:
+    bool connect();
+    void disconnect();
+
+    std::string m_ctrlPath;
+    int m_sock = -1;
+};
+
+enum class LinkQuality {
+    GOOD = 0,
+    DEGRADED = 1,
+};
+
+/**
+ * Adapts the phone's TCP socket to the wifi link quality. When the link degrades, the data queued but not
+ * yet sent is limited to about TARGET_QUEUE_DELAY at the current rate with TCP_NOTSENT_LOWAT, so the phone
+ * does not receive input and acknowledgements seconds late behind a full queue. Unlike a smaller SO_SNDBUF,
+ * this leaves send buffer autotuning alone, and the socket's own setting is restored once the link recovers.
+ *
+ * While degraded, the socket is also marked for the video WMM access category. The marking is per socket
+ * and not per Android Auto channel: the video stream flows from the phone to the dongle, so all that the
+ * dongle sends on the socket is input, audio input, control and acknowledgements, which are latency
+ * sensitive alike. The higher access category wins the contention for the air against the phone's own
+ * best effort video transmissions and the other stations, which is where those frames wait.
+ */
+class LinkController {
+public:
+    static LinkController& instance();
+
+    // Start polling the station info on the event loop.
+    void start(std::unique_ptr<StationInfoSource> source = nullptr);
+
+    void setSocket(int fd);
+
+    // Feed one sample of station info, called once per POLL_INTERVAL on the event loop.
+    void update(const StationInfo& info);
+
+    // Single line summary of the link and the decisions taken, as key=value pairs.
+    std::string summary();
+
+private:
+    static constexpr std::chrono::milliseconds POLL_INTERVAL = std::chrono::milliseconds(1000);
+    static constexpr std::chrono::milliseconds REPLY_TIMEOUT = std::chrono::milliseconds(500);
+    static constexpr std::chrono::milliseconds TARGET_QUEUE_DELAY = std::chrono::milliseconds(50);
+
+    // The link is degraded below either threshold, and good again above both recovery thresholds.
+    static constexpr int DEGRADED_SIGNAL = -75;
+    static constexpr double DEGRADED_TX_BITRATE = 24;
+    static constexpr int RECOVERED_SIGNAL = -70;
+    static constexpr double RECOVERED_TX_BITRATE = 48;
+    // Consecutive samples needed to change the link quality
+    static constexpr int DEGRADE_SAMPLES = 2;
+    static constexpr int RECOVER_SAMPLES = 3;
+
+    static constexpr int MIN_NOTSENT_LOWAT = 16 * 1024;
+    static constexpr int MAX_NOTSENT_LOWAT = 256 * 1024;
+    // Traffic class used while degraded, CS5 maps to the video access category
+    static constexpr int DEGRADED_TOS = 0xa0;
+
+    LinkController() {};
+    LinkController(LinkController const&);
+    LinkController& operator=(LinkController const&);
+
+    EventLoop::Task monitorLoop();
+
+    int notsentLowatFor(const StationInfo& info);
+    void applyDegraded(const char* reason);
+    void applyGood();
+
+    std::unique_ptr<StationInfoSource> m_source;
+
+    std::mutex m_mutex;
+    int m_fd = -1;
+    // Limit of the socket before it was first changed, 0 for the system default, to restore on recovery
+    int m_defaultNotsentLowat = 0;
+    int m_notsentLowat = 0;
+
+    LinkQuality m_quality = LinkQuality::GOOD;
+    int m_pendingSamples = 0;
+    std::optional<StationInfo> m_lastInfo;
+
+    uint64_t m_degradedCount = 0;
+    uint64_t m_recoveredCount = 0;
+    uint64_t m_notsentLowatChanges = 0;
+};
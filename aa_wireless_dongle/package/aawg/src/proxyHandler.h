@@ -1,31 +1,27 @@
 #pragma once
 
 #include <atomic>
-#include <optional>
-#include <thread>
+#include <cstdint>
+
+#include "eventLoop.h"
 
 class AAWProxy {
 public:
-    std::optional<std::thread> startServer(int32_t port);
-
-private:
-    enum class ProxyDirection {
-        TCP_to_USB,
-        USB_to_TCP
-    };
+    ~AAWProxy();
 
-    void handleClient(int server_fd);
-    void forward(ProxyDirection direction, std::atomic<bool>& should_exit);
-    void stopForwarding(std::atomic<bool>& should_exit);
+    // Start listening for the phone.
+    bool startServer(int32_t port);
+    // Accept the phone and forward its session until it ends, on the event loop. Forwarding runs on threads of its own.
+    EventLoop::Async<void> handleClient();
 
-    ssize_t readFully(int fd, unsigned char *buf, size_t nbyte);
-    ssize_t readMessage(int fd, unsigned char *buf, size_t nbyte);
+private:
+    // Close the listening socket if still open, and the fds of the session
+    void closeFds();
 
+    int m_server_fd = -1;
     int m_usb_fd = -1;
     int m_tcp_fd = -1;
 
-    std::optional<std::thread> m_usb_tcp_thread = std::nullopt;
-    std::optional<std::thread> m_tcp_usb_thread = std::nullopt;
-
-    std::atomic<bool> m_log_communication = false;
+    // Set by the control server's reconnect handler during a session
+    std::atomic<bool> m_reconnect_requested = false;
 };
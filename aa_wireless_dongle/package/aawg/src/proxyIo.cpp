@@ -0,0 +1,159 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+
+#include "proxyIo.h"
+#include "stats.h"
+
+void ProxyIo::setStopFd(int fd) {
+    m_stop_fd = fd;
+}
+
+bool ProxyIo::shouldRetry(int fd, short events, const std::atomic<bool>* should_exit) {
+    int err = errno;
+
+    if (should_exit && *should_exit) {
+        return false;
+    }
+
+    if (err == EINTR) {
+        return true;
+    }
+
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+        // On a blocking socket this means SO_RCVTIMEO or SO_SNDTIMEO expired, which is a real error.
+        int flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || !(flags & O_NONBLOCK)) {
+            errno = err;
+            return false;
+        }
+
+        // Wait until the fd is ready, or until the stop fd is signalled.
+        struct pollfd pfds[2] = {
+            {
+                .fd = fd,
+                .events = events,
+            },
+            {
+                .fd = should_exit ? m_stop_fd : -1,
+                .events = POLLIN,
+            },
+        };
+        if (poll(pfds, 2, -1) < 0 && errno != EINTR) {
+            return false;
+        }
+        return !(should_exit && *should_exit);
+    }
+
+    return false;
+}
+
+ssize_t ProxyIo::readSome(int fd, unsigned char *buffer, size_t nbyte, const std::atomic<bool>* should_exit) {
+    while (true) {
+        ssize_t len = read(fd, buffer, nbyte);
+
+        if (len < 0 && shouldRetry(fd, POLLIN, should_exit)) {
+            continue;
+        }
+
+        return len;
+    }
+}
+
+ssize_t ProxyIo::readFully(int fd, unsigned char *buffer, size_t nbyte, const std::atomic<bool>* should_exit) {
+    size_t remaining_bytes = nbyte;
+    while (remaining_bytes > 0) {
+        ssize_t len = readSome(fd, buffer, remaining_bytes, should_exit);
+
+        if (len <= 0) {
+            // Error, cannot read more.
+            return len;
+        }
+
+        buffer += len;
+        remaining_bytes -= len;
+    }
+
+    return nbyte;
+}
+
+ssize_t ProxyIo::writeFully(int fd, const unsigned char *buffer, size_t nbyte, const std::atomic<bool>* should_exit) {
+    size_t remaining_bytes = nbyte;
+    while (remaining_bytes > 0) {
+        ssize_t len = write(fd, buffer, remaining_bytes);
+
+        if (len < 0 && shouldRetry(fd, POLLOUT, should_exit)) {
+            continue;
+        }
+        else if (len < 0) {
+            return len;
+        }
+
+        buffer += len;
+        remaining_bytes -= len;
+    }
+
+    return nbyte;
+}
+
+ssize_t ProxyIo::sendFully(int fd, const unsigned char *buffer, size_t nbyte, int flags, const std::atomic<bool>* should_exit) {
+    size_t remaining_bytes = nbyte;
+    while (remaining_bytes > 0) {
+        ssize_t len = send(fd, buffer, remaining_bytes, flags);
+
+        if (len < 0 && shouldRetry(fd, POLLOUT, should_exit)) {
+            continue;
+        }
+        else if (len < 0) {
+            return len;
+        }
+
+        buffer += len;
+        remaining_bytes -= len;
+    }
+
+    return nbyte;
+}
+
+ssize_t ProxyIo::readMessage(int fd, unsigned char *buffer, size_t buffer_len, const std::atomic<bool>* should_exit) {
+    if (ssize_t len = readFully(fd, buffer, AAFrame::HEADER_LENGTH, should_exit); len <= 0) {
+        return len;
+    }
+
+    AAFrame::Header header = AAFrame::parseHeader(buffer);
+
+    if (header.frameLength() > buffer_len) {
+        // Not enough space in the buffer. This is unexpected.
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    // Read the rest of the header, if any, along with the payload.
+    if (ssize_t len = readFully(fd, buffer + AAFrame::HEADER_LENGTH, header.frameLength() - AAFrame::HEADER_LENGTH, should_exit); len <= 0) {
+        return len;
+    }
+
+    return header.frameLength();
+}
+
+ssize_t ProxyIo::readFrame(int fd, FrameBuffer& frames, const unsigned char** frame, const std::atomic<bool>* should_exit) {
+    while (true) {
+        if (size_t len = frames.nextFrame(frame); len > 0) {
+            return len;
+        }
+
+        // Read as much as is available, it usually holds several small frames.
+        // space() may move the buffered data, only then is the length of the free space known.
+        unsigned char* space = frames.space();
+        ssize_t len = readSome(fd, space, frames.spaceLength(), should_exit);
+        Stats::instance().addReadCall(TrafficDirection::TCP_to_USB);
+
+        if (len <= 0) {
+            return len;
+        }
+
+        frames.commit(len);
+    }
+}
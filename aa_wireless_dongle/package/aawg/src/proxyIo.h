@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <sys/types.h>
+
+#include "frameBuffer.h"
+
+/**
+ * Reads and writes of the forwarding threads, the same on blocking and non blocking fds.
+ *
+ * Interrupted and would-block calls are retried until should_exit is set. Would-block calls wait for the
+ * fd to be ready, or for the stop fd to be signalled.
+ */
+class ProxyIo {
+public:
+    // eventfd that wakes up calls waiting for an fd, -1 for none
+    void setStopFd(int fd);
+
+    ssize_t readSome(int fd, unsigned char *buf, size_t nbyte, const std::atomic<bool>* should_exit = nullptr);
+    ssize_t readFully(int fd, unsigned char *buf, size_t nbyte, const std::atomic<bool>* should_exit = nullptr);
+    ssize_t writeFully(int fd, const unsigned char *buf, size_t nbyte, const std::atomic<bool>* should_exit = nullptr);
+    ssize_t sendFully(int fd, const unsigned char *buf, size_t nbyte, int flags, const std::atomic<bool>* should_exit = nullptr);
+    // Read exactly one frame into buf
+    ssize_t readMessage(int fd, unsigned char *buf, size_t nbyte, const std::atomic<bool>* should_exit = nullptr);
+    // Hand out the next frame from frames, reading as much as is available when it holds no complete frame
+    ssize_t readFrame(int fd, FrameBuffer& frames, const unsigned char** frame, const std::atomic<bool>* should_exit = nullptr);
+
+private:
+    bool shouldRetry(int fd, short events, const std::atomic<bool>* should_exit);
+
+    int m_stop_fd = -1;
+};
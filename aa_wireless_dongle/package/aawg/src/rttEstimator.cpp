@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include "rttEstimator.h"
+
+/*static*/ RttEstimator& RttEstimator::instance() {
+    static RttEstimator instance;
+    return instance;
+}
+
+void RttEstimator::reset() {
+    for (int direction = 0; direction < 2; direction++) {
+        for (std::atomic<int64_t>& pending: m_pending[direction]) {
+            pending.store(0, std::memory_order_relaxed);
+        }
+        m_samples[direction].count.store(0, std::memory_order_release);
+    }
+}
+
+void RttEstimator::frameSent(TrafficDirection direction, const AAFrame::Header& header, std::chrono::steady_clock::time_point time) {
+    // Only a complete message can be answered
+    if (!(header.flags & AAFrame::FLAG_LAST)) {
+        return;
+    }
+
+    std::atomic<int64_t>& pending = m_pending[static_cast<int>(direction)][header.channel];
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    int64_t sent = pending.load(std::memory_order_relaxed);
+    if (sent == 0 || std::chrono::nanoseconds(now - sent) > MAX_RTT) {
+        // Fails only if the answer took the message in the meantime, then the slot is free for the next one.
+        pending.compare_exchange_strong(sent, now, std::memory_order_relaxed);
+    }
+}
+
+void RttEstimator::frameReceived(TrafficDirection direction, const AAFrame::Header& header, std::chrono::steady_clock::time_point time) {
+    if ((header.flags & AAFrame::FRAME_TYPE_MASK) != AAFrame::FRAME_TYPE_MASK || header.payloadLength > MAX_RESPONSE_LENGTH) {
+        return;
+    }
+
+    // The answer to a message sent towards the head unit comes back from the head unit, and the other way around.
+    TrafficDirection requestDirection = direction == TrafficDirection::USB_to_TCP ? TrafficDirection::TCP_to_USB : TrafficDirection::USB_to_TCP;
+    std::atomic<int64_t>& pending = m_pending[static_cast<int>(requestDirection)][header.channel];
+
+    // Cheap check first, most frames coming back answer nothing
+    if (pending.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    int64_t sent = pending.exchange(0, std::memory_order_relaxed);
+    if (sent == 0) {
+        return;
+    }
+
+    std::chrono::nanoseconds rtt = time.time_since_epoch() - std::chrono::nanoseconds(sent);
+    if (rtt > MAX_RTT) {
+        return;
+    }
+
+    // Only this thread writes the samples of the leg, the count publishes the value to summary().
+    Samples& samples = m_samples[requestDirection == TrafficDirection::TCP_to_USB ? USB : WIFI];
+    uint64_t count = samples.count.load(std::memory_order_relaxed);
+    samples.values[count % MAX_SAMPLES].store(std::chrono::duration_cast<std::chrono::microseconds>(rtt).count(), std::memory_order_relaxed);
+    samples.count.store(count + 1, std::memory_order_release);
+}
+
+/*static*/ double RttEstimator::percentile(std::vector<uint32_t>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+
+    size_t index = std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+std::string RttEstimator::summary() {
+    std::string result;
+
+    for (Leg leg: {WIFI, USB}) {
+        // A sample overwritten while copying only mixes a newer value into the percentiles.
+        uint64_t count = m_samples[leg].count.load(std::memory_order_acquire);
+        std::vector<uint32_t> sorted(std::min<uint64_t>(count, MAX_SAMPLES));
+        for (size_t i = 0; i < sorted.size(); i++) {
+            sorted[i] = m_samples[leg].values[i].load(std::memory_order_relaxed);
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        const char* name = leg == WIFI ? "wifi" : "usb";
+        char buffer[160];
+        snprintf(buffer, sizeof(buffer), "%srtt_%s_samples=%llu rtt_%s_p50_ms=%.1f rtt_%s_p90_ms=%.1f rtt_%s_p99_ms=%.1f",
+            result.empty() ? "" : " ",
+            name, (unsigned long long)count,
+            name, percentile(sorted, 0.5),
+            name, percentile(sorted, 0.9),
+            name, percentile(sorted, 0.99));
+        result += buffer;
+    }
+
+    return result;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "aaFrame.h"
+#include "stats.h"
+
+/**
+ * Passively estimates the round trip time on each side of the dongle from the frame headers, which stay in
+ * plain text after TLS starts.
+ *
+ * A complete message forwarded on a channel is paired with the next small single frame message coming back
+ * on the same channel, like a ping and its response, or a media frame and its acknowledgement. Messages
+ * forwarded to the phone measure the wifi leg, messages forwarded to the head unit measure the USB leg.
+ * Both include the time the other end takes to answer.
+ *
+ * Called for every frame by both forwarding threads, so it takes no lock: each pending message is one
+ * atomic slot, set by the thread sending in its direction and taken by the thread reading the answer, and
+ * the samples of each leg are only written by the thread reading that leg's answers.
+ */
+class RttEstimator {
+public:
+    static RttEstimator& instance();
+
+    // Forget the samples of the previous session.
+    void reset();
+
+    // A frame was written towards the phone for USB_to_TCP, or towards the head unit for TCP_to_USB.
+    void frameSent(TrafficDirection direction, const AAFrame::Header& header, std::chrono::steady_clock::time_point time);
+    // A frame was read from the head unit for USB_to_TCP, or from the phone for TCP_to_USB.
+    void frameReceived(TrafficDirection direction, const AAFrame::Header& header, std::chrono::steady_clock::time_point time);
+
+    // Percentiles of the recent samples of both legs, as key=value pairs.
+    std::string summary();
+
+private:
+    enum Leg {
+        WIFI = 0,
+        USB = 1,
+    };
+
+    static constexpr size_t MAX_SAMPLES = 256;
+    // Larger frames coming back are data, not an answer
+    static constexpr size_t MAX_RESPONSE_LENGTH = 128;
+    // A message unanswered for longer than this is not expected to be answered
+    static constexpr std::chrono::milliseconds MAX_RTT = std::chrono::milliseconds(2000);
+
+    struct Samples {
+        std::atomic<uint32_t> values[MAX_SAMPLES];  // us, used as a ring
+        std::atomic<uint64_t> count;
+    };
+
+    RttEstimator() {};
+    RttEstimator(RttEstimator const&);
+    RttEstimator& operator=(RttEstimator const&);
+
+    static double percentile(std::vector<uint32_t>& sorted, double fraction);
+
+    // Send time in ns of the oldest unanswered message per direction and channel, 0 if there is none
+    std::atomic<int64_t> m_pending[2][256];
+    Samples m_samples[2];
+};
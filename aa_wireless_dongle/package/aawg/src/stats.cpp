@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+#include "flightRecorder.h"
+#include "rttEstimator.h"
+#include "stats.h"
+
+/*static*/ Stats& Stats::instance() {
+    static Stats instance;
+    return instance;
+}
+
+/*static*/ const char* Stats::stateName(SessionState state) {
+    switch (state) {
+        case SessionState::IDLE:
+            return "idle";
+        case SessionState::WAITING_FOR_ACCESSORY:
+            return "waiting_for_accessory";
+        case SessionState::FORWARDING:
+            return "forwarding";
+        default:
+            return "unknown";
+    }
+}
+
+/*static*/ const char* Stats::stateName(BluetoothState state) {
+    switch (state) {
+        case BluetoothState::OFF:
+            return "off";
+        case BluetoothState::POWERED:
+            return "powered";
+        case BluetoothState::CONNECTING:
+            return "connecting";
+        case BluetoothState::CONNECTED:
+            return "connected";
+        default:
+            return "unknown";
+    }
+}
+
+/*static*/ const char* Stats::reasonName(SessionResetReason reason) {
+    switch (reason) {
+        case SessionResetReason::NONE:
+            return "none";
+        case SessionResetReason::PHONE_LOST:
+            return "phone_lost";
+        case SessionResetReason::RECONNECT_REQUESTED:
+            return "reconnect_requested";
+        default:
+            return "unknown";
+    }
+}
+
+void Stats::setSessionState(SessionState state) {
+    SessionState previousState = m_sessionState.exchange(state);
+    if (previousState == state) {
+        return;
+    }
+
+    FlightRecorder::instance().record(FlightRecord::Type::SESSION_STATE, static_cast<uint32_t>(state));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (state == SessionState::FORWARDING) {
+        for (DirectionCounters& counters: m_directions) {
+            counters.lastTrafficTime = std::chrono::steady_clock::now();
+            counters.stalled = false;
+        }
+    }
+
+    // A session starts when leaving idle state
+    if (previousState == SessionState::IDLE || m_timelines.empty()) {
+        m_timelines.emplace_back();
+        if (m_timelines.size() > MAX_TIMELINES) {
+            m_timelines.pop_front();
+        }
+    }
+
+    m_timelines.back().push_back({std::chrono::steady_clock::now(), state});
+}
+
+SessionState Stats::getSessionState() {
+    return m_sessionState;
+}
+
+void Stats::addSessionReset(SessionResetReason reason) {
+    m_sessionResets++;
+    m_lastResetReason = reason;
+
+    FlightRecorder::instance().record(FlightRecord::Type::SESSION_RESET, static_cast<uint32_t>(reason));
+}
+
+void Stats::setBluetoothState(BluetoothState state) {
+    if (m_bluetoothState.exchange(state) != state) {
+        FlightRecorder::instance().record(FlightRecord::Type::BLUETOOTH_STATE, static_cast<uint32_t>(state));
+    }
+}
+
+void Stats::setBluetoothInitTime(std::chrono::steady_clock::duration duration) {
+    m_bluetoothInitMs = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+void Stats::addBluetoothConnect(std::chrono::steady_clock::duration duration, bool connected) {
+    m_bluetoothConnectMs = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    if (!connected) {
+        m_bluetoothConnectFailures++;
+    }
+}
+
+void Stats::addBluetoothHandshake(std::chrono::steady_clock::duration duration) {
+    m_bluetoothHandshakeMs = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    m_bluetoothHandshakes++;
+}
+
+void Stats::addReadCall(TrafficDirection direction) {
+    m_directions[static_cast<int>(direction)].readCalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Stats::addTraffic(TrafficDirection direction, size_t bytes, const unsigned char* header, size_t frames) {
+    DirectionCounters& counters = m_directions[static_cast<int>(direction)];
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counters.frames.fetch_add(frames, std::memory_order_relaxed);
+
+    if (!m_capture.load(std::memory_order_relaxed) || bytes < 4 || frames == 0) {
+        return;
+    }
+
+    TraceEntry entry = {std::chrono::steady_clock::now(), direction, bytes, {header[0], header[1], header[2], header[3]}};
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_trace.push_back(entry);
+    if (m_trace.size() > MAX_TRACE_ENTRIES) {
+        m_trace.pop_front();
+    }
+}
+
+void Stats::addUsbFlushLatency(std::chrono::steady_clock::duration latency) {
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    m_usbFlushes.fetch_add(1, std::memory_order_relaxed);
+    m_usbFlushLatencyTotal.fetch_add(us, std::memory_order_relaxed);
+
+    // Only the USB to TCP thread updates the maximum
+    if (us > m_usbFlushLatencyMax.load(std::memory_order_relaxed)) {
+        m_usbFlushLatencyMax.store(us, std::memory_order_relaxed);
+    }
+}
+
+void Stats::addUsbHeldWrite() {
+    m_usbHeldWrites.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Stats::setTcpFd(int fd) {
+    std::lock_guard<std::mutex> lock(m_tcpFdMutex);
+    m_tcpFd = fd;
+}
+
+void Stats::setCapture(bool enabled) {
+    m_capture = enabled;
+
+    if (enabled) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_trace.clear();
+    }
+}
+
+bool Stats::getCapture() {
+    return m_capture;
+}
+
+void Stats::sample() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - m_lastSampleTime).count();
+    m_lastSampleTime = now;
+
+    if (seconds <= 0) {
+        return;
+    }
+
+    const bool forwarding = (m_sessionState == SessionState::FORWARDING);
+
+    for (int direction = 0; direction < 2; direction++) {
+        DirectionCounters& counters = m_directions[direction];
+
+        uint64_t bytes = counters.bytes;
+        uint64_t frames = counters.frames;
+
+        counters.bytesPerSecond = (bytes - counters.lastBytes) / seconds;
+        counters.framesPerSecond = (frames - counters.lastFrames) / seconds;
+
+        if (bytes != counters.lastBytes) {
+            counters.lastTrafficTime = now;
+            counters.stalled = false;
+        }
+        else if (forwarding && !counters.stalled && now - counters.lastTrafficTime >= STALL_THRESHOLD) {
+            counters.stalled = true;
+            FlightRecorder::instance().record(FlightRecord::Type::STALL, direction,
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - counters.lastTrafficTime).count());
+        }
+
+        counters.lastBytes = bytes;
+        counters.lastFrames = frames;
+    }
+
+    if (forwarding && ++m_samplesSinceThroughputRecord >= THROUGHPUT_RECORD_INTERVAL) {
+        m_samplesSinceThroughputRecord = 0;
+        FlightRecorder::instance().record(FlightRecord::Type::THROUGHPUT,
+            m_directions[static_cast<int>(TrafficDirection::TCP_to_USB)].bytesPerSecond,
+            m_directions[static_cast<int>(TrafficDirection::USB_to_TCP)].bytesPerSecond);
+    }
+
+    FlightRecorder::instance().flush();
+}
+
+/*static*/ double Stats::readsPerFrame(const DirectionCounters& counters) {
+    uint64_t frames = counters.frames.load(std::memory_order_relaxed);
+    return frames > 0 ? (double)counters.readCalls.load(std::memory_order_relaxed) / frames : 0;
+}
+
+/*static*/ Stats::ProcessUsage Stats::processUsage() {
+    ProcessUsage usage = {0, 0, 0};
+
+    if (FILE* file = fopen("/proc/self/status", "re")) {
+        char line[128];
+        while (fgets(line, sizeof(line), file)) {
+            sscanf(line, "Threads: %d", &usage.threads);
+            sscanf(line, "VmRSS: %ld", &usage.rssKb);
+        }
+        fclose(file);
+    }
+
+    // Not counting the ., .. and the fd of the directory itself
+    if (DIR* dir = opendir("/proc/self/fd")) {
+        while (readdir(dir)) {
+            usage.fds++;
+        }
+        closedir(dir);
+        usage.fds -= 3;
+    }
+
+    return usage;
+}
+
+std::string Stats::summary() {
+    int tcpInQueue = 0;
+    int tcpOutQueue = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_tcpFdMutex);
+        if (m_tcpFd >= 0) {
+            ioctl(m_tcpFd, SIOCINQ, &tcpInQueue);
+            ioctl(m_tcpFd, SIOCOUTQ, &tcpOutQueue);
+        }
+    }
+
+    std::string rtt = RttEstimator::instance().summary();
+
+    // A client polling in a tight loop should not make the daemon scan /proc each time.
+    ProcessUsage process;
+    {
+        std::lock_guard<std::mutex> lock(m_processUsageMutex);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (m_processUsageTime == std::chrono::steady_clock::time_point() || now - m_processUsageTime >= PROCESS_USAGE_INTERVAL) {
+            m_processUsage = processUsage();
+            m_processUsageTime = now;
+        }
+        process = m_processUsage;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const DirectionCounters& tcpToUsb = m_directions[static_cast<int>(TrafficDirection::TCP_to_USB)];
+    const DirectionCounters& usbToTcp = m_directions[static_cast<int>(TrafficDirection::USB_to_TCP)];
+
+    uint64_t usbFlushes = m_usbFlushes;
+
+    char buffer[1280];
+    snprintf(buffer, sizeof(buffer),
+        "state=%s resets=%llu reset_reason=%s bt=%s bt_init_ms=%llu bt_connect_ms=%llu bt_connect_failures=%llu bt_handshake_ms=%llu bt_handshakes=%llu"
+        " tcp_usb_bytes=%llu tcp_usb_bps=%.0f tcp_usb_fps=%.0f tcp_usb_reads_per_frame=%.2f"
+        " usb_tcp_bytes=%llu usb_tcp_bps=%.0f usb_tcp_fps=%.0f usb_tcp_reads_per_frame=%.2f"
+        " usb_tcp_flush_us_avg=%.0f usb_tcp_flush_us_max=%llu usb_tcp_held_writes=%llu %s"
+        " tcp_inq=%d tcp_outq=%d sessions=%zu capture=%d threads=%d rss_kb=%ld fds=%d\n",
+        stateName(m_sessionState), (unsigned long long)m_sessionResets, reasonName(m_lastResetReason), stateName(m_bluetoothState),
+        (unsigned long long)m_bluetoothInitMs, (unsigned long long)m_bluetoothConnectMs, (unsigned long long)m_bluetoothConnectFailures,
+        (unsigned long long)m_bluetoothHandshakeMs, (unsigned long long)m_bluetoothHandshakes,
+        (unsigned long long)tcpToUsb.bytes, tcpToUsb.bytesPerSecond, tcpToUsb.framesPerSecond, readsPerFrame(tcpToUsb),
+        (unsigned long long)usbToTcp.bytes, usbToTcp.bytesPerSecond, usbToTcp.framesPerSecond, readsPerFrame(usbToTcp),
+        usbFlushes > 0 ? (double)m_usbFlushLatencyTotal / usbFlushes : 0,
+        (unsigned long long)m_usbFlushLatencyMax, (unsigned long long)m_usbHeldWrites, rtt.c_str(),
+        tcpInQueue, tcpOutQueue, m_timelines.size(), m_capture.load(), process.threads, process.rssKb, process.fds);
+
+    return buffer;
+}
+
+std::string Stats::timelines() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string result;
+    for (const std::vector<TimelineEvent>& timeline: m_timelines) {
+        if (timeline.empty()) {
+            continue;
+        }
+
+        for (size_t i = 0; i < timeline.size(); i++) {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "%s+%lld:%s", i > 0 ? " " : "",
+                (long long)std::chrono::duration_cast<std::chrono::milliseconds>(timeline[i].time - timeline.front().time).count(),
+                stateName(timeline[i].state));
+            result += buffer;
+        }
+        result += "\n";
+    }
+
+    return result;
+}
+
+std::string Stats::trace() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::string result;
+    for (const TraceEntry& entry: m_trace) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%lld %s ch=%u flags=0x%02x len=%zu\n",
+            (long long)std::chrono::duration_cast<std::chrono::microseconds>(entry.time - m_trace.front().time).count(),
+            entry.direction == TrafficDirection::TCP_to_USB ? "tcp>usb" : "usb>tcp",
+            entry.header[0], entry.header[1], entry.length);
+        result += buffer;
+    }
+
+    return result;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class SessionState {
+    IDLE = 0,
+    WAITING_FOR_ACCESSORY = 1,
+    FORWARDING = 2,
+};
+
+// Why a session was reset instead of resumed
+enum class SessionResetReason {
+    NONE = 0,
+    // The phone's connection failed, like on a wifi drop. The phone starts a new Android Auto session when it
+    // connects again, the head unit's session cannot continue with it.
+    PHONE_LOST = 1,
+    // The phone's connection was dropped on request of the control socket, with the same result
+    RECONNECT_REQUESTED = 2,
+};
+
+enum class BluetoothState {
+    OFF = 0,
+    POWERED = 1,
+    CONNECTING = 2,
+    CONNECTED = 3,
+};
+
+enum class TrafficDirection {
+    TCP_to_USB = 0,
+    USB_to_TCP = 1,
+};
+
+/**
+ * Process wide counters and recent history of the daemon, cheap enough to update from the forwarding threads.
+ */
+class Stats {
+public:
+    struct ProcessUsage {
+        int threads;
+        long rssKb;
+        int fds;
+    };
+
+    static Stats& instance();
+
+    // Threads, resident memory and open fds of the daemon, from /proc/self
+    static ProcessUsage processUsage();
+
+    void setSessionState(SessionState state);
+    SessionState getSessionState();
+
+    // A session ended with the head unit reset, because it could not be resumed
+    void addSessionReset(SessionResetReason reason);
+
+    void setBluetoothState(BluetoothState state);
+    // Control plane latencies of the last bluetooth init, connect attempt and phone handshake
+    void setBluetoothInitTime(std::chrono::steady_clock::duration duration);
+    void addBluetoothConnect(std::chrono::steady_clock::duration duration, bool connected);
+    void addBluetoothHandshake(std::chrono::steady_clock::duration duration);
+
+    void addTraffic(TrafficDirection direction, size_t bytes, const unsigned char* header, size_t frames = 1);
+    void addReadCall(TrafficDirection direction);
+    // Time from reading the last byte of a frame from USB to handing it to the TCP socket
+    void addUsbFlushLatency(std::chrono::steady_clock::duration latency);
+    // Write of an incomplete frame to the TCP socket, held back until the frame is complete
+    void addUsbHeldWrite();
+    // Socket of the current session for the queue sizes, must be cleared before the socket is closed.
+    void setTcpFd(int fd);
+
+    void setCapture(bool enabled);
+    bool getCapture();
+
+    /**
+     * Update the rates, expected to be called about once per second.
+     */
+    void sample();
+
+    // Single line summary of the current state, as key=value pairs.
+    std::string summary();
+    // One line per recent session, with the time of each state change since the start of the session.
+    std::string timelines();
+    // One line per captured frame header.
+    std::string trace();
+
+private:
+    static constexpr size_t MAX_TIMELINES = 8;
+    static constexpr size_t MAX_TRACE_ENTRIES = 256;
+
+    // A direction is considered stalled when no data was forwarded for this long while forwarding
+    static constexpr std::chrono::seconds STALL_THRESHOLD = std::chrono::seconds(2);
+    // Number of samples between throughput records in the flight recorder
+    static constexpr int THROUGHPUT_RECORD_INTERVAL = 5;
+    // Minimum time between two scans of /proc/self for the summary
+    static constexpr std::chrono::seconds PROCESS_USAGE_INTERVAL = std::chrono::seconds(1);
+
+    struct DirectionCounters {
+        std::atomic<uint64_t> bytes = 0;
+        std::atomic<uint64_t> frames = 0;
+        std::atomic<uint64_t> readCalls = 0;
+
+        uint64_t lastBytes = 0;
+        uint64_t lastFrames = 0;
+        double bytesPerSecond = 0;
+        double framesPerSecond = 0;
+
+        std::chrono::steady_clock::time_point lastTrafficTime;
+        bool stalled = false;
+    };
+
+    struct TimelineEvent {
+        std::chrono::steady_clock::time_point time;
+        SessionState state;
+    };
+
+    struct TraceEntry {
+        std::chrono::steady_clock::time_point time;
+        TrafficDirection direction;
+        size_t length;
+        unsigned char header[4];
+    };
+
+    Stats() {};
+    Stats(Stats const&);
+    Stats& operator=(Stats const&);
+
+    static const char* stateName(SessionState state);
+    static const char* stateName(BluetoothState state);
+    static const char* reasonName(SessionResetReason reason);
+    // Read syscalls per forwarded frame
+    static double readsPerFrame(const DirectionCounters& counters);
+
+    std::atomic<SessionState> m_sessionState = SessionState::IDLE;
+    std::atomic<BluetoothState> m_bluetoothState = BluetoothState::OFF;
+
+    std::atomic<uint64_t> m_sessionResets = 0;
+    std::atomic<SessionResetReason> m_lastResetReason = SessionResetReason::NONE;
+
+    DirectionCounters m_directions[2];
+
+    std::atomic<uint64_t> m_usbFlushes = 0;
+    std::atomic<uint64_t> m_usbFlushLatencyTotal = 0;  // us
+    std::atomic<uint64_t> m_usbFlushLatencyMax = 0;    // us
+    std::atomic<uint64_t> m_usbHeldWrites = 0;
+    std::chrono::steady_clock::time_point m_lastSampleTime = std::chrono::steady_clock::now();
+    int m_samplesSinceThroughputRecord = 0;
+
+    std::atomic<uint64_t> m_bluetoothInitMs = 0;
+    std::atomic<uint64_t> m_bluetoothConnectMs = 0;
+    std::atomic<uint64_t> m_bluetoothConnectFailures = 0;
+    std::atomic<uint64_t> m_bluetoothHandshakeMs = 0;
+    std::atomic<uint64_t> m_bluetoothHandshakes = 0;
+
+    // Held while the socket is queried, so setTcpFd(-1) waits until it is no longer in use.
+    std::mutex m_tcpFdMutex;
+    int m_tcpFd = -1;
+
+    std::mutex m_processUsageMutex;
+    ProcessUsage m_processUsage = {0, 0, 0};
+    std::chrono::steady_clock::time_point m_processUsageTime;
+
+    std::atomic<bool> m_capture = false;
+
+    // Guards the timelines, trace and the sampled rates
+    std::mutex m_mutex;
+    std::deque<std::vector<TimelineEvent>> m_timelines;
+    std::deque<TraceEntry> m_trace;
+};
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Plays the head unit for benchAccessory: puts the board in Android accessory mode, then streams bulk data
+to it and reads what it sends back, in both directions at once, and prints the throughput seen on the PC.
+
+Needs pyusb, and access to the board's USB device (root, or a udev rule).
+
+    accessoryHost.py [--seconds 10]
+"""
+
+import argparse
+import threading
+import time
+
+import usb.core
+import usb.util
+
+GOOGLE_VENDOR_ID = 0x18D1
+DEFAULT_PRODUCT_ID = 0x4EE1
+ACCESSORY_PRODUCT_IDS = (0x2D00, 0x2D01)
+
+ACCESSORY_GET_PROTOCOL = 51
+ACCESSORY_SEND_STRING = 52
+ACCESSORY_START = 53
+
+ACCESSORY_STRINGS = ["Android", "Android Auto", "Android Auto", "2.0.1", "", ""]
+
+CHUNK = 64 * 1024
+TIMEOUT_MS = 1000
+
+
+def find_accessory():
+    for product_id in ACCESSORY_PRODUCT_IDS:
+        device = usb.core.find(idVendor=GOOGLE_VENDOR_ID, idProduct=product_id)
+        if device is not None:
+            return device
+    return None
+
+
+def start_accessory(timeout):
+    device = find_accessory()
+    if device is not None:
+        return device
+
+    device = usb.core.find(idVendor=GOOGLE_VENDOR_ID, idProduct=DEFAULT_PRODUCT_ID)
+    if device is None:
+        raise SystemExit("board not found")
+
+    protocol = device.ctrl_transfer(0xC0, ACCESSORY_GET_PROTOCOL, 0, 0, 2)
+    print("accessory protocol %d" % (protocol[0] | protocol[1] << 8))
+    for index, string in enumerate(ACCESSORY_STRINGS):
+        device.ctrl_transfer(0x40, ACCESSORY_SEND_STRING, 0, index, string.encode() + b"\0")
+    device.ctrl_transfer(0x40, ACCESSORY_START, 0, 0, None)
+
+    # The board switches gadgets, and comes back with the accessory ids.
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        device = find_accessory()
+        if device is not None:
+            return device
+        time.sleep(0.1)
+
+    raise SystemExit("board did not come back in accessory mode")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--seconds", type=float, default=10)
+    args = parser.parse_args()
+
+    device = start_accessory(10)
+    if device.is_kernel_driver_active(0):
+        device.detach_kernel_driver(0)
+    device.set_configuration()
+    interface = device.get_active_configuration()[(0, 0)]
+    usb.util.claim_interface(device, interface)
+
+    def endpoint(direction):
+        return usb.util.find_descriptor(interface, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == direction)
+
+    endpoint_in = endpoint(usb.util.ENDPOINT_IN)
+    endpoint_out = endpoint(usb.util.ENDPOINT_OUT)
+
+    deadline = time.monotonic() + args.seconds
+    totals = {"in": 0, "out": 0}
+
+    def receive():
+        while time.monotonic() < deadline:
+            try:
+                totals["in"] += len(endpoint_in.read(CHUNK, TIMEOUT_MS))
+            except usb.core.USBTimeoutError:
+                pass
+
+    def send():
+        data = bytes(range(256)) * (CHUNK // 256)
+        while time.monotonic() < deadline:
+            try:
+                totals["out"] += endpoint_out.write(data, TIMEOUT_MS)
+            except usb.core.USBTimeoutError:
+                pass
+
+    start = time.monotonic()
+    threads = [threading.Thread(target=receive), threading.Thread(target=send)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - start
+
+    usb.util.release_interface(device, interface)
+    print("to board: %.1f MB/s, from board: %.1f MB/s" % (totals["out"] / elapsed / 1e6, totals["in"] / elapsed / 1e6))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdio.h>
+#include <sys/utsname.h>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Minimal benchmark helpers. Each result is printed as one JSON object per line on stdout, tagged with
+ * the machine it ran on, so runs on x86 and on the boards can be collected and compared between releases.
+ */
+namespace Bench {
+    struct Result {
+        uint64_t iterations;
+        std::chrono::nanoseconds elapsed;
+    };
+
+    /**
+     * Keep the compiler from dropping the computation of a value that is otherwise unused.
+     */
+    template <typename T>
+    inline void keep(const T& value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    /**
+     * Run body in growing batches until one batch takes at least minimumTime, and time that batch.
+     */
+    template <typename Body>
+    Result run(Body&& body, std::chrono::milliseconds minimumTime = std::chrono::milliseconds(200)) {
+        for (uint64_t iterations = 1;; iterations *= 2) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) {
+                body();
+            }
+            std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+            if (elapsed >= minimumTime) {
+                return {iterations, elapsed};
+            }
+        }
+    }
+
+    /**
+     * Print a result. bytes is the amount of data handled per iteration, for a throughput figure.
+     */
+    inline void report(const char* name, const Result& result, uint64_t bytes = 0) {
+        static struct utsname machine;
+        if (!machine.machine[0]) {
+            uname(&machine);
+        }
+
+        double nanoseconds = result.elapsed.count();
+        double perIteration = result.iterations > 0 ? nanoseconds / result.iterations : 0;
+        double bytesPerSecond = nanoseconds > 0 ? bytes * result.iterations * 1e9 / nanoseconds : 0;
+
+        printf("{\"benchmark\":\"%s\",\"machine\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.1f,\"bytes_per_s\":%.0f}\n",
+            name, machine.machine, (unsigned long long)result.iterations, perIteration, bytesPerSecond);
+        fflush(stdout);
+    }
+}
@@ -0,0 +1,107 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/poll.h>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+
+/*
+ * Bulk throughput of /dev/usb_accessory on the board, in both directions at once, with the f_accessory
+ * request sizing in the name of each result.
+ *
+ * The head unit side is played by accessoryHost.py on a PC connected to the board's USB port. aawgd can
+ * keep running, it switches to the accessory gadget when the PC starts accessory mode, and only opens the
+ * accessory once a phone connects, so no phone must be connected.
+ *
+ *   benchAccessory [seconds] [device]
+ */
+
+static std::string moduleParameter(const char* name) {
+    std::ifstream file(std::string("/sys/module/usb_f_accessory/parameters/") + name);
+    std::string value;
+    std::getline(file, value);
+    return value.empty() ? "unknown" : value;
+}
+
+/**
+ * Transfer in one direction until the deadline, waiting at most 100 ms at a time so the deadline is kept
+ * even when the PC stops.
+ *
+ * @return Bytes transferred, or -1 on error.
+ */
+static long long transfer(int fd, bool reading, std::chrono::steady_clock::time_point deadline) {
+    std::vector<unsigned char> buffer(256 * 1024);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<unsigned char>(i);
+    }
+
+    long long total = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+        struct pollfd pfd = {
+            .fd = fd,
+            .events = static_cast<short>(reading ? POLLIN : POLLOUT),
+        };
+        if (poll(&pfd, 1, 100) < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (pfd.revents & (POLLERR | POLLHUP)) {
+            fprintf(stderr, "accessory disconnected\n");
+            return -1;
+        }
+        if (!(pfd.revents & pfd.events)) {
+            continue;
+        }
+
+        // Writes of 64 KB, like a large video frame forwarded at once
+        ssize_t len = reading ? read(fd, buffer.data(), buffer.size()) : write(fd, buffer.data(), 64 * 1024);
+        if (len < 0 && errno != EAGAIN && errno != EINTR) {
+            fprintf(stderr, "%s failed: %s\n", reading ? "read" : "write", strerror(errno));
+            return -1;
+        }
+        total += len > 0 ? len : 0;
+    }
+
+    return total;
+}
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    const char* path = argc > 2 ? argv[2] : "/dev/usb_accessory";
+
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "opening %s failed: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    std::string sizing = "buffer_" + moduleParameter("bulk_buffer_size") + "_tx_" + moduleParameter("tx_req_max") + "_rx_" + moduleParameter("rx_req_max");
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(seconds);
+
+    long long received = 0;
+    std::thread reader([fd, deadline, &received]() {
+        received = transfer(fd, true, deadline);
+    });
+    long long sent = transfer(fd, false, deadline);
+    reader.join();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    close(fd);
+
+    if (received < 0 || sent < 0) {
+        return 1;
+    }
+
+    Bench::report(("accessory/read/" + sizing).c_str(), {1, elapsed}, received);
+    Bench::report(("accessory/write/" + sizing).c_str(), {1, elapsed}, sent);
+
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "bluezMock.h"
+#include "bluetoothHandler.h"
+#include "eventLoop.h"
+
+/*
+ * Time to connect: from BluetoothHandler starting to connect the known devices until the phone has the wifi
+ * details from the RFCOMM handshake. bluetoothd is played by BluezMock on a private bus, so the figures are
+ * the control plane's own cost plus the scripted delays:
+ *   one_phone          one device that connects right away
+ *   paging_200ms       one device that takes 200 ms to connect, like paging a phone
+ *   first_unreachable  a device out of range failing after 200 ms, then one that connects
+ *   already_connected  a device that is still connected from before
+ *   after_restart      one device, right after bluetoothd restarted
+ *
+ * Every iteration powers the adapter on, connects, and ends the session like aawgd does after one. For the
+ * restart, the time until the handler registered its profile again and powered the adapter is reported too.
+ *
+ * Time to discovery: from powering on, or from the end of a session, until the phone found the LE advertisement
+ * and finished the handshake. The phone starts scanning after a scripted delay and sees the advertisement one
+ * MaxInterval of the phase registered at that time later, so the figures follow the advertising schedule.
+ * The phases are shortened to a 250 ms burst and a 500 ms fast phase, for scans to start in each of them:
+ *   power_on/immediate, power_on/after_fast       scanning right away, or once the slow phase started
+ *   session_end/immediate, session_end/after_burst, session_end/after_fast
+ *
+ * The log of the daemon code goes to stderr, with the phase each discovery happened in, the results to stdout.
+ *
+ *   benchBluetoothConnect [iterations]
+ */
+
+using namespace std::chrono_literals;
+
+static constexpr std::chrono::seconds CONNECT_TIMEOUT(10);
+// Devices are replaced before each iteration, for the handler to see them in its mirror.
+static constexpr std::chrono::milliseconds SETTLE_TIME(50);
+
+struct Scenario {
+    const char* name;
+    std::vector<BluezMock::DeviceBehaviour> devices;
+    bool restart = false;
+};
+
+static const std::vector<Scenario> SCENARIOS = {
+    {"one_phone", {{"00:11:22:33:44:01"}}},
+    {"paging_200ms", {{"00:11:22:33:44:01", false, 200ms}}},
+    {"first_unreachable", {{"00:11:22:33:44:01", false, 200ms, -1}, {"00:11:22:33:44:02"}}},
+    {"already_connected", {{"00:11:22:33:44:01", true}}},
+    {"after_restart", {{"00:11:22:33:44:01"}}, true},
+};
+
+enum class DiscoveryStart {
+    POWER_ON,
+    SESSION_END,
+};
+
+struct DiscoveryScenario {
+    const char* name;
+    DiscoveryStart from;
+    // Until the phone starts scanning
+    std::chrono::milliseconds scanDelay;
+};
+
+static constexpr const char* BURST_PERIOD_MS = "250";
+static constexpr const char* FAST_PERIOD_MS = "500";
+
+static const std::vector<DiscoveryScenario> DISCOVERY_SCENARIOS = {
+    {"power_on/immediate", DiscoveryStart::POWER_ON, 0ms},
+    {"power_on/after_fast", DiscoveryStart::POWER_ON, 600ms},
+    {"session_end/immediate", DiscoveryStart::SESSION_END, 0ms},
+    {"session_end/after_burst", DiscoveryStart::SESSION_END, 400ms},
+    {"session_end/after_fast", DiscoveryStart::SESSION_END, 900ms},
+};
+
+// Restart the mock's bluetoothd, and wait until the handler set it up again.
+static EventLoop::Async<bool> restart(BluezMock& mock, Bench::Result& recovery) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    co_await EventLoop::instance().blocking([&mock]() { mock.restart(); });
+
+    while (!mock.recovered()) {
+        if (std::chrono::steady_clock::now() - start > CONNECT_TIMEOUT) {
+            fprintf(stderr, "not set up again within %lld s after bluetoothd restarted\n", (long long)CONNECT_TIMEOUT.count());
+            co_return false;
+        }
+        co_await EventLoop::instance().sleepFor(std::chrono::milliseconds(1));
+    }
+
+    recovery.iterations++;
+    recovery.elapsed += std::chrono::steady_clock::now() - start;
+    co_return true;
+}
+
+static EventLoop::Task runScenarios(BluezMock& mock, EventLoop::Signal phoneConnected, int iterations, std::promise<bool>& result) {
+    for (const Scenario& scenario: SCENARIOS) {
+        Bench::Result connect = {0, std::chrono::nanoseconds(0)};
+        Bench::Result recovery = {0, std::chrono::nanoseconds(0)};
+
+        for (int i = 0; i < iterations; i++) {
+            co_await EventLoop::instance().blocking([&mock, &scenario]() { mock.setDevices(scenario.devices); });
+            co_await EventLoop::instance().sleepFor(SETTLE_TIME);
+            co_await EventLoop::instance().blocking([]() { BluetoothHandler::instance().powerOn(); });
+
+            if (scenario.restart && !co_await restart(mock, recovery)) {
+                result.set_value(false);
+                co_return;
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            BluetoothHandler::instance().connectWithRetry();
+            bool connected = co_await phoneConnected.wait(CONNECT_TIMEOUT);
+            std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+            BluetoothHandler::instance().stopConnectWithRetry();
+            co_await BluetoothHandler::instance().connectWithRetryStopped();
+            co_await EventLoop::instance().blocking([&mock]() { mock.disconnectAll(); });
+
+            if (!connected) {
+                fprintf(stderr, "%s: no connection within %lld s\n", scenario.name, (long long)CONNECT_TIMEOUT.count());
+                result.set_value(false);
+                co_return;
+            }
+
+            connect.iterations++;
+            connect.elapsed += elapsed;
+        }
+
+        Bench::report((std::string("bluetooth/connect/") + scenario.name).c_str(), connect);
+        if (recovery.iterations) {
+            Bench::report("bluetooth/recover_after_restart", recovery);
+        }
+    }
+
+    for (const DiscoveryScenario& scenario: DISCOVERY_SCENARIOS) {
+        Bench::Result discovery = {0, std::chrono::nanoseconds(0)};
+        uint32_t interval = 0;
+
+        for (int i = 0; i < iterations; i++) {
+            co_await EventLoop::instance().blocking([&mock]() { mock.setDevices({{"00:11:22:33:44:01"}}); });
+            co_await EventLoop::instance().sleepFor(SETTLE_TIME);
+            co_await EventLoop::instance().blocking([&scenario]() {
+                if (scenario.from == DiscoveryStart::POWER_ON) {
+                    BluetoothHandler::instance().powerOff();
+                } else {
+                    BluetoothHandler::instance().powerOn();
+                }
+            });
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            mock.discoverAfter(scenario.scanDelay);
+            co_await EventLoop::instance().blocking([&scenario]() {
+                if (scenario.from == DiscoveryStart::POWER_ON) {
+                    BluetoothHandler::instance().powerOn();
+                } else {
+                    BluetoothHandler::instance().sessionEnded();
+                }
+            });
+            bool connected = co_await phoneConnected.wait(CONNECT_TIMEOUT);
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+            co_await EventLoop::instance().blocking([&mock]() { mock.disconnectAll(); });
+
+            if (!connected) {
+                fprintf(stderr, "%s: not discovered within %lld s\n", scenario.name, (long long)CONNECT_TIMEOUT.count());
+                result.set_value(false);
+                co_return;
+            }
+
+            discovery.iterations++;
+            discovery.elapsed += end - start;
+
+            // The phase the phone saw, registered last before the scan started
+            for (const BluezMock::AdvertisementPhase& phase: mock.advertisements()) {
+                if (phase.registered <= start + scenario.scanDelay) {
+                    interval = phase.maxInterval;
+                }
+            }
+        }
+
+        fprintf(stderr, "%s: discovered at a %u ms advertising interval\n", scenario.name, interval);
+        Bench::report((std::string("bluetooth/discovery/") + scenario.name).c_str(), discovery);
+    }
+
+    result.set_value(true);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20;
+
+    PrivateBus bus;
+    if (bus.address().empty()) {
+        return 1;
+    }
+
+    setenv("AAWG_DBUS_ADDRESS", bus.address().c_str(), 1);
+    // There is no wlan0 to take it from
+    setenv("AAWG_WIFI_BSSID", "00:00:00:00:00:00", 0);
+    // Advertising, for the phone to discover the dongle
+    setenv("AAWG_CONNECTION_STRATEGY", "0", 1);
+    setenv("AAWG_BLE_BURST_PERIOD_MS", BURST_PERIOD_MS, 1);
+    setenv("AAWG_BLE_FAST_PERIOD_MS", FAST_PERIOD_MS, 1);
+
+    EventLoop::Signal phoneConnected;
+    BluezMock mock(bus.address(), [phoneConnected]() mutable { phoneConnected.notify(); });
+    if (!mock.start()) {
+        return 1;
+    }
+
+    std::thread([]() { EventLoop::instance().run(); }).detach();
+    BluetoothHandler::instance().init();
+
+    std::promise<bool> result;
+    std::future<bool> future = result.get_future();
+    EventLoop::instance().spawn([&mock, phoneConnected, iterations, &result]() {
+        return runScenarios(mock, phoneConnected, iterations, result);
+    });
+    bool ok = future.get();
+
+    BluezMock::Counters counters = mock.counters();
+    fprintf(stderr, "ConnectProfile calls: %d, failed: %d, Disconnect calls: %d, handshakes: %d\n",
+        counters.connectCalls, counters.connectFailures, counters.disconnectCalls, counters.handshakes);
+
+    return ok ? 0 : 1;
+}
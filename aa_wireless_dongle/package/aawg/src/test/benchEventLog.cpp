@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <syslog.h>
+
+#include "bench.h"
+#include "common.h"
+#include "eventLog.h"
+
+// Events logged between two flushes, half of a thread buffer so none are dropped.
+static constexpr uint64_t BATCH = 512;
+
+static void vsyslogInfo(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsyslog(LOG_INFO, format, args);
+    va_end(args);
+}
+
+int main() {
+    // The logger also copies every line to stderr, keep the output to the results.
+    freopen("/dev/null", "w", stderr);
+    Logger::instance();
+
+    // Cost on the logging thread, with the formatting left to the flush in between batches.
+    Bench::Result log = {0, std::chrono::nanoseconds(0)};
+    Bench::Result flush = {0, std::chrono::nanoseconds(0)};
+    while (log.elapsed < std::chrono::milliseconds(200)) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < BATCH; i++) {
+            EventLog::log<LogEvent::BYTES_READ>(static_cast<ssize_t>(i), "TCP");
+        }
+        std::chrono::steady_clock::time_point logged = std::chrono::steady_clock::now();
+        EventLog::instance().flush();
+        std::chrono::steady_clock::time_point flushed = std::chrono::steady_clock::now();
+
+        log.iterations += BATCH;
+        log.elapsed += logged - start;
+        flush.iterations += BATCH;
+        flush.elapsed += flushed - logged;
+    }
+    Bench::report("event_log/log", log);
+    Bench::report("event_log/sink_per_event", flush);
+
+    // The same message formatted on the calling thread, as Logger::info does.
+    Bench::report("event_log/vsyslog", Bench::run([i = 0LL]() mutable {
+        vsyslogInfo("%lld bytes read from %s\n", i++, "TCP");
+    }));
+
+    return 0;
+}
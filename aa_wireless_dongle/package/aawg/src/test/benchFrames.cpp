@@ -0,0 +1,170 @@
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "bench.h"
+#include "faultyIo.h"
+#include "frameStream.h"
+#include "aaFrame.h"
+#include "frameBuffer.h"
+#include "proxyIo.h"
+#include "rttEstimator.h"
+#include "uevent.h"
+#include "wirelessMessage.h"
+#include "proto/WifiInfoResponse.pb.h"
+
+// Read sizes of the phone side: unlimited, splitting frames mid payload, splitting headers, one byte at a time.
+static const size_t s_readChunks[] = {0, 1357, 3, 1};
+
+static void benchParse(const std::vector<unsigned char>& stream) {
+    Bench::report("aa_frame/parse_header", Bench::run([&stream]() {
+        size_t offset = 0;
+        while (offset < stream.size()) {
+            offset += AAFrame::parseHeader(stream.data() + offset).frameLength();
+        }
+        Bench::keep(offset);
+    }), stream.size());
+
+    // The USB reads arrive in arbitrary pieces
+    for (size_t chunk: s_readChunks) {
+        std::string name = "stream_tracker/consume/chunk_" + std::to_string(chunk);
+        size_t step = chunk > 0 ? chunk : stream.size();
+        AAFrame::StreamTracker tracker;
+        Bench::report(name.c_str(), Bench::run([&stream, &tracker, step]() {
+            size_t complete = 0;
+            for (size_t offset = 0; offset < stream.size(); offset += step) {
+                complete += tracker.consume(stream.data() + offset, std::min(step, stream.size() - offset), [](const AAFrame::Header&) {});
+            }
+            Bench::keep(complete);
+        }), stream.size());
+    }
+}
+
+template <typename ReadOne>
+static void benchRead(const char* name, const std::vector<unsigned char>& stream, size_t frames, size_t chunk, ReadOne&& readOne) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+    FaultyIo::inject(fds[0], {.maxChunk = chunk});
+
+    Bench::Result result;
+    {
+        FrameStream::Writer writer(fds[1], stream);
+        result = Bench::run([&readOne, fd = fds[0]]() {
+            readOne(fd);
+        });
+        shutdown(fds[0], SHUT_RDWR);
+    }
+
+    FaultyIo::clear(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+
+    std::string fullName = std::string(name) + "/chunk_" + std::to_string(chunk);
+    Bench::report(fullName.c_str(), result, stream.size() / frames);
+}
+
+static void benchReads(const std::vector<unsigned char>& stream, size_t frames) {
+    ProxyIo io;
+
+    for (size_t chunk: s_readChunks) {
+        // One read per header and one per payload, as the TCP to USB direction did before the frame buffer
+        std::vector<unsigned char> buffer(FrameBuffer::MAX_FRAME_LENGTH);
+        benchRead("proxy_io/read_message", stream, frames, chunk, [&io, &buffer](int fd) {
+            io.readMessage(fd, buffer.data(), buffer.size());
+        });
+
+        FrameBuffer frameBuffer;
+        benchRead("proxy_io/read_frame", stream, frames, chunk, [&io, &frameBuffer](int fd) {
+            const unsigned char* frame;
+            io.readFrame(fd, frameBuffer, &frame);
+        });
+    }
+}
+
+static void benchRttEstimator(const std::vector<unsigned char>& stream) {
+    std::vector<AAFrame::Header> headers;
+    for (size_t offset = 0; offset < stream.size(); offset += headers.back().frameLength()) {
+        headers.push_back(AAFrame::parseHeader(stream.data() + offset));
+    }
+
+    // What the forwarder does for each frame, the stream taken as read and sent in one direction
+    auto forwardAll = [&headers](TrafficDirection direction) {
+        for (const AAFrame::Header& header: headers) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            RttEstimator::instance().frameReceived(direction, header, now);
+            RttEstimator::instance().frameSent(direction, header, now);
+        }
+    };
+
+    Bench::report("rtt_estimator/one_direction", Bench::run([&forwardAll]() {
+        forwardAll(TrafficDirection::USB_to_TCP);
+    }), stream.size());
+
+    // With the other direction forwarding at the same time, as in a session
+    std::atomic<bool> stop = false;
+    std::thread other([&forwardAll, &stop]() {
+        while (!stop) {
+            forwardAll(TrafficDirection::TCP_to_USB);
+        }
+    });
+    Bench::report("rtt_estimator/both_directions", Bench::run([&forwardAll]() {
+        forwardAll(TrafficDirection::USB_to_TCP);
+    }), stream.size());
+    stop = true;
+    other.join();
+
+    Bench::keep(RttEstimator::instance().summary().size());
+}
+
+static void benchUevent() {
+    // Worst case: a full netlink message of short entries, each one a map insertion.
+    std::string message = "change@/devices/platform/soc/20980000.usb/udc/20980000.usb";
+    message += '\0';
+    for (int i = 0; message.size() < 8 * 1024 - 32; i++) {
+        message += "KEY" + std::to_string(i) + "=value" + std::to_string(i);
+        message += '\0';
+    }
+    Bench::report("uevent/parse/worst_case", Bench::run([&message]() {
+        Bench::keep(UeventMonitor::parse(message.data(), message.size()).size());
+    }), message.size());
+
+    std::string accessory = std::string("change@/devices/virtual/misc/usb_accessory") + '\0'
+        + "ACTION=change" + '\0' + "DEVPATH=/devices/virtual/misc/usb_accessory" + '\0' + "SUBSYSTEM=misc" + '\0'
+        + "ACCESSORY=START" + '\0' + "MAJOR=10" + '\0' + "MINOR=60" + '\0' + "DEVNAME=usb_accessory" + '\0' + "SEQNUM=2412";
+    Bench::report("uevent/parse/accessory_start", Bench::run([&accessory]() {
+        Bench::keep(UeventMonitor::parse(accessory.data(), accessory.size()).size());
+    }), accessory.size());
+}
+
+static void benchHandshake() {
+    WifiInfoResponse response;
+    response.set_ssid("AAWirelessDongle-1234");
+    response.set_key("ConnectAAWirelessDongle");
+    response.set_bssid("b8:27:eb:12:34:56");
+    response.set_security_mode(WPA2_PERSONAL);
+    response.set_access_point_type(DYNAMIC);
+
+    size_t length = WirelessMessage::encode(3, response).size();
+    Bench::report("wireless_message/encode", Bench::run([&response]() {
+        Bench::keep(WirelessMessage::encode(3, response).size());
+    }), length);
+}
+
+int main() {
+    // The writer threads see their peer go away at the end of each benchmark.
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t frames;
+    std::vector<unsigned char> stream = FrameStream::session(frames);
+
+    benchParse(stream);
+    benchReads(stream, frames);
+    benchRttEstimator(stream);
+    benchUevent();
+    benchHandshake();
+
+    return 0;
+}
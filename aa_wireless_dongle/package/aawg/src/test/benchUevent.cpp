@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "uevent.h"
+
+/*
+ * Latency of a uevent from the moment it is sent until a handler is called with it, through the monitor's
+ * receive loop on the event loop thread. The messages come from a socketpair, one datagram per uevent like
+ * the kernel's netlink socket, and each one is sent only once the previous one was handled.
+ */
+
+// Handlers registered for the whole daemon run, as the USB and bluetooth code does
+static constexpr int PERSISTENT_HANDLERS = 8;
+
+class SocketUeventSource: public UeventSource {
+public:
+    explicit SocketUeventSource(int fd): m_fd(fd) {};
+    ~SocketUeventSource() override { close(m_fd); }
+
+    ssize_t receive(char* buffer, size_t length) override { return recv(m_fd, buffer, length, 0); }
+    int fd() override { return m_fd; }
+
+private:
+    int m_fd;
+};
+
+// Send time of the message in flight, and the total latency of the handled ones
+static std::atomic<int64_t> s_sentNs = 0;
+static std::atomic<int64_t> s_latencyNs = 0;
+static std::atomic<uint64_t> s_handled = 0;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool isBenchEvent(const UeventEnv& env, const char* scenario) {
+    auto it = env.find("BENCH");
+    return it != env.end() && it->second == scenario;
+}
+
+static void handled() {
+    s_latencyNs += nowNs() - s_sentNs;
+    s_handled++;
+    s_handled.notify_one();
+}
+
+static std::string message(const char* scenario) {
+    return std::string("change@/devices/virtual/misc/usb_accessory") + '\0'
+        + "ACTION=change" + '\0' + "DEVPATH=/devices/virtual/misc/usb_accessory" + '\0' + "SUBSYSTEM=misc" + '\0'
+        + "ACCESSORY=START" + '\0' + "MAJOR=10" + '\0' + "MINOR=60" + '\0' + "DEVNAME=usb_accessory" + '\0'
+        + "BENCH=" + scenario;
+}
+
+/**
+ * Send the scenario's message until at least 200 ms of latency were measured, before each one calling prepare.
+ */
+template <typename Prepare>
+static Bench::Result measure(int fd, const char* scenario, Prepare&& prepare) {
+    std::string msg = message(scenario);
+    s_latencyNs = 0;
+
+    uint64_t iterations = 0;
+    while (s_latencyNs < std::chrono::nanoseconds(std::chrono::milliseconds(200)).count()) {
+        prepare();
+
+        uint64_t before = s_handled;
+        s_sentNs = nowNs();
+        if (send(fd, msg.data(), msg.size(), 0) < 0) {
+            perror("send");
+            break;
+        }
+        s_handled.wait(before);
+        iterations++;
+    }
+
+    return {iterations, std::chrono::nanoseconds(s_latencyNs.load())};
+}
+
+int main() {
+    // The logger also copies every line to stderr, keep the output to the results.
+    freopen("/dev/null", "w", stderr);
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    std::thread([]() { EventLoop::instance().run(); }).detach();
+    if (!UeventMonitor::instance().start(std::make_unique<SocketUeventSource>(fds[1]))) {
+        return 1;
+    }
+
+    // Interested in other devices, so each looks the event up and passes.
+    for (int i = 0; i < PERSISTENT_HANDLERS; i++) {
+        std::string devname = "device" + std::to_string(i);
+        UeventMonitor::instance().addHandler([devname](const UeventEnv& env) {
+            auto it = env.find("DEVNAME");
+            Bench::keep(it != env.end() && it->second == devname);
+            return false;
+        });
+    }
+    UeventMonitor::instance().addHandler([](const UeventEnv& env) {
+        if (isBenchEvent(env, "persistent") || isBenchEvent(env, "concurrent_registration")) {
+            handled();
+        }
+        return false;
+    });
+
+    Bench::report("uevent/dispatch/persistent", measure(fds[0], "persistent", []() {}));
+
+    // A matcher registered right before its event, as waitFor does, and removed once it fired.
+    Bench::report("uevent/dispatch/one_shot", measure(fds[0], "one_shot", []() {
+        UeventMonitor::instance().addHandler([](const UeventEnv& env) {
+            if (!isBenchEvent(env, "one_shot")) {
+                return false;
+            }
+            handled();
+            return true;
+        });
+    }));
+
+    // With another thread registering and removing handlers all the time
+    std::atomic<bool> stop = false;
+    std::thread registering([&stop]() {
+        while (!stop) {
+            UeventMonitor::HandlerId id = UeventMonitor::instance().addHandler([](const UeventEnv&) { return false; });
+            UeventMonitor::instance().removeHandler(id);
+        }
+    });
+    Bench::report("uevent/dispatch/concurrent_registration", measure(fds[0], "concurrent_registration", []() {}));
+    stop = true;
+    registering.join();
+
+    close(fds[0]);
+    return 0;
+}
@@ -0,0 +1,609 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <optional>
+
+#include "bluezMock.h"
+
+static constexpr const char* BLUEZ_BUS_NAME = "org.bluez";
+static constexpr const char* BLUEZ_OBJECT_PATH = "/org/bluez";
+static constexpr const char* ADAPTER_OBJECT_PATH = "/org/bluez/hci0";
+
+static constexpr const char* INTERFACE_OBJECT_MANAGER = "org.freedesktop.DBus.ObjectManager";
+static constexpr const char* INTERFACE_PROPERTIES = "org.freedesktop.DBus.Properties";
+static constexpr const char* INTERFACE_BLUEZ_PROFILE_MANAGER = "org.bluez.ProfileManager1";
+static constexpr const char* INTERFACE_BLUEZ_PROFILE = "org.bluez.Profile1";
+static constexpr const char* INTERFACE_BLUEZ_ADAPTER = "org.bluez.Adapter1";
+static constexpr const char* INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER = "org.bluez.LEAdvertisingManager1";
+static constexpr const char* INTERFACE_BLUEZ_LE_ADVERTISEMENT = "org.bluez.LEAdvertisement1";
+static constexpr const char* INTERFACE_BLUEZ_DEVICE = "org.bluez.Device1";
+
+static constexpr const char* AAWG_PROFILE_UUID = "4de17a00-52cb-11e6-bdf4-0800200c9a66";
+
+// Messages of the handshake, see AAWirelessLauncher
+static constexpr uint16_t WIFI_START_REQUEST = 1;
+static constexpr uint16_t WIFI_INFO_REQUEST = 2;
+static constexpr uint16_t WIFI_INFO_RESPONSE = 3;
+static constexpr uint16_t WIFI_CONNECT_STATUS = 6;
+static constexpr uint16_t WIFI_START_RESPONSE = 7;
+
+static constexpr int HANDSHAKE_TIMEOUT_MS = 5000;
+// A scanning phone gives up if nothing is advertised for this long
+static constexpr std::chrono::seconds DISCOVERY_TIMEOUT(10);
+
+#pragma region PrivateBus
+PrivateBus::PrivateBus() {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return;
+    }
+
+    m_pid = fork();
+    if (m_pid == 0) {
+        // The address is printed to the pipe, the only descriptor kept open over exec.
+        int addressFd = dup(fds[1]);
+        std::string printAddress = "--print-address=" + std::to_string(addressFd);
+        execlp("dbus-daemon", "dbus-daemon", "--session", "--nofork", "--nopidfile", printAddress.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    // One line, or nothing if the daemon did not start
+    char buffer[256];
+    size_t length = 0;
+    ssize_t len;
+    while (length < sizeof(buffer) && (len = read(fds[0], buffer + length, sizeof(buffer) - length)) > 0) {
+        length += len;
+        if (memchr(buffer, '\n', length)) {
+            break;
+        }
+    }
+    close(fds[0]);
+
+    m_address = std::string(buffer, std::find(buffer, buffer + length, '\n'));
+    if (m_address.empty()) {
+        fprintf(stderr, "dbus-daemon did not start\n");
+    }
+}
+
+PrivateBus::~PrivateBus() {
+    if (m_pid > 0) {
+        kill(m_pid, SIGTERM);
+        waitpid(m_pid, nullptr, 0);
+    }
+}
+#pragma endregion PrivateBus
+
+#pragma region Objects
+class BluezMock::Root: public DBus::Object {
+public:
+    Root(BluezMock& mock): DBus::Object("/"), m_mock(mock) {
+        this->create_method<DBus::ManagedObjects(void)>(INTERFACE_OBJECT_MANAGER, "GetManagedObjects", sigc::mem_fun(*this, &Root::GetManagedObjects));
+
+        interfacesAdded = this->create_signal<void(DBus::Path, DBus::Interfaces)>(INTERFACE_OBJECT_MANAGER, "InterfacesAdded");
+        interfacesRemoved = this->create_signal<void(DBus::Path, std::vector<std::string>)>(INTERFACE_OBJECT_MANAGER, "InterfacesRemoved");
+    }
+
+    std::shared_ptr<DBus::Signal<void(DBus::Path, DBus::Interfaces)>> interfacesAdded;
+    std::shared_ptr<DBus::Signal<void(DBus::Path, std::vector<std::string>)>> interfacesRemoved;
+
+private:
+    DBus::ManagedObjects GetManagedObjects();
+
+    BluezMock& m_mock;
+};
+
+class BluezMock::ProfileManager: public DBus::Object {
+public:
+    ProfileManager(BluezMock& mock): DBus::Object(BLUEZ_OBJECT_PATH), m_mock(mock) {
+        this->create_method<void(DBus::Path, std::string, DBus::Properties)>(INTERFACE_BLUEZ_PROFILE_MANAGER, "RegisterProfile", sigc::mem_fun(*this, &ProfileManager::RegisterProfile));
+    }
+
+private:
+    void RegisterProfile(DBus::Path path, std::string uuid, DBus::Properties options) {
+        std::lock_guard<std::mutex> lock(m_mock.m_mutex);
+        m_mock.m_counters.registeredProfiles++;
+
+        // The caller is not known here, it is looked up once the phone connects.
+        if (uuid == AAWG_PROFILE_UUID) {
+            m_mock.m_profilePath = path;
+            m_mock.m_profileOwner.clear();
+        }
+    }
+
+    BluezMock& m_mock;
+};
+
+class BluezMock::Adapter: public DBus::Object {
+public:
+    Adapter(BluezMock& mock): DBus::Object(ADAPTER_OBJECT_PATH), m_mock(mock) {
+        alias = this->create_property<std::string>(INTERFACE_BLUEZ_ADAPTER, "Alias");
+        powered = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Powered");
+        discoverable = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Discoverable");
+        pairable = this->create_property<bool>(INTERFACE_BLUEZ_ADAPTER, "Pairable");
+
+        alias->set_value("mock");
+        powered->set_value(false);
+        discoverable->set_value(false);
+        pairable->set_value(false);
+
+        this->create_method<void(DBus::Path, DBus::Properties)>(INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER, "RegisterAdvertisement", sigc::mem_fun(*this, &Adapter::RegisterAdvertisement));
+        this->create_method<void(DBus::Path)>(INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER, "UnregisterAdvertisement", sigc::mem_fun(*this, &Adapter::UnregisterAdvertisement));
+    }
+
+    DBus::Interfaces interfaces() {
+        return {
+            {INTERFACE_BLUEZ_ADAPTER, {
+                {"Alias", DBus::Variant(alias->value())},
+                {"Powered", DBus::Variant(powered->value())},
+                {"Discoverable", DBus::Variant(discoverable->value())},
+                {"Pairable", DBus::Variant(pairable->value())},
+            }},
+            {INTERFACE_BLUEZ_LE_ADVERTISING_MANAGER, {}},
+        };
+    }
+
+    std::shared_ptr<DBus::Property<std::string>> alias;
+    std::shared_ptr<DBus::Property<bool>> powered;
+    std::shared_ptr<DBus::Property<bool>> discoverable;
+    std::shared_ptr<DBus::Property<bool>> pairable;
+
+    void reset() {
+        powered->set_value(false);
+        discoverable->set_value(false);
+        pairable->set_value(false);
+
+        std::lock_guard<std::mutex> lock(m_mock.m_mutex);
+        for (const auto& [path, phase]: m_advertisements) {
+            m_mock.m_advertisementPhases[phase].unregistered = std::chrono::steady_clock::now();
+        }
+        m_advertisements.clear();
+    }
+
+private:
+    // Like bluetoothd, an advertisement can only be registered once, and its parameters are read from the
+    // caller's object before the reply.
+    void RegisterAdvertisement(DBus::Path path, DBus::Properties options) {
+        {
+            std::lock_guard<std::mutex> lock(m_mock.m_mutex);
+            if (findAdvertisement(path) != m_advertisements.end()) {
+                throw DBus::Error("org.bluez.Error.AlreadyExists", "Already Exists");
+            }
+        }
+
+        AdvertisementPhase phase;
+        try {
+            std::shared_ptr<DBus::ObjectProxy> advertisement = m_mock.m_clientConnection->create_object_proxy(m_mock.clientName(), path);
+            DBus::MethodProxy getAll = *(advertisement->create_method<DBus::Properties(std::string)>(INTERFACE_PROPERTIES, "GetAll"));
+            DBus::Properties properties = getAll(INTERFACE_BLUEZ_LE_ADVERTISEMENT);
+
+            if (auto it = properties.find("MinInterval"); it != properties.end()) {
+                phase.minInterval = it->second.to_type<uint32_t>();
+            }
+            if (auto it = properties.find("MaxInterval"); it != properties.end()) {
+                phase.maxInterval = it->second.to_type<uint32_t>();
+            }
+            if (auto it = properties.find("Duration"); it != properties.end()) {
+                phase.duration = it->second.to_type<uint16_t>();
+            }
+        } catch (DBus::Error& e) {
+            throw DBus::Error("org.bluez.Error.Failed", std::string("Failed to parse advertisement: ") + e.what());
+        }
+        phase.registered = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lock(m_mock.m_mutex);
+        m_advertisements.emplace_back(path, m_mock.m_advertisementPhases.size());
+        m_mock.m_advertisementPhases.push_back(phase);
+        m_mock.m_counters.registeredAdvertisements++;
+    }
+
+    void UnregisterAdvertisement(DBus::Path path) {
+        std::lock_guard<std::mutex> lock(m_mock.m_mutex);
+        auto it = findAdvertisement(path);
+        if (it == m_advertisements.end()) {
+            throw DBus::Error("org.bluez.Error.DoesNotExist", "Does Not Exist");
+        }
+
+        m_mock.m_advertisementPhases[it->second].unregistered = std::chrono::steady_clock::now();
+        m_advertisements.erase(it);
+    }
+
+    // Guarded by the mock's mutex
+    std::vector<std::pair<DBus::Path, size_t>>::iterator findAdvertisement(const DBus::Path& path) {
+        return std::find_if(m_advertisements.begin(), m_advertisements.end(), [&path](const auto& advertisement) {
+            return advertisement.first == path;
+        });
+    }
+
+    BluezMock& m_mock;
+    // Registered advertisements, with their index in the mock's phases
+    std::vector<std::pair<DBus::Path, size_t>> m_advertisements;
+};
+
+class BluezMock::Device: public DBus::Object {
+public:
+    Device(BluezMock& mock, DBus::Path path, DeviceBehaviour behaviour):
+        DBus::Object(path), behaviour(behaviour), failuresLeft(behaviour.failures), m_mock(mock) {
+        address = this->create_property<std::string>(INTERFACE_BLUEZ_DEVICE, "Address", DBus::PropertyAccess::ReadOnly);
+        adapter = this->create_property<DBus::Path>(INTERFACE_BLUEZ_DEVICE, "Adapter", DBus::PropertyAccess::ReadOnly);
+        connected = this->create_property<bool>(INTERFACE_BLUEZ_DEVICE, "Connected", DBus::PropertyAccess::ReadOnly);
+
+        address->set_value(behaviour.address);
+        adapter->set_value(DBus::Path(ADAPTER_OBJECT_PATH));
+        connected->set_value(behaviour.connected);
+
+        this->create_method<void(std::string)>(INTERFACE_BLUEZ_DEVICE, "ConnectProfile", sigc::mem_fun(*this, &Device::ConnectProfile));
+        this->create_method<void(void)>(INTERFACE_BLUEZ_DEVICE, "Disconnect", sigc::mem_fun(*this, &Device::Disconnect));
+    }
+
+    DBus::Interfaces interfaces() {
+        return {
+            {INTERFACE_BLUEZ_DEVICE, {
+                {"Address", DBus::Variant(address->value())},
+                {"Adapter", DBus::Variant(adapter->value())},
+                {"Connected", DBus::Variant(connected->value())},
+            }},
+        };
+    }
+
+    const DeviceBehaviour behaviour;
+    // Guarded by the mock's mutex
+    int failuresLeft;
+
+    std::shared_ptr<DBus::Property<std::string>> address;
+    std::shared_ptr<DBus::Property<DBus::Path>> adapter;
+    std::shared_ptr<DBus::Property<bool>> connected;
+
+private:
+    void ConnectProfile(std::string uuid) {
+        m_mock.connectProfile(*this, uuid);
+    }
+
+    void Disconnect() {
+        m_mock.disconnect(*this);
+    }
+
+    BluezMock& m_mock;
+};
+
+DBus::ManagedObjects BluezMock::Root::GetManagedObjects() {
+    DBus::ManagedObjects objects;
+    objects[ADAPTER_OBJECT_PATH] = m_mock.m_adapter->interfaces();
+
+    std::lock_guard<std::mutex> lock(m_mock.m_mutex);
+    for (const std::shared_ptr<Device>& device: m_mock.m_devices) {
+        objects[device->path()] = device->interfaces();
+    }
+
+    return objects;
+}
+#pragma endregion Objects
+
+#pragma region BluezMock
+BluezMock::BluezMock(std::string busAddress, std::function<void()> phoneConnected):
+    m_busAddress(busAddress), m_phoneConnected(phoneConnected) {}
+
+BluezMock::~BluezMock() {
+    disconnectAll();
+}
+
+bool BluezMock::start() {
+    m_dispatcher = DBus::StandaloneDispatcher::create();
+    m_connection = m_dispatcher->create_connection(m_busAddress);
+    if (!m_connection) {
+        fprintf(stderr, "Cannot connect to %s\n", m_busAddress.c_str());
+        return false;
+    }
+
+    m_clientDispatcher = DBus::StandaloneDispatcher::create();
+    m_clientConnection = m_clientDispatcher->create_connection(m_busAddress);
+    if (!m_clientConnection) {
+        fprintf(stderr, "Cannot connect to %s\n", m_busAddress.c_str());
+        return false;
+    }
+
+    m_root = std::make_shared<Root>(*this);
+    m_profileManager = std::make_shared<ProfileManager>(*this);
+    m_adapter = std::make_shared<Adapter>(*this);
+
+    for (std::shared_ptr<DBus::Object> object: std::initializer_list<std::shared_ptr<DBus::Object>>{m_root, m_profileManager, m_adapter}) {
+        if (m_connection->register_object(object, DBus::ThreadForCalling::DispatcherThread) != DBus::RegistrationStatus::Success) {
+            fprintf(stderr, "Cannot register %s\n", object->path().c_str());
+            return false;
+        }
+    }
+
+    if (m_connection->request_name(BLUEZ_BUS_NAME, DBUSCXX_NAME_FLAG_DO_NOT_QUEUE) != DBus::RequestNameResponse::PrimaryOwner) {
+        fprintf(stderr, "Cannot own %s\n", BLUEZ_BUS_NAME);
+        return false;
+    }
+
+    return true;
+}
+
+void BluezMock::setDevices(std::vector<DeviceBehaviour> devices) {
+    std::vector<std::shared_ptr<Device>> removed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        removed.swap(m_devices);
+    }
+
+    for (const std::shared_ptr<Device>& device: removed) {
+        m_connection->unregister_object(device->path());
+        m_root->interfacesRemoved->emit(device->path(), {INTERFACE_BLUEZ_DEVICE});
+    }
+
+    for (const DeviceBehaviour& behaviour: devices) {
+        std::string path = std::string(ADAPTER_OBJECT_PATH) + "/dev_" + behaviour.address;
+        std::replace(path.begin(), path.end(), ':', '_');
+
+        std::shared_ptr<Device> device = std::make_shared<Device>(*this, path, behaviour);
+        m_connection->register_object(device, DBus::ThreadForCalling::DispatcherThread);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_devices.push_back(device);
+        }
+        m_root->interfacesAdded->emit(device->path(), device->interfaces());
+    }
+}
+
+void BluezMock::disconnectAll() {
+    std::vector<std::shared_ptr<Device>> devices;
+    std::vector<std::thread> phones;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        devices = m_devices;
+        phones.swap(m_phones);
+    }
+
+    // The sessions end on their own after the handshake
+    for (std::thread& phone: phones) {
+        phone.join();
+    }
+
+    for (const std::shared_ptr<Device>& device: devices) {
+        device->connected->set_value(false);
+    }
+}
+
+void BluezMock::restart() {
+    m_connection->release_name(BLUEZ_BUS_NAME);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_profilePath.clear();
+        m_profileOwner.clear();
+    }
+    m_adapter->reset();
+
+    m_connection->request_name(BLUEZ_BUS_NAME, DBUSCXX_NAME_FLAG_DO_NOT_QUEUE);
+}
+
+bool BluezMock::recovered() {
+    bool powered = m_adapter->powered->value();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_profilePath.empty() && powered;
+}
+
+BluezMock::Counters BluezMock::counters() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counters;
+}
+
+std::vector<BluezMock::AdvertisementPhase> BluezMock::advertisements() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_advertisementPhases;
+}
+
+void BluezMock::discoverAfter(std::chrono::milliseconds delay) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_phones.emplace_back(&BluezMock::discover, this, delay);
+}
+
+std::string BluezMock::clientName() {
+    std::shared_ptr<DBus::ObjectProxy> bus = m_clientConnection->create_object_proxy("org.freedesktop.DBus", "/org/freedesktop/DBus");
+    DBus::MethodProxy listNames = *(bus->create_method<std::vector<std::string>(void)>("org.freedesktop.DBus", "ListNames"));
+    for (const std::string& name: listNames()) {
+        if (name[0] == ':' && name != m_connection->unique_name() && name != m_clientConnection->unique_name()) {
+            return name;
+        }
+    }
+
+    return "";
+}
+
+void BluezMock::connectProfile(Device& device, std::string uuid) {
+    std::this_thread::sleep_for(device.behaviour.connectDelay);
+
+    bool fail = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_counters.connectCalls++;
+
+        if (device.failuresLeft != 0) {
+            if (device.failuresLeft > 0) {
+                device.failuresLeft--;
+            }
+            m_counters.connectFailures++;
+            fail = true;
+        }
+    }
+
+    if (fail) {
+        throw DBus::Error("org.bluez.Error.Failed", "Page Timeout");
+    }
+
+    device.connected->set_value(true);
+
+    // The phone answers with the AA Wireless profile. The call waits for the handshake, it cannot be made
+    // on the dispatcher thread that has to deliver its reply.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_profilePath.empty()) {
+        m_phones.emplace_back(&BluezMock::playPhone, this, device.path());
+    }
+}
+
+void BluezMock::disconnect(Device& device) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_counters.disconnectCalls++;
+    }
+
+    device.connected->set_value(false);
+}
+#pragma endregion BluezMock
+
+#pragma region Phone
+static bool readFully(int fd, unsigned char* buffer, size_t length) {
+    while (length > 0) {
+        struct pollfd pfd = {
+            .fd = fd,
+            .events = POLLIN,
+        };
+        if (poll(&pfd, 1, HANDSHAKE_TIMEOUT_MS) <= 0) {
+            return false;
+        }
+
+        ssize_t len = read(fd, buffer, length);
+        if (len <= 0) {
+            return false;
+        }
+        buffer += len;
+        length -= len;
+    }
+
+    return true;
+}
+
+// The message id, or 0 if none came
+static uint16_t readMessage(int fd) {
+    unsigned char header[4];
+    if (!readFully(fd, header, sizeof(header))) {
+        return 0;
+    }
+
+    std::vector<unsigned char> payload((header[0] << 8) | header[1]);
+    if (!readFully(fd, payload.data(), payload.size())) {
+        return 0;
+    }
+
+    return (header[2] << 8) | header[3];
+}
+
+// Without payload, the dongle does not look into these.
+static bool writeMessage(int fd, uint16_t messageId) {
+    unsigned char header[4] = {0, 0, (unsigned char)(messageId >> 8), (unsigned char)(messageId & 0xFF)};
+    return write(fd, header, sizeof(header)) == sizeof(header);
+}
+
+void BluezMock::playPhone(DBus::Path devicePath) {
+    DBus::Path profilePath;
+    std::string owner;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        profilePath = m_profilePath;
+        owner = m_profileOwner;
+    }
+
+    if (owner.empty()) {
+        owner = clientName();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_profileOwner = owner;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        fprintf(stderr, "socketpair failed: %s\n", strerror(errno));
+        return;
+    }
+
+    std::thread call([this, owner, profilePath, devicePath, fd = fds[1]]() {
+        try {
+            std::shared_ptr<DBus::ObjectProxy> profile = m_connection->create_object_proxy(owner, profilePath);
+            DBus::MethodProxy newConnection = *(profile->create_method<void(DBus::Path, std::shared_ptr<DBus::FileDescriptor>, DBus::Properties)>(INTERFACE_BLUEZ_PROFILE, "NewConnection"));
+            newConnection(devicePath, DBus::FileDescriptor::create(fd), {});
+        } catch (DBus::Error& e) {
+            fprintf(stderr, "NewConnection failed: %s\n", e.what());
+        }
+    });
+
+    // The bus passes the daemon a duplicate, this end is only kept for the call.
+    bool ok = handshake(fds[0]);
+    call.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    if (!ok) {
+        fprintf(stderr, "Handshake with %s failed\n", devicePath.c_str());
+    }
+}
+
+bool BluezMock::handshake(int fd) {
+    if (readMessage(fd) != WIFI_START_REQUEST || !writeMessage(fd, WIFI_INFO_REQUEST)) {
+        return false;
+    }
+
+    if (readMessage(fd) != WIFI_INFO_RESPONSE) {
+        return false;
+    }
+
+    // The phone has what it needs to join the access point.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_counters.handshakes++;
+    }
+    m_phoneConnected();
+
+    return writeMessage(fd, WIFI_START_RESPONSE) && writeMessage(fd, WIFI_CONNECT_STATUS);
+}
+void BluezMock::discover(std::chrono::milliseconds delay) {
+    std::this_thread::sleep_for(delay);
+
+    // The advertisement registered last, once there is one
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + DISCOVERY_TIMEOUT;
+    std::optional<AdvertisementPhase> phase;
+    while (!phase) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = std::find_if(m_advertisementPhases.rbegin(), m_advertisementPhases.rend(), [](const AdvertisementPhase& phase) {
+                return phase.unregistered == std::chrono::steady_clock::time_point();
+            });
+            if (it != m_advertisementPhases.rend()) {
+                phase = *it;
+                break;
+            }
+        }
+
+        if (std::chrono::steady_clock::now() > deadline) {
+            fprintf(stderr, "Nothing advertised within %lld s\n", (long long)DISCOVERY_TIMEOUT.count());
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Scanning all the time, the phone sees the next advertising event.
+    std::this_thread::sleep_for(std::chrono::milliseconds(phase->maxInterval));
+
+    std::shared_ptr<Device> device;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_devices.empty() || m_profilePath.empty()) {
+            fprintf(stderr, "No device or profile to connect\n");
+            return;
+        }
+        device = m_devices.front();
+    }
+
+    device->connected->set_value(true);
+    playPhone(device->path());
+}
+#pragma endregion Phone
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <sys/types.h>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bluetoothCommon.h"
+
+/**
+ * A dbus-daemon of its own, so the mock can own org.bluez without touching the system bus.
+ */
+class PrivateBus {
+public:
+    PrivateBus();
+    ~PrivateBus();
+
+    // Empty if the daemon did not start
+    std::string address() const { return m_address; }
+
+private:
+    pid_t m_pid = -1;
+    std::string m_address;
+};
+
+/**
+ * Stands in for bluetoothd: one adapter with the devices of a scenario, behind the interfaces aawgd uses.
+ *
+ *   /                  org.freedesktop.DBus.ObjectManager
+ *   /org/bluez         org.bluez.ProfileManager1
+ *   /org/bluez/hci0    org.bluez.Adapter1, org.bluez.LEAdvertisingManager1
+ *   .../dev_XX_..      org.bluez.Device1
+ *
+ * Once a device connects, the phone connects the AA Wireless profile back: the mock hands the profile one end
+ * of a socketpair with NewConnection, and plays the phone's side of the RFCOMM handshake on the other.
+ * The phone can also find the dongle on its own, by a scripted scan of its LE advertisement.
+ *
+ * Methods are handled on the mock's dispatcher thread, one at a time like bluetoothd's main loop.
+ */
+class BluezMock {
+public:
+    struct DeviceBehaviour {
+        std::string address;
+        bool connected = false;
+        // ConnectProfile takes this long, like paging the phone
+        std::chrono::milliseconds connectDelay{0};
+        // ConnectProfile fails this many times before it succeeds, -1 for always
+        int failures = 0;
+    };
+
+    // An LE advertisement as registered, with the parameters read from it like bluetoothd does
+    struct AdvertisementPhase {
+        std::chrono::steady_clock::time_point registered;
+        // Still registered while unset
+        std::chrono::steady_clock::time_point unregistered;
+        uint32_t minInterval = 0;   // ms
+        uint32_t maxInterval = 0;   // ms
+        uint16_t duration = 0;      // s
+    };
+
+    struct Counters {
+        int connectCalls = 0;
+        int connectFailures = 0;
+        int disconnectCalls = 0;
+        int registeredProfiles = 0;
+        int registeredAdvertisements = 0;
+        int handshakes = 0;
+    };
+
+    // phoneConnected runs on a thread of the mock once a handshake got the wifi details.
+    BluezMock(std::string busAddress, std::function<void()> phoneConnected);
+    ~BluezMock();
+
+    // Owns org.bluez, false if it could not
+    bool start();
+
+    // Replace the devices, signalling the removed and added ones
+    void setDevices(std::vector<DeviceBehaviour> devices);
+    // Drop the connections, like the phone walking away
+    void disconnectAll();
+    // Like bluetoothd restarting: org.bluez changes owner, the profiles, the advertisements and the adapter
+    // settings are forgotten, and nothing is signalled for the objects.
+    void restart();
+    // The profile was registered again, and the adapter powered
+    bool recovered();
+
+    Counters counters();
+    // Every advertisement registered since the mock started, oldest first
+    std::vector<AdvertisementPhase> advertisements();
+
+    // The phone starts scanning after delay, sees the advertisement at its next advertising event, a MaxInterval
+    // later at most, and connects the AA Wireless profile of the first device. Returns right away, the phone
+    // waits for an advertisement if there is none yet.
+    void discoverAfter(std::chrono::milliseconds delay);
+
+private:
+    class Root;
+    class ProfileManager;
+    class Adapter;
+    class Device;
+
+    void connectProfile(Device& device, std::string uuid);
+    void disconnect(Device& device);
+    // The phone side of a session, on a thread of its own
+    void playPhone(DBus::Path devicePath);
+    bool handshake(int fd);
+    // Unique name of the daemon under test, the one other client of the private bus
+    std::string clientName();
+    void discover(std::chrono::milliseconds delay);
+
+    std::string m_busAddress;
+    std::function<void()> m_phoneConnected;
+
+    std::shared_ptr<DBus::Dispatcher> m_dispatcher;
+    std::shared_ptr<DBus::Connection> m_connection;
+    // For the calls made while handling a method, whose replies the mock's dispatcher thread cannot deliver
+    std::shared_ptr<DBus::Dispatcher> m_clientDispatcher;
+    std::shared_ptr<DBus::Connection> m_clientConnection;
+
+    std::shared_ptr<Root> m_root;
+    std::shared_ptr<ProfileManager> m_profileManager;
+    std::shared_ptr<Adapter> m_adapter;
+
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<Device>> m_devices;
+    // The AA Wireless profile, as registered
+    DBus::Path m_profilePath;
+    std::string m_profileOwner;
+    Counters m_counters;
+    std::vector<AdvertisementPhase> m_advertisementPhases;
+    std::vector<std::thread> m_phones;
+};
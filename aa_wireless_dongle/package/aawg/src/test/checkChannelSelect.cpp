@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "wifiChannel.h"
+
+/*
+ * Scores the channels of iw output recorded in the wifi directory, which the check runs next to:
+ *   apartment    brcmfmac with the EU domain, crowded 2.4 GHz, some 5 GHz networks, no survey support
+ *   car_2ghz     2.4 GHz only radio with survey data, one busy channel
+ *   no_usable    no channel where an access point may be started
+ */
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    }
+
+static const WifiChannel::Score* find(const std::vector<WifiChannel::Score>& scores, int number) {
+    for (const WifiChannel::Score& score: scores) {
+        if (score.channel.number == number) {
+            return &score;
+        }
+    }
+    return nullptr;
+}
+
+static std::vector<WifiChannel::Score> score(RecordedScanSource& source) {
+    return WifiChannel::scoreChannels(source.channels(), source.survey(), source.scan());
+}
+
+static bool checkApartment() {
+    RecordedScanSource source("wifi/apartment");
+
+    std::vector<WifiChannel::Channel> channels = source.channels();
+    CHECK(channels.size() == 14 + 26);
+    CHECK(source.survey().empty());
+    CHECK(source.scan().size() == 11);
+
+    std::vector<WifiChannel::Score> scores = score(source);
+    // 1-13 and the four 5 GHz channels without radar detection
+    CHECK(scores.size() == 13 + 4);
+    CHECK(!find(scores, 14));
+    CHECK(!find(scores, 52));
+
+    // The free 5 GHz channels, in the order the radio lists them
+    CHECK(scores[0].channel.number == 40);
+    CHECK(scores[1].channel.number == 48);
+    CHECK(scores[0].bssCount == 0);
+    CHECK(find(scores, 36)->bssCount == 2);
+    CHECK(find(scores, 44)->score > scores[1].score);
+
+    // Any 5 GHz channel beats the crowded 2.4 GHz band
+    for (const WifiChannel::Score& score: scores) {
+        if (!WifiChannel::is5GHz(score.channel.frequency)) {
+            CHECK(score.score > find(scores, 36)->score);
+        }
+    }
+
+    return true;
+}
+
+static bool checkCar2Ghz() {
+    RecordedScanSource source("wifi/car_2ghz");
+
+    std::vector<WifiChannel::Survey> surveys = source.survey();
+    CHECK(surveys.size() == 11);
+    CHECK(surveys[0].frequency == 2412);
+    CHECK(surveys[0].noise == -92);
+    // Not overwritten by the "extension channel busy time" line
+    CHECK(surveys[0].activeTime == 1000);
+    CHECK(surveys[0].busyTime == 600);
+
+    std::vector<WifiChannel::Score> scores = score(source);
+    CHECK(scores.size() == 11);
+    CHECK(scores[0].channel.number == 11);
+    CHECK(fabs(find(scores, 1)->busyFraction - 0.6) < 1e-9);
+    // The strongest network is on 6, and channel 1 is busy most of the time
+    CHECK(find(scores, 6)->score > scores[0].score);
+    CHECK(find(scores, 1)->score > find(scores, 10)->score);
+
+    return true;
+}
+
+static bool checkNoUsable() {
+    RecordedScanSource source("wifi/no_usable");
+
+    CHECK(!source.channels().empty());
+    CHECK(score(source).empty());
+
+    return true;
+}
+
+static bool checkChannelOption() {
+    CHECK(WifiChannel::parseChannelNumber("6") == 6);
+    CHECK(WifiChannel::parseChannelNumber("149") == 149);
+    CHECK(!WifiChannel::parseChannelNumber(""));
+    CHECK(!WifiChannel::parseChannelNumber("abc"));
+    CHECK(!WifiChannel::parseChannelNumber("6abc"));
+    CHECK(!WifiChannel::parseChannelNumber("0"));
+    CHECK(!WifiChannel::parseChannelNumber("-1"));
+    CHECK(!WifiChannel::parseChannelNumber("99999999999"));
+
+    std::vector<WifiChannel::Channel> channels = RecordedScanSource("wifi/apartment").channels();
+    CHECK(WifiChannel::isAllowed(13, channels));
+    CHECK(WifiChannel::isAllowed(36, channels));
+    CHECK(!WifiChannel::isAllowed(14, channels));
+    CHECK(!WifiChannel::isAllowed(52, channels));
+    CHECK(!WifiChannel::isAllowed(149, channels));
+
+    // Without channels from the radio, only the channel numbers themselves can be checked
+    CHECK(WifiChannel::isAllowed(6, {}));
+    CHECK(WifiChannel::isAllowed(52, {}));
+    CHECK(WifiChannel::isAllowed(165, {}));
+    CHECK(!WifiChannel::isAllowed(15, {}));
+    CHECK(!WifiChannel::isAllowed(38, {}));
+
+    return true;
+}
+
+int main(void) {
+    bool ok = checkApartment();
+    ok = checkCar2Ghz() && ok;
+    ok = checkNoUsable() && ok;
+    ok = checkChannelOption() && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "eventLoop.h"
+
+/*
+ * Drives the awaitables the control plane is built from on the event loop, which runs on a thread of its own
+ * for the whole check. Each case is a coroutine reporting its result through a promise.
+ */
+
+// Fail a case from within its coroutine
+#define CHECK_ASYNC(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        result.set_value(false); \
+        co_return; \
+    }
+
+static constexpr std::chrono::seconds CASE_TIMEOUT(5);
+
+static int threadCount() {
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.compare(0, 8, "Threads:") == 0) {
+            return std::stoi(line.substr(8));
+        }
+    }
+    return -1;
+}
+
+// Run a case on the loop and wait for its result
+template <typename Case>
+static bool runCase(const char* name, Case coroutine) {
+    std::promise<bool> result;
+    std::future<bool> future = result.get_future();
+
+    EventLoop::instance().spawn([&coroutine, &result]() { return coroutine(result); });
+
+    if (future.wait_for(CASE_TIMEOUT) != std::future_status::ready) {
+        fprintf(stderr, "%s: did not complete\n", name);
+        return false;
+    }
+    return future.get();
+}
+
+static EventLoop::Async<int> square(int value) {
+    co_await EventLoop::instance().sleepFor(std::chrono::milliseconds(1));
+    co_return value * value;
+}
+
+static EventLoop::Async<void> fail() {
+    co_await EventLoop::instance().sleepFor(std::chrono::milliseconds(1));
+    throw std::runtime_error("failed");
+}
+
+static EventLoop::Task checkAsync(std::promise<bool>& result) {
+    int sum = 0;
+    for (int i = 1; i <= 3; i++) {
+        sum += co_await square(i);
+    }
+    CHECK_ASYNC(sum == 14);
+
+    bool thrown = false;
+    try {
+        co_await fail();
+    } catch (std::runtime_error& e) {
+        thrown = true;
+    }
+    CHECK_ASYNC(thrown);
+
+    result.set_value(true);
+}
+
+static EventLoop::Task checkSignal(std::promise<bool>& result) {
+    EventLoop::Signal signal;
+
+    // From another thread, while waiting
+    std::thread notifier([signal]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        signal.notify();
+    });
+    bool notified = co_await signal.wait(std::chrono::milliseconds(2000));
+    notifier.join();
+    CHECK_ASYNC(notified);
+
+    // Nobody notifies
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CHECK_ASYNC(!co_await signal.wait(std::chrono::milliseconds(20)));
+    CHECK_ASYNC(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+    // Before anybody waits, kept for the next wait
+    signal.notify();
+    co_await EventLoop::instance().sleepFor(std::chrono::milliseconds(1));
+    CHECK_ASYNC(co_await signal.wait(std::chrono::milliseconds(20)));
+    CHECK_ASYNC(!co_await signal.wait(std::chrono::milliseconds(1)));
+
+    result.set_value(true);
+}
+
+static EventLoop::Task checkBlocking(std::promise<bool>& result) {
+    std::thread::id loopThread = std::this_thread::get_id();
+    int threads = threadCount();
+
+    std::thread::id callThread = co_await EventLoop::instance().blocking([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return std::this_thread::get_id();
+    });
+    CHECK_ASYNC(std::this_thread::get_id() == loopThread);
+    CHECK_ASYNC(callThread != loopThread);
+
+    bool thrown = false;
+    try {
+        co_await EventLoop::instance().blocking([]() { throw std::runtime_error("failed"); });
+    } catch (std::runtime_error& e) {
+        thrown = true;
+    }
+    CHECK_ASYNC(thrown);
+
+    // The threads of the calls end, give them a moment to exit after resuming the loop.
+    for (int i = 0; i < 100; i++) {
+        co_await EventLoop::instance().blocking([]() {});
+    }
+    for (int i = 0; i < 100 && threadCount() > threads; i++) {
+        co_await EventLoop::instance().sleepFor(std::chrono::milliseconds(1));
+    }
+    CHECK_ASYNC(threadCount() == threads);
+
+    result.set_value(true);
+}
+
+struct StaleFdCase {
+    int first[2];
+    int second[2];
+    int reused[2] = {-1, -1};
+    bool secondReadable = true;
+    bool reusedReadable = true;
+    EventLoop::Signal done;
+
+    // Reads the first pipe, then closes the second one and gets its fd number for a new pipe.
+    EventLoop::Task closer() {
+        co_await EventLoop::instance().readable(first[0]);
+
+        close(second[0]);
+        pipe2(reused, O_CLOEXEC);
+
+        // Nothing was written to the new pipe, only the timeout may end this wait.
+        reusedReadable = co_await EventLoop::instance().readable(reused[0], std::chrono::milliseconds(50));
+        done.notify();
+    }
+
+    // Its event is in the same batch as the first pipe's, and must neither wake the new pipe's wait nor get lost.
+    EventLoop::Task waiter() {
+        secondReadable = co_await EventLoop::instance().readable(second[0]);
+    }
+};
+
+static EventLoop::Task checkStaleFd(std::promise<bool>& result) {
+    StaleFdCase staleFd;
+    CHECK_ASYNC(pipe2(staleFd.first, O_CLOEXEC) == 0 && pipe2(staleFd.second, O_CLOEXEC) == 0);
+
+    staleFd.closer();
+    staleFd.waiter();
+
+    // Both ready before the loop waits again, in this order
+    write(staleFd.first[1], "x", 1);
+    write(staleFd.second[1], "x", 1);
+
+    co_await staleFd.done.wait();
+
+    CHECK_ASYNC(staleFd.reused[0] == staleFd.second[0]);
+    CHECK_ASYNC(!staleFd.reusedReadable);
+    CHECK_ASYNC(!staleFd.secondReadable);
+
+    for (int fd: {staleFd.first[0], staleFd.first[1], staleFd.second[1], staleFd.reused[0], staleFd.reused[1]}) {
+        close(fd);
+    }
+
+    result.set_value(true);
+}
+
+int main(void) {
+    std::thread([]() { EventLoop::instance().run(); }).detach();
+
+    bool ok = runCase("async", checkAsync);
+    ok = runCase("signal", checkSignal) && ok;
+    ok = runCase("blocking", checkBlocking) && ok;
+    ok = runCase("stale_fd", checkStaleFd) && ok;
+
+    return ok ? 0 : 1;
+}
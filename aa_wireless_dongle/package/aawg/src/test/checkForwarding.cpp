@@ -0,0 +1,216 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "faultyIo.h"
+#include "frameStream.h"
+#include "aaFrame.h"
+#include "forwarder.h"
+
+/*
+ * Forwards synthetic sessions in both directions at once, while the daemon's side of both fds misbehaves
+ * according to a fault profile. Every byte must come out in order, and the frames must parse back one
+ * after the other, whatever pieces the data went through in. Also prints the throughput of each profile.
+ *
+ * The faults are random, set AAWG_FAULT_SEED to the seed printed by a failed run to replay it.
+ */
+
+struct FaultCase {
+    const char* name;
+    FaultyIo::Profile profile;
+    // Repetitions of the session stream in each direction
+    size_t sessions;
+};
+
+static const FaultCase s_cases[] = {
+    {"clean", {}, 64},
+    {"short_transfers", {.randomChunks = true}, 64},
+    {"split_headers", {.maxChunk = 7, .randomChunks = true}, 4},
+    {"interrupted", {.randomChunks = true, .interruptRate = 0.2, .wouldBlockRate = 0.2}, 32},
+    {"stalled", {.randomChunks = true, .interruptRate = 0.05, .wouldBlockRate = 0.05, .delayRate = 0.02, .maxDelay = std::chrono::microseconds(2000)}, 8},
+};
+
+// Connected TCP sockets over loopback, like the phone's connection
+static bool tcpPair(int fds[2]) {
+    int server = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_len = sizeof(address);
+
+    bool ok = server >= 0 &&
+        bind(server, (struct sockaddr*)&address, sizeof(address)) == 0 &&
+        listen(server, 1) == 0 &&
+        getsockname(server, (struct sockaddr*)&address, &address_len) == 0 &&
+        (fds[1] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) >= 0 &&
+        connect(fds[1], (struct sockaddr*)&address, sizeof(address)) == 0 &&
+        (fds[0] = accept4(server, nullptr, nullptr, SOCK_CLOEXEC)) >= 0;
+
+    if (server >= 0) {
+        close(server);
+    }
+    return ok;
+}
+
+static void writeAll(int fd, const std::vector<unsigned char>& stream, size_t sessions) {
+    for (size_t session = 0; session < sessions; session++) {
+        const unsigned char* data = stream.data();
+        size_t remaining = stream.size();
+        while (remaining > 0) {
+            ssize_t len = write(fd, data, remaining);
+            if (len <= 0) {
+                return;
+            }
+            data += len;
+            remaining -= len;
+        }
+    }
+}
+
+/**
+ * Read what the forwarder delivered and compare it to what was sent.
+ *
+ * @return Error message, empty if all data arrived intact.
+ */
+static std::string readAndVerify(int fd, const std::vector<unsigned char>& stream, size_t frames, size_t sessions) {
+    size_t expected = stream.size() * sessions;
+    size_t received = 0;
+    size_t parsed = 0;
+    AAFrame::StreamTracker tracker;
+    std::vector<unsigned char> buffer(65536);
+
+    while (received < expected) {
+        ssize_t len = read(fd, buffer.data(), std::min(buffer.size(), expected - received));
+        if (len <= 0) {
+            return "stream ended after " + std::to_string(received) + " of " + std::to_string(expected) + " bytes: " + (len < 0 ? strerror(errno) : "EOF");
+        }
+
+        for (ssize_t i = 0; i < len; i++) {
+            if (buffer[i] != stream[(received + i) % stream.size()]) {
+                return "byte " + std::to_string(received + i) + " differs";
+            }
+        }
+
+        tracker.consume(buffer.data(), len, [&parsed](const AAFrame::Header&) {
+            parsed++;
+        });
+        received += len;
+    }
+
+    if (parsed != frames * sessions) {
+        return "parsed " + std::to_string(parsed) + " frames instead of " + std::to_string(frames * sessions);
+    }
+
+    return "";
+}
+
+static bool runCase(const FaultCase& faultCase, const std::vector<unsigned char>& stream, size_t frames) {
+    // [0] is the daemon's end, [1] the phone's and the head unit's.
+    int tcp[2], usb[2];
+    if (!tcpPair(tcp) || socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, usb) < 0) {
+        fprintf(stderr, "%s: creating sockets failed: %s\n", faultCase.name, strerror(errno));
+        return false;
+    }
+
+    // Set up like the daemon does, and make sure a stalled forwarder fails the check instead of hanging it.
+    fcntl(usb[0], F_SETFL, fcntl(usb[0], F_GETFL) | O_NONBLOCK);
+    int nodelay = 1;
+    setsockopt(tcp[0], IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    struct timeval tv = {
+        .tv_sec = 10,
+        .tv_usec = 0,
+    };
+    for (int fd: {tcp[0], tcp[1], usb[1]}) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    FaultyIo::inject(tcp[0], faultCase.profile);
+    FaultyIo::inject(usb[0], faultCase.profile);
+
+    auto start = std::chrono::steady_clock::now();
+
+    Forwarder forwarder(tcp[0], usb[0]);
+    std::thread forwarderThread([&forwarder]() {
+        forwarder.run();
+    });
+
+    std::thread phone(writeAll, tcp[1], std::cref(stream), faultCase.sessions);
+    std::thread headUnit(writeAll, usb[1], std::cref(stream), faultCase.sessions);
+
+    std::string usbError;
+    std::thread usbReader([&]() {
+        usbError = readAndVerify(usb[1], stream, frames, faultCase.sessions);
+    });
+    std::string tcpError = readAndVerify(tcp[1], stream, frames, faultCase.sessions);
+    usbReader.join();
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    forwarder.stop();
+    forwarderThread.join();
+
+    // Unblock the writers if the forwarder gave up early
+    shutdown(tcp[1], SHUT_RDWR);
+    shutdown(usb[1], SHUT_RDWR);
+    phone.join();
+    headUnit.join();
+
+    FaultyIo::clear(tcp[0]);
+    FaultyIo::clear(usb[0]);
+    for (int fd: {tcp[0], tcp[1], usb[0], usb[1]}) {
+        close(fd);
+    }
+
+    bool ok = true;
+    if (!tcpError.empty()) {
+        fprintf(stderr, "%s: USB to TCP: %s\n", faultCase.name, tcpError.c_str());
+        ok = false;
+    }
+    if (!usbError.empty()) {
+        fprintf(stderr, "%s: TCP to USB: %s\n", faultCase.name, usbError.c_str());
+        ok = false;
+    }
+
+    if (ok) {
+        std::string name = std::string("forwarder/") + faultCase.name;
+        Bench::report(name.c_str(), {1, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)}, 2 * stream.size() * faultCase.sessions);
+    }
+
+    return ok;
+}
+
+int main(void) {
+    // Like the daemon, writing to a closed socket must fail instead of killing the check.
+    signal(SIGPIPE, SIG_IGN);
+
+    uint32_t seed = std::random_device()();
+    if (const char* seedEnv = getenv("AAWG_FAULT_SEED")) {
+        seed = strtoul(seedEnv, nullptr, 0);
+    }
+    printf("Fault seed %u\n", seed);
+    FaultyIo::seed(seed);
+
+    size_t frames;
+    std::vector<unsigned char> stream = FrameStream::session(frames);
+
+    bool ok = true;
+    for (const FaultCase& faultCase: s_cases) {
+        ok = runCase(faultCase, stream, frames) && ok;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "FAILED, rerun with AAWG_FAULT_SEED=%u\n", seed);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "frameStream.h"
+#include "aaFrame.h"
+#include "frameBuffer.h"
+#include "proxyIo.h"
+
+/*
+ * Reads frames through a FrameBuffer that gets filled to its last byte, with a partial frame left at the
+ * end. Making room for the rest of that frame moves it to the front, and the read after that must still
+ * get the whole free space.
+ */
+
+#define CHECK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        return false; \
+    }
+
+// The buffer alone, filled by hand
+static bool checkCompaction(const std::vector<unsigned char>& stream) {
+    FrameBuffer frames;
+
+    size_t length = frames.spaceLength();
+    CHECK(length == FrameBuffer::DEFAULT_CAPACITY);
+    CHECK(stream.size() >= length);
+    memcpy(frames.space(), stream.data(), length);
+    frames.commit(length);
+
+    size_t handedOut = 0;
+    const unsigned char* frame;
+    while (size_t frameLength = frames.nextFrame(&frame)) {
+        CHECK(memcmp(frame, stream.data() + handedOut, frameLength) == 0);
+        handedOut += frameLength;
+    }
+    CHECK(handedOut < length);
+
+    // Full, until space() moves the partial frame to the front
+    CHECK(frames.spaceLength() == 0);
+    unsigned char* space = frames.space();
+    CHECK(frames.spaceLength() == FrameBuffer::DEFAULT_CAPACITY - (length - handedOut));
+    CHECK(frames.spaceLength() >= FrameBuffer::MAX_FRAME_LENGTH);
+
+    size_t rest = std::min(frames.spaceLength(), stream.size() - length);
+    memcpy(space, stream.data() + length, rest);
+    frames.commit(rest);
+    CHECK(frames.nextFrame(&frame) > 0);
+    CHECK(memcmp(frame, stream.data() + handedOut, AAFrame::parseHeader(frame).frameLength()) == 0);
+
+    return true;
+}
+
+// Through ProxyIo, with more data waiting than fits, so the first read fills the buffer to capacity
+static bool checkReadFrame(const std::vector<unsigned char>& stream, size_t frames) {
+    int fds[2];
+    CHECK(pipe2(fds, O_CLOEXEC) == 0);
+    CHECK(fcntl(fds[1], F_SETPIPE_SZ, 1024 * 1024) >= (int)(2 * stream.size()));
+    CHECK(write(fds[1], stream.data(), stream.size()) == (ssize_t)stream.size());
+    CHECK(write(fds[1], stream.data(), stream.size()) == (ssize_t)stream.size());
+    close(fds[1]);
+
+    ProxyIo io;
+    FrameBuffer frameBuffer;
+    size_t offset = 0;
+    for (size_t i = 0; i < 2 * frames; i++) {
+        const unsigned char* frame;
+        ssize_t len = io.readFrame(fds[0], frameBuffer, &frame);
+        CHECK(len > 0);
+        CHECK(memcmp(frame, stream.data() + offset % stream.size(), len) == 0);
+        offset += len;
+    }
+
+    const unsigned char* frame;
+    CHECK(io.readFrame(fds[0], frameBuffer, &frame) == 0);
+    close(fds[0]);
+
+    return true;
+}
+
+int main(void) {
+    size_t frames;
+    std::vector<unsigned char> session = FrameStream::session(frames);
+
+    std::vector<unsigned char> stream = session;
+    stream.insert(stream.end(), session.begin(), session.end());
+
+    bool ok = checkCompaction(stream);
+    ok = checkReadFrame(session, frames) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+
+#include "faultyIo.h"
+
+extern "C" {
+    ssize_t __real_read(int fd, void* buffer, size_t length);
+    ssize_t __real_write(int fd, const void* buffer, size_t length);
+    ssize_t __real_send(int fd, const void* buffer, size_t length, int flags);
+}
+
+// Indexed by fd, the profiles are set up before the threads under test start.
+static constexpr int MAX_FDS = 1024;
+static FaultyIo::Profile s_profiles[MAX_FDS];
+
+static std::atomic<uint32_t> s_seed = 1;
+static std::atomic<uint32_t> s_threads = 0;
+
+static std::minstd_rand& generator() {
+    thread_local std::minstd_rand t_generator(s_seed + s_threads++);
+    return t_generator;
+}
+
+static bool chance(double rate) {
+    return rate > 0 && std::uniform_real_distribution<double>(0, 1)(generator()) < rate;
+}
+
+/**
+ * Apply the faults of the fd's profile to a call about to transfer length bytes.
+ *
+ * @return Length to pass on to the real call, or 0 if the call must fail with errno set.
+ */
+static size_t applyFaults(int fd, size_t length) {
+    if (fd < 0 || fd >= MAX_FDS || length == 0) {
+        return length;
+    }
+    const FaultyIo::Profile& profile = s_profiles[fd];
+
+    if (chance(profile.delayRate)) {
+        usleep(std::uniform_int_distribution<long>(0, profile.maxDelay.count())(generator()));
+    }
+
+    if (chance(profile.interruptRate)) {
+        errno = EINTR;
+        return 0;
+    }
+
+    if (profile.wouldBlockRate > 0 && (fcntl(fd, F_GETFL) & O_NONBLOCK) && chance(profile.wouldBlockRate)) {
+        errno = EAGAIN;
+        return 0;
+    }
+
+    size_t limit = profile.maxChunk > 0 ? std::min(length, profile.maxChunk) : length;
+    if (profile.randomChunks) {
+        limit = std::uniform_int_distribution<size_t>(1, limit)(generator());
+    }
+
+    return limit;
+}
+
+void FaultyIo::seed(uint32_t seed) {
+    s_seed = seed;
+}
+
+void FaultyIo::inject(int fd, const Profile& profile) {
+    if (fd >= 0 && fd < MAX_FDS) {
+        s_profiles[fd] = profile;
+    }
+}
+
+void FaultyIo::clear(int fd) {
+    inject(fd, Profile());
+}
+
+extern "C" ssize_t __wrap_read(int fd, void* buffer, size_t length) {
+    size_t limit = applyFaults(fd, length);
+    return limit > 0 || length == 0 ? __real_read(fd, buffer, limit) : -1;
+}
+
+extern "C" ssize_t __wrap_write(int fd, const void* buffer, size_t length) {
+    size_t limit = applyFaults(fd, length);
+    return limit > 0 || length == 0 ? __real_write(fd, buffer, limit) : -1;
+}
+
+extern "C" ssize_t __wrap_send(int fd, const void* buffer, size_t length, int flags) {
+    size_t limit = applyFaults(fd, length);
+    return limit > 0 || length == 0 ? __real_send(fd, buffer, limit, flags) : -1;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Interposer for the read, write and send calls of the daemon code linked into a test, through the
+ * linker's --wrap option. Calls on an fd with a profile behave like a peer that delivers and accepts
+ * data in small pieces, gets interrupted and stalls, other fds are left alone.
+ */
+namespace FaultyIo {
+    struct Profile {
+        // Largest transfer per call, 0 for no limit
+        size_t maxChunk = 0;
+        // Transfer a random length up to the limit instead of the limit
+        bool randomChunks = false;
+        // Chance per call to fail with EINTR without transferring anything
+        double interruptRate = 0;
+        // Chance per call to fail with EAGAIN without transferring anything, only on non blocking fds
+        double wouldBlockRate = 0;
+        // Chance per call to sleep up to maxDelay first
+        double delayRate = 0;
+        std::chrono::microseconds maxDelay{0};
+    };
+
+    // Seed of the random faults. Each thread draws from its own generator, seeded from this and the thread's order.
+    void seed(uint32_t seed);
+
+    // Apply a profile to the fd until cleared, before any thread uses the fd.
+    void inject(int fd, const Profile& profile);
+    void clear(int fd);
+}
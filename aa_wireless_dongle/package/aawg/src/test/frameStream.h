@@ -0,0 +1,90 @@
+#pragma once
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "aaFrame.h"
+
+/*
+ * Synthetic Android Auto traffic for the checks and benchmarks.
+ */
+namespace FrameStream {
+    /**
+     * Append a frame with the given flags and payload length. The first fragment of a fragmented message
+     * gets the extra four bytes of header. The payload is a counter, so misplaced bytes show.
+     */
+    inline void appendFrame(std::vector<unsigned char>& stream, uint8_t channel, uint8_t flags, size_t payloadLength) {
+        stream.push_back(channel);
+        stream.push_back(flags);
+        stream.push_back(payloadLength >> 8);
+        stream.push_back(payloadLength & 0xFF);
+        if ((flags & AAFrame::FRAME_TYPE_MASK) == AAFrame::FLAG_FIRST) {
+            for (int i = 0; i < 4; i++) {
+                stream.push_back(0);
+            }
+        }
+        for (size_t i = 0; i < payloadLength; i++) {
+            stream.push_back(static_cast<unsigned char>(stream.size()));
+        }
+    }
+
+    /**
+     * A mix like a session: small control and input frames, and video messages fragmented into a first,
+     * middle and last frame, up to the largest frame possible.
+     */
+    inline std::vector<unsigned char> session(size_t& frames) {
+        std::vector<unsigned char> stream;
+        frames = 0;
+
+        const size_t videoPayloads[] = {1200, 16384, 0xFFFF};
+        for (size_t payload: videoPayloads) {
+            appendFrame(stream, AAFrame::CONTROL_CHANNEL, AAFrame::FLAG_FIRST | AAFrame::FLAG_LAST | AAFrame::FLAG_CONTROL, 6);
+            appendFrame(stream, 3, AAFrame::FLAG_FIRST | AAFrame::FLAG_ENCRYPTED, payload);
+            appendFrame(stream, 3, AAFrame::FLAG_ENCRYPTED, payload);
+            appendFrame(stream, 3, AAFrame::FLAG_LAST | AAFrame::FLAG_ENCRYPTED, payload / 3);
+            appendFrame(stream, 7, AAFrame::FLAG_FIRST | AAFrame::FLAG_LAST | AAFrame::FLAG_ENCRYPTED, 42);
+            frames += 5;
+        }
+
+        return stream;
+    }
+
+    /**
+     * Writes a stream over and over into an fd from its own thread, until stopped.
+     */
+    class Writer {
+    public:
+        Writer(int fd, const std::vector<unsigned char>& stream): m_fd(fd), m_stream(stream) {
+            m_thread = std::thread([this]() {
+                while (!m_stop) {
+                    const unsigned char* data = m_stream.data();
+                    size_t remaining = m_stream.size();
+                    while (remaining > 0) {
+                        ssize_t len = write(m_fd, data, remaining);
+                        if (len <= 0) {
+                            return;
+                        }
+                        data += len;
+                        remaining -= len;
+                    }
+                }
+            });
+        }
+
+        // The reader must have shut down its end first, so a blocked write fails.
+        ~Writer() {
+            m_stop = true;
+            m_thread.join();
+        }
+
+    private:
+        int m_fd;
+        const std::vector<unsigned char>& m_stream;
+        std::atomic<bool> m_stop = false;
+        std::thread m_thread;
+    };
+}
@@ -0,0 +1,490 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "bluezMock.h"
+#include "frameStream.h"
+#include "aaFrame.h"
+#include "common.h"
+#include "bluetoothHandler.h"
+#include "controlServer.h"
+#include "eventLog.h"
+#include "eventLoop.h"
+#include "flightRecorder.h"
+#include "proxyHandler.h"
+#include "uevent.h"
+#include "usb.h"
+
+/*
+ * Reconnect soak: thousands of sessions back to back, each set up and torn down the way aawgd does it, to
+ * catch what a handful of sessions never shows. Each cycle:
+ *   - BluetoothHandler connects the phone, played by BluezMock on a private bus, which gets the wifi details
+ *   - the phone connects to the proxy, a replayed uevent requests the accessory, the gadgets are switched in
+ *     a scratch configfs, and the session forwards over a fifo standing in for /dev/usb_accessory, which
+ *     echoes the phone's frames back
+ *   - once its frames came back, the phone drops the connection with the reconnect command of the control
+ *     socket, and the session ends
+ * The accessory requests come from a uevent recording, replayed through AAWG_UEVENT_REPLAY_FILE: one request
+ * every ACCESSORY_INTERVAL. After each cycle, the threads, resident memory and fds of the process are read
+ * from the stats of the control socket.
+ *
+ * Fails when the last window of cycles, compared to the first one after the warmup:
+ *   - has more threads or fds at any point
+ *   - is more than RSS_SLACK_KB larger on average
+ *   - takes more than LATENCY_DRIFT times longer at the median, from connecting bluetooth until the phone
+ *     got its frames back
+ * The log of the daemon code and the verdict go to stderr. Each cycle is printed to stdout as one JSON object
+ * per line, followed by the results of the two windows:
+ *   {"cycle":1,"latency_ms":41.2,"threads":9,"fds":31,"rss_kb":5120}
+ *
+ *   soakReconnect [cycles]
+ */
+
+using namespace std::chrono_literals;
+
+static constexpr int DEFAULT_CYCLES = 2000;
+static constexpr int MIN_CYCLES = 200;
+// Pools, caches and the malloc arenas of the threads settle during the first cycles
+static constexpr int WARMUP_PERCENT = 25;
+static constexpr int MIN_WARMUP = 50;
+// The first and last window compared are this share of the cycles
+static constexpr int WINDOW_PERCENT = 10;
+static constexpr int MIN_WINDOW = 20;
+
+// Allocator fragmentation may still grow the heap a little, a leak of half a kB per cycle adds up to more.
+static constexpr long RSS_SLACK_KB = 512;
+// The accessory requests alone add up to an ACCESSORY_INTERVAL of jitter to each cycle.
+static constexpr double LATENCY_DRIFT = 1.5;
+static constexpr std::chrono::milliseconds LATENCY_DRIFT_FLOOR(10);
+
+static constexpr std::chrono::milliseconds ACCESSORY_INTERVAL(20);
+// The recording lasts this long per cycle, a cycle takes less than a tenth of it.
+static constexpr std::chrono::milliseconds CYCLE_BUDGET(500);
+static constexpr std::chrono::seconds CONNECT_TIMEOUT(10);
+// Longer than the daemon waits for the accessory
+static constexpr std::chrono::seconds CYCLE_TIMEOUT(60);
+
+// What the kernel sends once the phone asked the accessory gadget to start
+static const char ACCESSORY_START[] = "ACTION=change\0DEVPATH=/devices/virtual/misc/usb_accessory\0SUBSYSTEM=misc\0"
+    "MAJOR=10\0MINOR=52\0DEVNAME=usb_accessory\0ACCESSORY=START";
+
+struct Sample {
+    std::chrono::nanoseconds latency;
+    int threads;
+    long rssKb;
+    int fds;
+};
+
+#pragma region Setup
+// Accessory start requests for the given number of cycles, in the format of UeventRecorder
+static bool writeRecording(std::string path, int cycles) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+
+    long long requests = (long long)cycles * (CYCLE_BUDGET / ACCESSORY_INTERVAL);
+    uint32_t length = sizeof(ACCESSORY_START);
+    for (long long i = 1; i <= requests; i++) {
+        uint64_t offsetUs = std::chrono::duration_cast<std::chrono::microseconds>(ACCESSORY_INTERVAL * i).count();
+        file.write(reinterpret_cast<const char*>(&offsetUs), sizeof(offsetUs));
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(ACCESSORY_START, length);
+    }
+
+    return bool(file);
+}
+
+/*
+ * What the daemon expects to find under the configfs, sysfs and dev roots once the kernel set them up: the
+ * gadgets' UDC attributes, a detached UDC, and the endpoints umtprd would have created. The accessory is a
+ * fifo, whatever is written to it is read back.
+ */
+static bool makeRoots(std::string root) {
+    std::vector<std::string> dirs = {"/sysfs/class/udc/soak.udc", "/dev/ffs-mtp", "/run"};
+    for (std::string gadget: {"default", "accessory"}) {
+        for (std::string dir: {"/strings", "/functions", "/configs"}) {
+            dirs.push_back("/configfs/usb_gadget/" + gadget + dir);
+        }
+    }
+
+    std::error_code error;
+    for (const std::string& dir: dirs) {
+        if (!std::filesystem::create_directories(root + dir, error)) {
+            fprintf(stderr, "Cannot create %s%s: %s\n", root.c_str(), dir.c_str(), error.message().c_str());
+            return false;
+        }
+    }
+
+    std::ofstream(root + "/configfs/usb_gadget/default/UDC") << "\n";
+    std::ofstream(root + "/configfs/usb_gadget/accessory/UDC") << "\n";
+    std::ofstream(root + "/sysfs/class/udc/soak.udc/state") << "not attached\n";
+    std::ofstream(root + "/dev/ffs-mtp/ep0");
+    std::ofstream(root + "/dev/ffs-mtp/ep1");
+
+    if (mkfifo((root + "/dev/usb_accessory").c_str(), 0600) != 0) {
+        fprintf(stderr, "Cannot create the accessory fifo: %s\n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+// A port nothing listens on, for the proxy
+static int freePort() {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t address_len = sizeof(address);
+
+    int port = -1;
+    if (fd >= 0 && bind(fd, (struct sockaddr*)&address, sizeof(address)) == 0 && getsockname(fd, (struct sockaddr*)&address, &address_len) == 0) {
+        port = ntohs(address.sin_port);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    return port;
+}
+#pragma endregion Setup
+
+#pragma region Phone
+// Send a command to the control socket and return the response. Blocks, never call it on the event loop.
+static std::string control(std::string command) {
+    std::string path = Config::instance()->getControlSocketPath();
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    std::string response;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0 &&
+        write(fd, command.c_str(), command.size()) == (ssize_t)command.size()) {
+        char buffer[1024];
+        ssize_t len;
+        while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+            response.append(buffer, len);
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    return response;
+}
+
+// Value of a key of the stats summary, -1 if it is missing
+static long statValue(const std::string& stats, const char* key) {
+    std::string line = " " + stats;
+    std::string pattern = std::string(" ") + key + "=";
+
+    size_t position = line.find(pattern);
+    if (position == std::string::npos) {
+        return -1;
+    }
+    return atol(line.c_str() + position + pattern.size());
+}
+
+/*
+ * The phone's side of a session: connect to the proxy, send a few frames and wait for the fifo to echo them
+ * back, then drop the connection through the control socket. Returns once the daemon closed the session.
+ */
+static bool playPhone(int port, std::chrono::steady_clock::time_point start, std::chrono::nanoseconds& latency) {
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "phone: cannot connect to the proxy: %s\n", strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    std::vector<unsigned char> frames;
+    FrameStream::appendFrame(frames, AAFrame::CONTROL_CHANNEL, AAFrame::FLAG_FIRST | AAFrame::FLAG_LAST | AAFrame::FLAG_CONTROL, 6);
+    FrameStream::appendFrame(frames, 7, AAFrame::FLAG_FIRST | AAFrame::FLAG_LAST | AAFrame::FLAG_ENCRYPTED, 42);
+
+    bool ok = write(fd, frames.data(), frames.size()) == (ssize_t)frames.size();
+
+    // Forwarded once the accessory is open
+    std::vector<unsigned char> echo(frames.size());
+    size_t received = 0;
+    while (ok && received < echo.size()) {
+        ssize_t len = read(fd, echo.data() + received, echo.size() - received);
+        if (len <= 0) {
+            fprintf(stderr, "phone: session ended after %zu of %zu bytes\n", received, echo.size());
+            ok = false;
+            break;
+        }
+        received += len;
+    }
+
+    if (ok && echo != frames) {
+        fprintf(stderr, "phone: frames came back altered\n");
+        ok = false;
+    }
+
+    if (ok) {
+        latency = std::chrono::steady_clock::now() - start;
+
+        std::string response = control("reconnect");
+        if (response != "ok\n") {
+            fprintf(stderr, "phone: reconnect answered '%s'\n", response.c_str());
+            ok = false;
+        }
+    }
+
+    // Without a reconnect, closing the socket ends the session.
+    if (!ok) {
+        shutdown(fd, SHUT_RDWR);
+    }
+
+    char buffer[256];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+    close(fd);
+
+    return ok;
+}
+#pragma endregion Phone
+
+#pragma region Soak
+/*
+ * One session after the other like connectionLoop in aawgd, without the pause between sessions.
+ */
+static EventLoop::Task runCycles(int cycles, int port, BluezMock& mock, EventLoop::Signal phoneConnected, std::vector<Sample>& samples, std::atomic<int>& completed, std::promise<bool>& result) {
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        std::unique_ptr<AAWProxy> proxy = std::make_unique<AAWProxy>();
+        if (!proxy->startServer(port)) {
+            result.set_value(false);
+            co_return;
+        }
+
+        co_await EventLoop::instance().blocking([]() { BluetoothHandler::instance().powerOn(); });
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        BluetoothHandler::instance().connectWithRetry();
+        if (!co_await phoneConnected.wait(CONNECT_TIMEOUT)) {
+            fprintf(stderr, "cycle %d: no bluetooth connection within %lld s\n", cycle + 1, (long long)CONNECT_TIMEOUT.count());
+            result.set_value(false);
+            co_return;
+        }
+
+        std::chrono::nanoseconds latency(0);
+        bool phoneOk = false;
+        std::thread phone([port, start, &latency, &phoneOk]() { phoneOk = playPhone(port, start, latency); });
+
+        co_await proxy->handleClient();
+        proxy = nullptr;
+
+        BluetoothHandler::instance().stopConnectWithRetry();
+        co_await BluetoothHandler::instance().connectWithRetryStopped();
+        UsbManager::instance().disableGadget();
+
+        std::string stats = co_await EventLoop::instance().blocking([&phone, &mock]() {
+            phone.join();
+            mock.disconnectAll();
+            return control("stats");
+        });
+
+        Sample sample = {latency, (int)statValue(stats, "threads"), statValue(stats, "rss_kb"), (int)statValue(stats, "fds")};
+        if (!phoneOk || sample.threads <= 0 || sample.rssKb <= 0 || sample.fds <= 0) {
+            fprintf(stderr, "cycle %d failed, stats: %s\n", cycle + 1, stats.c_str());
+            result.set_value(false);
+            co_return;
+        }
+
+        printf("{\"cycle\":%d,\"latency_ms\":%.1f,\"threads\":%d,\"fds\":%d,\"rss_kb\":%ld}\n",
+            cycle + 1, std::chrono::duration<double, std::milli>(latency).count(), sample.threads, sample.fds, sample.rssKb);
+        fflush(stdout);
+
+        samples.push_back(sample);
+        completed++;
+    }
+
+    result.set_value(true);
+}
+
+struct Window {
+    Bench::Result latency;
+    std::chrono::nanoseconds medianLatency;
+    int maxThreads = 0;
+    int maxFds = 0;
+    long meanRssKb = 0;
+};
+
+static Window summarize(const std::vector<Sample>& samples, size_t begin, size_t end) {
+    Window window;
+    window.latency = {end - begin, std::chrono::nanoseconds(0)};
+
+    std::vector<std::chrono::nanoseconds> latencies;
+    long long rssKb = 0;
+    for (size_t i = begin; i < end; i++) {
+        latencies.push_back(samples[i].latency);
+        window.latency.elapsed += samples[i].latency;
+        window.maxThreads = std::max(window.maxThreads, samples[i].threads);
+        window.maxFds = std::max(window.maxFds, samples[i].fds);
+        rssKb += samples[i].rssKb;
+    }
+
+    std::nth_element(latencies.begin(), latencies.begin() + latencies.size() / 2, latencies.end());
+    window.medianLatency = latencies[latencies.size() / 2];
+    window.meanRssKb = rssKb / (long long)(end - begin);
+
+    return window;
+}
+
+static double milliseconds(std::chrono::nanoseconds duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Compare the last window to the first one after the warmup.
+static bool checkGrowth(const std::vector<Sample>& samples) {
+    size_t warmup = std::max<size_t>(MIN_WARMUP, samples.size() * WARMUP_PERCENT / 100);
+    size_t windowSize = std::max<size_t>(MIN_WINDOW, samples.size() * WINDOW_PERCENT / 100);
+
+    Window first = summarize(samples, warmup, warmup + windowSize);
+    Window last = summarize(samples, samples.size() - windowSize, samples.size());
+
+    Bench::report("soak/reconnect/first_window", first.latency);
+    Bench::report("soak/reconnect/last_window", last.latency);
+
+    fprintf(stderr, "%zu cycles, first and last %zu after %zu of warmup: threads %d -> %d, fds %d -> %d, %ld -> %ld kB resident, median reconnect %.1f -> %.1f ms\n",
+        samples.size(), windowSize, warmup, first.maxThreads, last.maxThreads, first.maxFds, last.maxFds,
+        first.meanRssKb, last.meanRssKb, milliseconds(first.medianLatency), milliseconds(last.medianLatency));
+
+    bool ok = true;
+    if (last.maxThreads > first.maxThreads) {
+        fprintf(stderr, "FAIL: threads grew by %d\n", last.maxThreads - first.maxThreads);
+        ok = false;
+    }
+    if (last.maxFds > first.maxFds) {
+        fprintf(stderr, "FAIL: fds grew by %d\n", last.maxFds - first.maxFds);
+        ok = false;
+    }
+    if (last.meanRssKb - first.meanRssKb > RSS_SLACK_KB) {
+        fprintf(stderr, "FAIL: resident memory grew by %ld kB, more than %ld kB\n", last.meanRssKb - first.meanRssKb, RSS_SLACK_KB);
+        ok = false;
+    }
+    if (last.medianLatency > first.medianLatency * LATENCY_DRIFT + LATENCY_DRIFT_FLOOR) {
+        fprintf(stderr, "FAIL: reconnecting drifted from %.1f to %.1f ms\n", milliseconds(first.medianLatency), milliseconds(last.medianLatency));
+        ok = false;
+    }
+
+    return ok;
+}
+#pragma endregion Soak
+
+int main(int argc, char** argv) {
+    int cycles = argc > 1 ? atoi(argv[1]) : DEFAULT_CYCLES;
+    if (cycles < MIN_CYCLES) {
+        fprintf(stderr, "At least %d cycles are needed\n", MIN_CYCLES);
+        return 1;
+    }
+
+    // Like aawgd, a phone that went away must not kill the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    char rootTemplate[] = "/tmp/soakReconnect.XXXXXX";
+    if (!mkdtemp(rootTemplate)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string root = rootTemplate;
+
+    int port = freePort();
+    if (!makeRoots(root) || !writeRecording(root + "/uevents", cycles) || port < 0) {
+        std::filesystem::remove_all(root);
+        return 1;
+    }
+
+    setenv("AAWG_CONFIGFS_ROOT", (root + "/configfs").c_str(), 1);
+    setenv("AAWG_SYSFS_ROOT", (root + "/sysfs").c_str(), 1);
+    setenv("AAWG_DEV_ROOT", (root + "/dev").c_str(), 1);
+    setenv("AAWG_RUN_ROOT", (root + "/run").c_str(), 1);
+    setenv("AAWG_UEVENT_REPLAY_FILE", (root + "/uevents").c_str(), 1);
+    setenv("AAWG_CONTROL_SOCKET", (root + "/aawgd.sock").c_str(), 1);
+    setenv("AAWG_FLIGHT_RECORDER_FILE", (root + "/aawgd.flight").c_str(), 1);
+    setenv("AAWG_CONNECTION_STRATEGY", "1", 1);
+    setenv("AAWG_PROXY_PORT", std::to_string(port).c_str(), 1);
+    // There is no wlan0 to take it from
+    setenv("AAWG_WIFI_BSSID", "00:00:00:00:00:00", 0);
+
+    FlightRecorder::instance().init();
+    EventLog::instance().start();
+
+    PrivateBus bus;
+    if (bus.address().empty()) {
+        std::filesystem::remove_all(root);
+        return 1;
+    }
+    setenv("AAWG_DBUS_ADDRESS", bus.address().c_str(), 1);
+
+    EventLoop::Signal phoneConnected;
+    BluezMock mock(bus.address(), [phoneConnected]() mutable { phoneConnected.notify(); });
+    if (!mock.start()) {
+        std::filesystem::remove_all(root);
+        return 1;
+    }
+    mock.setDevices({{"00:11:22:33:44:01"}});
+
+    std::thread([]() { EventLoop::instance().run(); }).detach();
+    UsbManager::instance().init();
+    ControlServer::instance().start();
+    BluetoothHandler::instance().init();
+    // The replay starts now, after the slowest part of the init
+    if (!UeventMonitor::instance().start()) {
+        std::filesystem::remove_all(root);
+        return 1;
+    }
+
+    // Allocated up front, only the daemon code may grow while cycling
+    std::vector<Sample> samples;
+    samples.reserve(cycles);
+    std::atomic<int> completed = 0;
+    std::promise<bool> result;
+    std::future<bool> future = result.get_future();
+    EventLoop::instance().spawn([cycles, port, &mock, phoneConnected, &samples, &completed, &result]() {
+        return runCycles(cycles, port, mock, phoneConnected, samples, completed, result);
+    });
+
+    // A cycle that hangs would hold the soak forever
+    int lastCompleted = -1;
+    while (future.wait_for(CYCLE_TIMEOUT) != std::future_status::ready) {
+        if (completed == lastCompleted) {
+            fprintf(stderr, "cycle %d did not finish within %lld s\n", lastCompleted + 1, (long long)CYCLE_TIMEOUT.count());
+            std::filesystem::remove_all(root);
+            return 1;
+        }
+        lastCompleted = completed;
+    }
+
+    bool ok = future.get() && checkGrowth(samples);
+
+    std::filesystem::remove_all(root);
+    return ok ? 0 : 1;
+}
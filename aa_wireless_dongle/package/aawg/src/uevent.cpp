@@ -1,7 +1,5 @@
 #include <unistd.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <linux/netlink.h>
 
 #include "common.h"
 #include "uevent.h"
@@ -13,80 +11,169 @@ UeventMonitor& UeventMonitor::instance() {
     return instance;
 }
 
-void UeventMonitor::monitorLoop(int nl_socket) {
-    char msg[NETLINK_MSG_SIZE + 1];
+EventLoop::Task UeventMonitor::monitorLoop() {
+    char msg[NETLINK_MSG_SIZE];
 
     while (true) {
-        ssize_t len = read(nl_socket, msg, NETLINK_MSG_SIZE);
+        co_await EventLoop::instance().readable(m_source->fd());
+        ssize_t len = m_source->receive(msg, NETLINK_MSG_SIZE);
 
         if (len < 0) {
-            Logger::instance()->info("Read from netlink socket failed: %s\n", strerror(errno));
+            Logger::instance()->info("Read from uevent source failed: %s\n", strerror(errno));
             continue;
         }
         else if (len == 0) {
-            continue;
+            Logger::instance()->info("Uevent source exhausted, stopping uevent monitoring\n");
+            break;
         }
 
-        char* end = msg + len;
-        *end = '\0';
-
-        // printf("length: %ld msg: %s\n", len, msg);
+        if (m_recorder) {
+            m_recorder->record(msg, len);
+        }
 
-        // Parse the env from message
-        UeventEnv envMap;
-        char* current = msg;
-        while (current < end) {
-            if (char* split = strchr(current, '='); split != NULL && split > current) {
-                std::string envName(current, split - current);
-                std::string envValue(split + 1);
+        dispatch(parse(msg, len));
+    }
+}
 
-                envMap.emplace(envName, envValue);
-                // printf("%s = %s\n", envName.c_str(), envValue.c_str());
-            }
+/*static*/ UeventEnv UeventMonitor::parse(const char* msg, size_t len) {
+    UeventEnv envMap;
 
-            current += strlen(current) + 1;
+    const char* current = msg;
+    const char* end = msg + len;
+    while (current < end) {
+        // Each entry ends with a null, except possibly the last one.
+        const char* entryEnd = static_cast<const char*>(memchr(current, '\0', end - current));
+        if (entryEnd == nullptr) {
+            entryEnd = end;
         }
 
-        // Call the handlers
-        for (auto it = handlers.cbegin(); it != handlers.cend(); ++it) {
-            if ((*it)(envMap)) {
-                it = handlers.erase(it);
-            }
+        if (const char* split = static_cast<const char*>(memchr(current, '=', entryEnd - current)); split != nullptr && split > current) {
+            envMap.emplace(std::string(current, split - current), std::string(split + 1, entryEnd - split - 1));
         }
+
+        current = entryEnd + 1;
     }
+
+    return envMap;
 }
 
-void UeventMonitor::addHandler(std::function<bool(UeventEnv)> handler) {
-    handlers.push_back(handler);
+void UeventMonitor::dispatch(const UeventEnv& env) {
+    std::shared_ptr<const HandlerList> handlers = std::atomic_load(&m_handlers);
+
+    bool removed = false;
+    for (const std::shared_ptr<Handler>& handler: *handlers) {
+        if (!handler->active) {
+            removed = true;
+            continue;
+        }
+
+        if (!handler->callback(env)) {
+            continue;
+        }
+
+        // Claim the handler, it might have been removed concurrently while the callback was running.
+        if (handler->active.exchange(false) && handler->onMatch) {
+            handler->onMatch(env);
+        }
+        removed = true;
+    }
+
+    if (removed) {
+        pruneHandlers();
+    }
 }
 
-std::optional<std::thread> UeventMonitor::start() {
-    Logger::instance()->info("Starting uevent monitoring\n");
+void UeventMonitor::pruneHandlers() {
+    std::lock_guard<std::mutex> lock(m_handlersMutex);
 
-    int nl_sock;
-    if ((nl_sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT)) < 0) {
-        Logger::instance()->info("creating socket failed for netlink socket: %s\n", strerror(errno));
-        return std::nullopt;
+    std::shared_ptr<HandlerList> handlers = std::make_shared<HandlerList>();
+    for (const std::shared_ptr<Handler>& handler: *m_handlers) {
+        if (handler->active) {
+            handlers->push_back(handler);
+        }
     }
 
-    struct sockaddr_nl address = {
-        .nl_family = AF_NETLINK,
-        .nl_pid = (unsigned int)getpid(),
-        .nl_groups = -1u
+    std::atomic_store(&m_handlers, std::shared_ptr<const HandlerList>(handlers));
+}
+
+UeventMonitor::HandlerId UeventMonitor::addHandler(std::shared_ptr<Handler> handler) {
+    std::lock_guard<std::mutex> lock(m_handlersMutex);
+
+    handler->id = m_nextHandlerId++;
+
+    std::shared_ptr<HandlerList> handlers = std::make_shared<HandlerList>(*m_handlers);
+    handlers->push_back(handler);
+
+    std::atomic_store(&m_handlers, std::shared_ptr<const HandlerList>(handlers));
+
+    return handler->id;
+}
+
+UeventMonitor::HandlerId UeventMonitor::addHandler(std::function<bool(const UeventEnv&)> callback) {
+    std::shared_ptr<Handler> handler = std::make_shared<Handler>();
+    handler->callback = callback;
+
+    return addHandler(handler);
+}
+
+EventLoop::Async<std::optional<UeventEnv>> UeventMonitor::waitFor(std::function<bool(const UeventEnv&)> matcher, std::chrono::milliseconds timeout) {
+    EventLoop::Signal matched;
+    std::shared_ptr<UeventEnv> event = std::make_shared<UeventEnv>();
+
+    std::shared_ptr<Handler> handler = std::make_shared<Handler>();
+    handler->callback = matcher;
+    handler->onMatch = [matched, event](const UeventEnv& env) mutable {
+        *event = env;
+        matched.notify();
     };
+    HandlerId id = addHandler(handler);
+
+    // The handler may have matched just as the wait timed out, then its event is still taken.
+    if (!co_await matched.wait(timeout) && removeHandler(id)) {
+        co_return std::nullopt;
+    }
+
+    co_return *event;
+}
+
+bool UeventMonitor::removeHandler(HandlerId id) {
+    std::shared_ptr<const HandlerList> handlers = std::atomic_load(&m_handlers);
+
+    for (const std::shared_ptr<Handler>& handler: *handlers) {
+        if (handler->id == id) {
+            bool wasActive = handler->active.exchange(false);
+            pruneHandlers();
+            return wasActive;
+        }
+    }
+
+    return false;
+}
+
+bool UeventMonitor::start(std::unique_ptr<UeventSource> source) {
+    Logger::instance()->info("Starting uevent monitoring\n");
+
+    if (!source) {
+        if (std::string replayFile = Config::instance()->getUeventReplayFile(); !replayFile.empty()) {
+            Logger::instance()->info("Replaying uevents from %s\n", replayFile.c_str());
+            source = ReplayUeventSource::create(replayFile);
+        } else {
+            source = NetlinkUeventSource::create();
+        }
+    }
 
-    if (bind(nl_sock, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        Logger::instance()->info("bind failed for netlink socket: %s\n", strerror(errno));
-        return std::nullopt;
+    if (!source) {
+        return false;
     }
+    m_source = std::move(source);
 
-    int opt = 1;
-    if (setsockopt(nl_sock, SOL_SOCKET, SO_PASSCRED, &opt, sizeof(opt))) {
-        Logger::instance()->info("setsockopt failed to set SO_PASSCRED for netlink socket: %s\n", strerror(errno));
-        return std::nullopt;
+    if (std::string recordFile = Config::instance()->getUeventRecordFile(); !recordFile.empty()) {
+        Logger::instance()->info("Recording uevents to %s\n", recordFile.c_str());
+        m_recorder = UeventRecorder::create(recordFile);
     }
 
     Logger::instance()->info("Uevent monitoring started\n");
 
-    return std::thread(&UeventMonitor::monitorLoop, this, nl_sock);
+    EventLoop::instance().spawn([this]() { return monitorLoop(); });
+    return true;
 }
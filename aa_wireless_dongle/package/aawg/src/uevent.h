@@ -1,32 +1,88 @@
 #include <optional>
 #include <thread>
-#include <list>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <map>
 #include <functional>
 
+#include "eventLoop.h"
+#include "ueventSource.h"
+
 typedef std::map<std::string, std::string> UeventEnv;
 
 class UeventMonitor {
 public:
+    typedef uint64_t HandlerId;
+
     static UeventMonitor& instance();
 
-    std::optional<std::thread> start();
+    /**
+     * Start monitoring uevents on the event loop.
+     *
+     * @param source Source to read uevents from. By default, uevents are replayed from AAWG_UEVENT_REPLAY_FILE if set, or read from the kernel otherwise.
+     * @return false if the source could not be created.
+     */
+    bool start(std::unique_ptr<UeventSource> source = nullptr);
 
     /**
-     * Add a handler to be called for upcoming uevents, the handler will be called on the monitor thread.
+     * Add a handler to be called for upcoming uevents, the handler will be called on the event loop thread.
      * The handler should check if the event is interesting to it, and act on the event if interesting.
      * The handler should return a boolean. If returned true, the handler is removed and will no longer recieve any more callbacks.
-     * 
+     *
      * @param handler Handler to be called for every upcoming uevent.
+     * @return Id that can be used to remove the handler using removeHandler.
      */
-    void addHandler(std::function<bool(UeventEnv)> handler);
+    HandlerId addHandler(std::function<bool(const UeventEnv&)> handler);
+
+    /**
+     * Wait for the first upcoming uevent the matcher returns true for, from a coroutine on the event loop. The matcher
+     * is registered as a one-shot handler when the wait starts, and removed if the timeout expires first.
+     *
+     * @param matcher Returns true for the event to wait for.
+     * @param timeout Time to wait for, zero waits forever.
+     * @return The matched event, or nullopt if timed out.
+     */
+    EventLoop::Async<std::optional<UeventEnv>> waitFor(std::function<bool(const UeventEnv&)> matcher, std::chrono::milliseconds timeout);
+
+    /**
+     * Remove a handler. Safe to call from any thread, including from within a handler.
+     *
+     * @return true if the handler was active and will not be called again, false if it was already removed or has fired as one-shot.
+     */
+    bool removeHandler(HandlerId id);
+
+    /**
+     * Parse a raw uevent message, a sequence of null separated "KEY=VALUE" strings, into its environment.
+     * The first line of kernel uevents, "ACTION@DEVPATH", has no '=' and is skipped.
+     */
+    static UeventEnv parse(const char* msg, size_t len);
 
 private:
+    struct Handler {
+        HandlerId id;
+        std::function<bool(const UeventEnv&)> callback;
+        std::function<void(const UeventEnv&)> onMatch;
+        std::atomic<bool> active = true;
+    };
+    typedef std::vector<std::shared_ptr<Handler>> HandlerList;
+
     UeventMonitor() {};
     UeventMonitor(UeventMonitor const&);
     UeventMonitor& operator=(UeventMonitor const&);
 
-    void monitorLoop(int nl_socket);
+    EventLoop::Task monitorLoop();
+    void dispatch(const UeventEnv& env);
+    HandlerId addHandler(std::shared_ptr<Handler> handler);
+    void pruneHandlers();
+
+    // Copy-on-write list of handlers. Writers copy under m_handlersMutex and publish a new list atomically,
+    // dispatch only loads the current list and calls the handlers without holding the mutex.
+    std::shared_ptr<const HandlerList> m_handlers = std::make_shared<HandlerList>();
+    std::mutex m_handlersMutex;
+    std::atomic<HandlerId> m_nextHandlerId = 1;
 
-    std::list<std::function<bool(UeventEnv)>> handlers;
+    std::unique_ptr<UeventSource> m_source;
+    std::unique_ptr<UeventRecorder> m_recorder;
 };
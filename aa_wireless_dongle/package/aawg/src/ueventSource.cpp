@@ -0,0 +1,161 @@
+#include <unistd.h>
+#include <string.h>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <linux/netlink.h>
+
+#include "common.h"
+#include "ueventSource.h"
+
+#pragma region NetlinkUeventSource
+/* static */ std::unique_ptr<NetlinkUeventSource> NetlinkUeventSource::create() {
+    int nl_sock;
+    if ((nl_sock = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT)) < 0) {
+        Logger::instance()->info("creating socket failed for netlink socket: %s\n", strerror(errno));
+        return nullptr;
+    }
+
+    struct sockaddr_nl address = {
+        .nl_family = AF_NETLINK,
+        .nl_pid = (unsigned int)getpid(),
+        .nl_groups = -1u
+    };
+
+    if (bind(nl_sock, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        Logger::instance()->info("bind failed for netlink socket: %s\n", strerror(errno));
+        close(nl_sock);
+        return nullptr;
+    }
+
+    int opt = 1;
+    if (setsockopt(nl_sock, SOL_SOCKET, SO_PASSCRED, &opt, sizeof(opt))) {
+        Logger::instance()->info("setsockopt failed to set SO_PASSCRED for netlink socket: %s\n", strerror(errno));
+        close(nl_sock);
+        return nullptr;
+    }
+
+    return std::unique_ptr<NetlinkUeventSource>(new NetlinkUeventSource(nl_sock));
+}
+
+NetlinkUeventSource::~NetlinkUeventSource() {
+    close(m_nl_socket);
+}
+
+int NetlinkUeventSource::fd() {
+    return m_nl_socket;
+}
+
+ssize_t NetlinkUeventSource::receive(char* buffer, size_t length) {
+    while (true) {
+        ssize_t len = read(m_nl_socket, buffer, length);
+
+        // The netlink socket never runs out, skip empty reads.
+        if (len != 0) {
+            return len;
+        }
+    }
+}
+#pragma endregion NetlinkUeventSource
+
+#pragma region ReplayUeventSource
+/* static */ std::unique_ptr<ReplayUeventSource> ReplayUeventSource::create(std::string path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        Logger::instance()->info("Failed to open uevent recording %s\n", path.c_str());
+        return nullptr;
+    }
+
+    int timer_fd;
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+        Logger::instance()->info("Creating timer for uevent replay failed: %s\n", strerror(errno));
+        return nullptr;
+    }
+
+    std::unique_ptr<ReplayUeventSource> source(new ReplayUeventSource(std::move(file), timer_fd));
+    source->m_startTime = std::chrono::steady_clock::now();
+    source->readNext();
+
+    return source;
+}
+
+ReplayUeventSource::~ReplayUeventSource() {
+    close(m_timer_fd);
+}
+
+int ReplayUeventSource::fd() {
+    return m_timer_fd;
+}
+
+void ReplayUeventSource::readNext() {
+    m_hasNext = m_file.read(reinterpret_cast<char*>(&m_nextOffsetUs), sizeof(m_nextOffsetUs))
+        && m_file.read(reinterpret_cast<char*>(&m_nextLength), sizeof(m_nextLength));
+
+    // At the end of the recording, fire right away so the end is noticed. steady_clock is CLOCK_MONOTONIC.
+    std::chrono::steady_clock::time_point due = m_hasNext ? m_startTime + std::chrono::microseconds(m_nextOffsetUs) : m_startTime;
+    auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(due.time_since_epoch()).count();
+
+    // A zero expiration would disarm the timer
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = sinceEpoch / 1000000000;
+    spec.it_value.tv_nsec = std::max<long long>(sinceEpoch % 1000000000, 1);
+    timerfd_settime(m_timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+ssize_t ReplayUeventSource::receive(char* buffer, size_t length) {
+    if (!m_hasNext) {
+        // End of the recording
+        return 0;
+    }
+
+    uint64_t expirations;
+    read(m_timer_fd, &expirations, sizeof(expirations));
+    std::this_thread::sleep_until(m_startTime + std::chrono::microseconds(m_nextOffsetUs));
+
+    uint32_t messageLength = m_nextLength;
+    if (messageLength > length) {
+        m_file.ignore(messageLength);
+        readNext();
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (!m_file.read(buffer, messageLength)) {
+        Logger::instance()->info("Uevent recording is truncated\n");
+        m_hasNext = false;
+        return 0;
+    }
+
+    readNext();
+    return messageLength;
+}
+#pragma endregion ReplayUeventSource
+
+#pragma region UeventRecorder
+/* static */ std::unique_ptr<UeventRecorder> UeventRecorder::create(std::string path) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        Logger::instance()->info("Failed to open %s to record uevents\n", path.c_str());
+        return nullptr;
+    }
+
+    return std::unique_ptr<UeventRecorder>(new UeventRecorder(std::move(file)));
+}
+
+void UeventRecorder::record(const char* message, size_t length) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (!m_startTime) {
+        m_startTime = now;
+    }
+
+    uint64_t offsetUs = std::chrono::duration_cast<std::chrono::microseconds>(now - *m_startTime).count();
+    uint32_t messageLength = length;
+
+    m_file.write(reinterpret_cast<const char*>(&offsetUs), sizeof(offsetUs));
+    m_file.write(reinterpret_cast<const char*>(&messageLength), sizeof(messageLength));
+    m_file.write(message, length);
+
+    // Flush every message, the daemon usually stops by being killed.
+    m_file.flush();
+}
+#pragma endregion UeventRecorder
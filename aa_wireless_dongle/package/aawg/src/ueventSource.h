@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <fstream>
+
+/**
+ * Source of raw uevent messages, as received from the kernel over netlink.
+ * Each message is a sequence of null separated "KEY=VALUE" strings.
+ */
+class UeventSource {
+public:
+    virtual ~UeventSource() = default;
+
+    /**
+     * Block until the next uevent message is available and copy it to the buffer.
+     *
+     * @return Length of the message, 0 if the source is exhausted, or -1 on error with errno set.
+     */
+    virtual ssize_t receive(char* buffer, size_t length) = 0;
+
+    /**
+     * File descriptor that becomes readable once receive would not block, to wait for it on the event loop.
+     */
+    virtual int fd() = 0;
+};
+
+
+class NetlinkUeventSource: public UeventSource {
+public:
+    static std::unique_ptr<NetlinkUeventSource> create();
+    ~NetlinkUeventSource() override;
+
+    ssize_t receive(char* buffer, size_t length) override;
+    int fd() override;
+
+private:
+    NetlinkUeventSource(int nl_socket): m_nl_socket(nl_socket) {};
+
+    int m_nl_socket;
+};
+
+
+/**
+ * Replays a uevent stream recorded by UeventRecorder, preserving the original timing between messages.
+ * The timing starts when the source is created, its fd is a timer firing when the next message is due.
+ */
+class ReplayUeventSource: public UeventSource {
+public:
+    static std::unique_ptr<ReplayUeventSource> create(std::string path);
+    ~ReplayUeventSource() override;
+
+    ssize_t receive(char* buffer, size_t length) override;
+    int fd() override;
+
+private:
+    ReplayUeventSource(std::ifstream&& file, int timer_fd): m_file(std::move(file)), m_timer_fd(timer_fd) {};
+
+    // Read the header of the next message and arm the timer for it.
+    void readNext();
+
+    std::ifstream m_file;
+    int m_timer_fd;
+    std::chrono::steady_clock::time_point m_startTime;
+
+    // Header of the next message, if any
+    bool m_hasNext = false;
+    uint64_t m_nextOffsetUs = 0;
+    uint32_t m_nextLength = 0;
+};
+
+
+/**
+ * Records uevent messages with their relative timestamps, to be replayed later with ReplayUeventSource.
+ *
+ * The recording is a sequence of records, each with a 64 bit microsecond offset from the first message,
+ * a 32 bit message length, both in host byte order, followed by the raw message.
+ */
+class UeventRecorder {
+public:
+    static std::unique_ptr<UeventRecorder> create(std::string path);
+
+    void record(const char* message, size_t length);
+
+private:
+    UeventRecorder(std::ofstream&& file): m_file(std::move(file)) {};
+
+    std::ofstream m_file;
+    std::optional<std::chrono::steady_clock::time_point> m_startTime;
+};
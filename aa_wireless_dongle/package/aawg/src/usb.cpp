@@ -1,14 +1,45 @@
 #include <dirent.h>
 #include <string.h>
-#include <future>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fstream>
 
 #include "common.h"
 #include "uevent.h"
 #include "usb.h"
+#include "eventLog.h"
 
 constexpr const char* defaultGadgetName = "default";
 constexpr const char* accessoryGadgetName = "accessory";
 
+constexpr const char* vendorId = "0x18D1";
+constexpr const char* defaultProductId = "0x4EE1";
+constexpr const char* accessoryProductId = "0x2D00";
+constexpr const char* serialNumber = "0123456";
+constexpr const char* manufacturer = "My Own";
+constexpr const char* product = "AA Wireless Dongle";
+constexpr const char* maxPower = "500";
+
+constexpr const char* defaultFunction = "ffs.mtp";
+constexpr const char* accessoryFunction = "accessory.usb0";
+
+// Under the dev and run roots
+constexpr const char* mtpFunctionfsDir = "ffs-mtp";
+constexpr const char* mtpPidFileName = "umtprd.pid";
+constexpr const char* mtpDaemonPath = "/usr/sbin/umtprd";
+constexpr const char* mtpDaemonName = "umtprd";
+// The daemon creates the endpoints once it has written its descriptors, usually within a few hundred ms.
+constexpr std::chrono::milliseconds mtpReadyTimeout(2000);
+constexpr std::chrono::milliseconds mtpPollInterval(5);
+
+// Fallback if the UDC does not report that the gadget was unbound.
+constexpr std::chrono::milliseconds udcUnbindTimeout(100);
+
 /*static*/ std::string UsbManager::s_udcName;
 
 UsbManager& UsbManager::instance() {
@@ -23,14 +54,26 @@ void UsbManager::init() {
 UsbManager::UsbManager() {
     Logger::instance()->info("Initializing USB Manager\n");
 
-    disableGadget();
+    m_configfsRoot = Config::instance()->getConfigfsRoot();
+    m_sysfsRoot = Config::instance()->getSysfsRoot();
+    m_mtpFunctionfsPath = Config::instance()->getDevRoot() + "/" + mtpFunctionfsDir;
+    m_mtpPidFile = Config::instance()->getRunRoot() + "/" + mtpPidFileName;
+
+    std::chrono::steady_clock::time_point provisionStart = std::chrono::steady_clock::now();
+    bool provisioned = provisionGadgets();
+    Logger::instance()->info("USB Manager: %s gadgets in %lld ms\n", provisioned ? "Provisioned" : "Failed to provision",
+        (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - provisionStart).count());
+
+    disableGadget(defaultGadgetName);
+    disableGadget(accessoryGadgetName);
 
-    DIR* dirSysClassUdc = opendir("/sys/class/udc/");
+    std::string udcClassPath = m_sysfsRoot + "/class/udc/";
+    DIR* dirSysClassUdc = opendir(udcClassPath.c_str());
     if (dirSysClassUdc == NULL) {
-        Logger::instance()->info("USB Manager: Error opening /sys/class/udc/: %s\n", strerror(errno));
+        Logger::instance()->info("USB Manager: Error opening %s: %s\n", udcClassPath.c_str(), strerror(errno));
         return;
     }
-    
+
     struct dirent* dirEntry = NULL;
     while ((dirEntry = readdir(dirSysClassUdc)) != NULL) {
         if (dirEntry->d_name[0] == '.') {
@@ -44,17 +87,207 @@ UsbManager::UsbManager() {
 
     if (s_udcName.empty()) {
         Logger::instance()->info("USB Manager: Did not find a valid UDC to use\n");
-    } else {
-        Logger::instance()->info("USB Manager: Found UDC %s\n", s_udcName.c_str());
+        return;
+    }
+
+    Logger::instance()->info("USB Manager: Found UDC %s\n", s_udcName.c_str());
+
+    std::string udcStatePath = udcClassPath + s_udcName + "/state";
+    if ((m_udcStateFd = open(udcStatePath.c_str(), O_RDONLY | O_CLOEXEC)) < 0) {
+        Logger::instance()->info("USB Manager: Error opening %s: %s\n", udcStatePath.c_str(), strerror(errno));
     }
 }
 
-void UsbManager::writeGadgetFile(std::string gadgetName, std::string relativeFilePath, const char* content) {
-    std::string gadgetFilePath = "/sys/kernel/config/usb_gadget/" + gadgetName + "/" + relativeFilePath;
-    FILE* gadgetFile = fopen(gadgetFilePath.c_str(), "w");
-    fputs(content, gadgetFile);
-    fputc('\n', gadgetFile);
-    fclose(gadgetFile);
+#pragma region Provisioning
+bool UsbManager::provisionGadgets() {
+    std::string gadgetRoot = m_configfsRoot + "/usb_gadget";
+    if (access(gadgetRoot.c_str(), F_OK) != 0 && mount("none", m_configfsRoot.c_str(), "configfs", 0, nullptr) != 0) {
+        Logger::instance()->info("USB Manager: Error mounting configfs on %s: %s\n", m_configfsRoot.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool ok = provisionGadget(accessoryGadgetName, accessoryProductId, accessoryFunction);
+    ok = provisionGadget(defaultGadgetName, defaultProductId, defaultFunction) && ok;
+
+    // The MTP function can only be mounted once it exists in configfs.
+    std::string ep0Path = m_mtpFunctionfsPath + "/ep0";
+    if (access(ep0Path.c_str(), F_OK) != 0) {
+        mkdir(m_mtpFunctionfsPath.c_str(), 0755);
+        if (mount("mtp", m_mtpFunctionfsPath.c_str(), "functionfs", 0, nullptr) != 0) {
+            Logger::instance()->info("USB Manager: Error mounting functionfs on %s: %s\n", m_mtpFunctionfsPath.c_str(), strerror(errno));
+            ok = false;
+        }
+    }
+
+    // A daemon left over by a previous instance would keep the function busy.
+    if (std::ifstream pidFile(m_mtpPidFile); pidFile) {
+        pid_t pid = 0;
+        if (pidFile >> pid && pid > 0 && isMtpDaemon(pid)) {
+            kill(pid, SIGKILL);
+        }
+        unlink(m_mtpPidFile.c_str());
+    }
+
+    return ok;
+}
+
+bool UsbManager::provisionGadget(const char* gadgetName, const char* productId, const char* function) {
+    std::string path = m_configfsRoot + "/usb_gadget/" + gadgetName;
+
+    // Creating a directory that exists fails with EEXIST, everything else is a real error.
+    for (std::string dir: {path, path + "/strings/0x409", path + "/functions/" + function, path + "/configs/c.1"}) {
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            Logger::instance()->info("USB Manager: Error creating %s: %s\n", dir.c_str(), strerror(errno));
+            return false;
+        }
+    }
+
+    bool ok = writeAttribute(path + "/idVendor", vendorId)
+        && writeAttribute(path + "/idProduct", productId)
+        && writeAttribute(path + "/strings/0x409/serialnumber", serialNumber)
+        && writeAttribute(path + "/strings/0x409/manufacturer", manufacturer)
+        && writeAttribute(path + "/strings/0x409/product", product)
+        && writeAttribute(path + "/configs/c.1/MaxPower", maxPower);
+    if (!ok) {
+        return false;
+    }
+
+    std::string linkPath = path + "/configs/c.1/" + function;
+    std::string functionPath = path + "/functions/" + function;
+    struct stat linkStat;
+    if (lstat(linkPath.c_str(), &linkStat) != 0 && symlink(functionPath.c_str(), linkPath.c_str()) != 0) {
+        Logger::instance()->info("USB Manager: Error linking %s: %s\n", linkPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool UsbManager::writeAttribute(std::string path, std::string value) {
+    // Only write what differs, attributes of a gadget bound to the UDC cannot be changed.
+    auto read = [&path]() {
+        std::ifstream file(path);
+        std::string current;
+        std::getline(file, current);
+        return current;
+    };
+
+    if (strcasecmp(read().c_str(), value.c_str()) == 0) {
+        return true;
+    }
+
+    {
+        std::ofstream file(path);
+        file << value << "\n";
+    }
+
+    // Ids read back in lower case
+    if (std::string current = read(); strcasecmp(current.c_str(), value.c_str()) != 0) {
+        Logger::instance()->info("USB Manager: %s is '%s' instead of '%s'\n", path.c_str(), current.c_str(), value.c_str());
+        return false;
+    }
+
+    return true;
+}
+#pragma endregion Provisioning
+
+#pragma region MTP
+EventLoop::Async<bool> UsbManager::startMtpDaemon() {
+    if (m_mtpPid > 0) {
+        if (waitpid(m_mtpPid, nullptr, WNOHANG) == 0) {
+            co_return true;
+        }
+
+        Logger::instance()->info("USB Manager: %s exited, restarting it\n", mtpDaemonPath);
+        m_mtpPid = -1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        Logger::instance()->info("USB Manager: Error starting %s: %s\n", mtpDaemonPath, strerror(errno));
+        co_return false;
+    }
+    if (pid == 0) {
+        execl(mtpDaemonPath, mtpDaemonPath, (char*)nullptr);
+        _exit(127);
+    }
+
+    m_mtpPid = pid;
+    if (std::ofstream pidFile(m_mtpPidFile); pidFile) {
+        pidFile << pid << "\n";
+    }
+
+    bool ready = co_await waitForMtpFunction(mtpReadyTimeout);
+    Logger::instance()->info("USB Manager: Started %s, %s after %lld ms\n", mtpDaemonPath, ready ? "ready" : "not ready",
+        (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    co_return ready;
+}
+
+EventLoop::Async<bool> UsbManager::waitForMtpFunction(std::chrono::milliseconds timeout) {
+    // Functionfs only creates the endpoint files once the daemon wrote the descriptors to ep0.
+    std::string ep1Path = m_mtpFunctionfsPath + "/ep1";
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (access(ep1Path.c_str(), F_OK) != 0) {
+        if (waitpid(m_mtpPid, nullptr, WNOHANG) == m_mtpPid) {
+            Logger::instance()->info("USB Manager: %s exited\n", mtpDaemonPath);
+            m_mtpPid = -1;
+            unlink(m_mtpPidFile.c_str());
+            co_return false;
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            co_return false;
+        }
+
+        co_await EventLoop::instance().sleepFor(mtpPollInterval);
+    }
+
+    co_return true;
+}
+
+/*static*/ bool UsbManager::isMtpDaemon(pid_t pid) {
+    std::ifstream commFile("/proc/" + std::to_string(pid) + "/comm");
+    std::string comm;
+    return std::getline(commFile, comm) && comm == mtpDaemonName;
+}
+#pragma endregion MTP
+
+int UsbManager::openGadgetFile(std::string gadgetName, std::string relativeFilePath) {
+    std::string gadgetFilePath = m_configfsRoot + "/usb_gadget/" + gadgetName + "/" + relativeFilePath;
+
+    if (auto it = m_gadgetFiles.find(gadgetFilePath); it != m_gadgetFiles.end()) {
+        return it->second;
+    }
+
+    int fd = open(gadgetFilePath.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        Logger::instance()->info("USB Manager: Error opening %s: %s\n", gadgetFilePath.c_str(), strerror(errno));
+        return -1;
+    }
+
+    m_gadgetFiles.emplace(gadgetFilePath, fd);
+    return fd;
+}
+
+bool UsbManager::writeGadgetFile(std::string gadgetName, std::string relativeFilePath, const char* content) {
+    std::lock_guard<std::mutex> lock(m_gadgetFilesMutex);
+
+    int fd = openGadgetFile(gadgetName, relativeFilePath);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string line = std::string(content) + "\n";
+    if (pwrite(fd, line.c_str(), line.size(), 0) < 0) {
+        Logger::instance()->info("USB Manager: Error writing %s/%s: %s\n", gadgetName.c_str(), relativeFilePath.c_str(), strerror(errno));
+        return false;
+    }
+
+    return true;
 }
 
 void UsbManager::enableGadget(std::string gadgetName) {
@@ -62,15 +295,78 @@ void UsbManager::enableGadget(std::string gadgetName) {
 }
 
 void UsbManager::disableGadget(std::string gadgetName) {
-    writeGadgetFile(gadgetName, "UDC", "");
+    std::lock_guard<std::mutex> lock(m_gadgetFilesMutex);
+
+    int fd = openGadgetFile(gadgetName, "UDC");
+    if (fd < 0) {
+        return;
+    }
+
+    // Writing to a gadget that is not bound to any UDC fails with ENODEV, which is fine here.
+    if (pwrite(fd, "\n", 1, 0) < 0 && errno != ENODEV) {
+        Logger::instance()->info("USB Manager: Error disabling gadget %s: %s\n", gadgetName.c_str(), strerror(errno));
+    }
+}
+
+std::string UsbManager::readUdcState() {
+    char state[32];
+    ssize_t len = pread(m_udcStateFd, state, sizeof(state) - 1, 0);
+    if (len <= 0) {
+        return "";
+    }
+
+    // Remove the trailing newline
+    while (len > 0 && (state[len - 1] == '\n' || state[len - 1] == '\0')) {
+        len--;
+    }
+
+    return std::string(state, len);
+}
+
+EventLoop::Async<bool> UsbManager::waitForUdcState(std::string state, std::chrono::milliseconds timeout) {
+    if (m_udcStateFd < 0) {
+        co_await EventLoop::instance().sleepFor(timeout);
+        co_return false;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        // Reading the attribute also re-arms the notification.
+        if (readUdcState() == state) {
+            co_return true;
+        }
+
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining <= std::chrono::milliseconds(0)) {
+            co_return false;
+        }
+
+        // sysfs notifies state changes with POLLPRI | POLLERR
+        co_await EventLoop::instance().changed(m_udcStateFd, remaining);
+    }
 }
 
-void UsbManager::switchToAccessoryGadget() {
+EventLoop::Async<void> UsbManager::switchToAccessoryGadget() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
     disableGadget(defaultGadgetName);
-    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // 0.1 second, keep the gadget disabled for a short time to let the host recognize the change
+
+    // The UDC reports "not attached" as soon as the gadget is unbound locally, which says nothing about the host
+    // having seen the disconnect. Only the fixed minimum detach time gives the host the chance to notice it.
+    bool unbound = co_await waitForUdcState("not attached", udcUnbindTimeout);
+    std::chrono::steady_clock::time_point unbindTime = std::chrono::steady_clock::now();
+    co_await EventLoop::instance().sleepUntil(start + Config::instance()->getUsbMinimumDetachTime());
+
     enableGadget(accessoryGadgetName);
 
-    Logger::instance()->info("USB Manager: Switched to accessory gadget from default\n");
+    std::chrono::microseconds latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    m_lastSwitchLatency = latency;
+
+    if (unbound) {
+        EventLog::log<LogEvent::GADGET_SWITCHED>(latency.count(), std::chrono::duration_cast<std::chrono::microseconds>(unbindTime - start).count());
+    } else {
+        EventLog::log<LogEvent::GADGET_SWITCHED_WITHOUT_DETACH>(latency.count());
+    }
 }
 
 void UsbManager::disableGadget() {
@@ -80,18 +376,27 @@ void UsbManager::disableGadget() {
     Logger::instance()->info("USB Manager: Disabled all USB gadgets\n");
 }
 
-bool UsbManager::enableDefaultAndWaitForAccessory(std::chrono::milliseconds timeout) {
-    std::shared_ptr<std::promise<void>> accessoryPromise = std::make_shared<std::promise<void>>();
-    std::weak_ptr<std::promise<void>> accessoryPromiseWeak = accessoryPromise;
+std::optional<std::chrono::steady_clock::time_point> UsbManager::getAccessoryStartTime() {
+    std::chrono::steady_clock::duration sinceEpoch = m_accessoryStartTime;
+    if (sinceEpoch == std::chrono::steady_clock::duration::zero()) {
+        return std::nullopt;
+    }
+    return std::chrono::steady_clock::time_point(sinceEpoch);
+}
 
-    UeventMonitor::instance().addHandler([accessoryPromiseWeak](UeventEnv env) {
-        std::shared_ptr<std::promise<void>> accessoryPromise = accessoryPromiseWeak.lock();
+std::chrono::microseconds UsbManager::getLastSwitchLatency() {
+    return m_lastSwitchLatency;
+}
 
-        // If the promise is no longer active, nothing to do.
-        if (!accessoryPromise) {
-            return true;
-        }
+EventLoop::Async<bool> UsbManager::enableDefaultAndWaitForAccessory(std::chrono::milliseconds timeout) {
+    // The default gadget can only be bound once its MTP function is served, which takes long only the first time.
+    co_await startMtpDaemon();
+    enableGadget(defaultGadgetName);
+
+    Logger::instance()->info("USB Manager: Enabled default gadget\n");
 
+    // Starts waiting before the loop runs anything else, the request cannot come in between.
+    std::optional<UeventEnv> request = co_await UeventMonitor::instance().waitFor([](const UeventEnv& env) {
         if (auto it = env.find("DEVNAME"); it == env.end() || it->second != "usb_accessory") {
             return false;
         }
@@ -100,29 +405,18 @@ bool UsbManager::enableDefaultAndWaitForAccessory(std::chrono::milliseconds time
             return false;
         }
 
-        // Got an accessory start event
-        Logger::instance()->info("USB Manager: Received accessory start request\n");
-        UsbManager::instance().switchToAccessoryGadget();
-        accessoryPromise->set_value();
-
         return true;
-    });
-
-    enableGadget(defaultGadgetName);
+    }, timeout);
 
-    Logger::instance()->info("USB Manager: Enabled default gadget\n");
+    if (!request) {
+        Logger::instance()->info("USB Manager: Timeout waiting for accessory start request\n");
+        co_return false;
+    }
 
-    if (timeout == std::chrono::milliseconds(0)) {
-        accessoryPromise->get_future().wait();
-        return true;
-    } else {
-        std::future_status status = accessoryPromise->get_future().wait_for(timeout);
+    // Got an accessory start event
+    m_accessoryStartTime = std::chrono::steady_clock::now().time_since_epoch();
+    EventLog::log<LogEvent::ACCESSORY_START_REQUEST>();
+    co_await switchToAccessoryGadget();
 
-        if (status == std::future_status::ready) {
-            return true;
-        } else {
-            Logger::instance()->info("USB Manager: Timeout waiting for accessory start request\n");
-            return false;
-        }
-    }
+    co_return true;
 }
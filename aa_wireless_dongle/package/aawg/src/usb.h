@@ -1,23 +1,70 @@
+#include <sys/types.h>
 #include <string>
 #include <chrono>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <optional>
+
+#include "eventLoop.h"
 
 class UsbManager {
 public:
     static UsbManager& instance();
 
     void init();
-    bool enableDefaultAndWaitForAccessory(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
-    void switchToAccessoryGadget();
+    // Enable the default gadget and switch to the accessory gadget once the phone requests it, on the event loop.
+    EventLoop::Async<bool> enableDefaultAndWaitForAccessory(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
     void disableGadget();
 
+    // When the phone last requested accessory mode, nothing before the first request.
+    std::optional<std::chrono::steady_clock::time_point> getAccessoryStartTime();
+    std::chrono::microseconds getLastSwitchLatency();
+
 private:
     UsbManager();
     UsbManager(UsbManager const&);
     UsbManager& operator=(UsbManager const&);
 
-    void writeGadgetFile(std::string gadgetName, std::string relativeFilePath, const char* content);
+    // Create the gadgets in configfs if needed, and check their attributes.
+    bool provisionGadgets();
+    bool provisionGadget(const char* gadgetName, const char* productId, const char* function);
+    bool writeAttribute(std::string path, std::string value);
+
+    EventLoop::Async<void> switchToAccessoryGadget();
+
+    // The MTP daemon serves the functionfs function of the default gadget. Started along with the gadget the
+    // first time, it keeps running across sessions and idles while the function is not bound.
+    EventLoop::Async<bool> startMtpDaemon();
+    EventLoop::Async<bool> waitForMtpFunction(std::chrono::milliseconds timeout);
+    // A pid from the pid file may have been reused by another process since.
+    static bool isMtpDaemon(pid_t pid);
+
+    int openGadgetFile(std::string gadgetName, std::string relativeFilePath);
+    bool writeGadgetFile(std::string gadgetName, std::string relativeFilePath, const char* content);
     void enableGadget(std::string name);
     void disableGadget(std::string name);
 
-    static std::string s_udcName; 
+    std::string readUdcState();
+    EventLoop::Async<bool> waitForUdcState(std::string state, std::chrono::milliseconds timeout);
+
+    static std::string s_udcName;
+
+    std::string m_configfsRoot;
+    std::string m_sysfsRoot;
+    std::string m_mtpFunctionfsPath;
+    std::string m_mtpPidFile;
+
+    // Files in configfs are kept open, and rewritten from the start for each write.
+    std::map<std::string, int> m_gadgetFiles;
+    std::mutex m_gadgetFilesMutex;
+
+    int m_udcStateFd = -1;
+
+    // Only used on the event loop
+    pid_t m_mtpPid = -1;
+
+    std::atomic<std::chrono::microseconds> m_lastSwitchLatency = std::chrono::microseconds(0);
+    // Since the clock's epoch, zero before the first request. An atomic optional would need libatomic.
+    std::atomic<std::chrono::steady_clock::duration> m_accessoryStartTime{std::chrono::steady_clock::duration::zero()};
 };
\ No newline at end of file
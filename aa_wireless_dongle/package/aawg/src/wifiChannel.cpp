@@ -0,0 +1,291 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "wifiChannel.h"
+
+namespace WifiChannel {
+
+#pragma region Parsing
+bool is5GHz(int frequency) {
+    return frequency >= 4900;
+}
+
+std::optional<int> parseChannelNumber(const std::string& text) {
+    char* end;
+    errno = 0;
+    long number = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || errno != 0 || number <= 0 || number > 255) {
+        return std::nullopt;
+    }
+
+    return (int)number;
+}
+
+bool isAllowed(int number, const std::vector<Channel>& channels) {
+    if (!channels.empty()) {
+        return std::any_of(channels.begin(), channels.end(), [number](const Channel& channel) {
+            return channel.number == number && channel.usable;
+        });
+    }
+
+    // 20 MHz channels of 2.4 GHz, and of the 5 GHz sub-bands
+    return (number >= 1 && number <= 14)
+        || (number >= 36 && number <= 64 && number % 4 == 0)
+        || (number >= 100 && number <= 144 && number % 4 == 0)
+        || (number >= 149 && number <= 177 && number % 4 == 1);
+}
+
+// Rest of the line after key, if the line starts with it. Keys include their indentation, so
+// "channel busy time:" does not match "extension channel busy time:", nor nested attributes.
+static const char* valueOf(const std::string& line, const char* key) {
+    if (line.rfind(key, 0) != 0) {
+        return nullptr;
+    }
+
+    return line.c_str() + strlen(key);
+}
+
+std::vector<Channel> parsePhyInfo(const std::string& text) {
+    std::vector<Channel> channels;
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        // e.g. "* 5180.0 MHz [36] (20.0 dBm)" or "* 5260 MHz [52] (20.0 dBm) (no IR, radar detection)"
+        double frequency;
+        int number;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || sscanf(line.c_str() + start, "* %lf MHz [%d]", &frequency, &number) != 2) {
+            continue;
+        }
+
+        bool usable = line.find("disabled") == std::string::npos
+            && line.find("no IR") == std::string::npos
+            && line.find("passive scan") == std::string::npos
+            && line.find("radar detection") == std::string::npos;
+
+        channels.push_back({number, (int)frequency, usable});
+    }
+
+    return channels;
+}
+
+std::vector<Survey> parseSurveyDump(const std::string& text) {
+    std::vector<Survey> surveys;
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind("Survey data from", 0) == 0) {
+            surveys.push_back({});
+            continue;
+        }
+        else if (surveys.empty()) {
+            continue;
+        }
+
+        Survey& survey = surveys.back();
+        double value;
+        if (const char* rest = valueOf(line, "\tfrequency:"); rest && sscanf(rest, "%lf", &value) == 1) {
+            survey.frequency = (int)value;
+        }
+        else if (const char* rest = valueOf(line, "\tnoise:"); rest && sscanf(rest, "%lf", &value) == 1) {
+            survey.noise = (int)value;
+        }
+        else if (const char* rest = valueOf(line, "\tchannel active time:"); rest && sscanf(rest, "%lf", &value) == 1) {
+            survey.activeTime = (long long)value;
+        }
+        else if (const char* rest = valueOf(line, "\tchannel busy time:"); rest && sscanf(rest, "%lf", &value) == 1) {
+            survey.busyTime = (long long)value;
+        }
+    }
+
+    return surveys;
+}
+
+std::vector<Bss> parseScan(const std::string& text) {
+    std::vector<Bss> bssList;
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind("BSS ", 0) == 0) {
+            bssList.push_back({0, -100});
+            continue;
+        }
+        else if (bssList.empty()) {
+            continue;
+        }
+
+        Bss& bss = bssList.back();
+        double value;
+        if (const char* rest = valueOf(line, "\tfreq:"); rest && sscanf(rest, "%lf", &value) == 1) {
+            bss.frequency = (int)value;
+        }
+        else if (const char* rest = valueOf(line, "\tsignal:"); rest && sscanf(rest, "%lf", &value) == 1) {
+            bss.signal = value;
+        }
+    }
+
+    return bssList;
+}
+#pragma endregion Parsing
+
+#pragma region Scoring
+// Assumed noise floor when the survey does not report one
+constexpr double DEFAULT_NOISE_DBM = -95;
+// Penalty for a channel whose air is busy all the time
+constexpr double BUSY_PENALTY_DB = 15;
+// Penalty for 2.4 GHz channels other than 1, 6 and 11, which overlap twice as many neighbours
+constexpr double OVERLAPPING_CHANNEL_PENALTY_DB = 3;
+// Bonus for 5 GHz, which has wider channels and usually fewer networks that are not seen by the scan
+constexpr double BAND_5GHZ_BONUS_DB = 6;
+
+static double toMilliwatt(double dbm) {
+    return pow(10, dbm / 10);
+}
+
+static double toDbm(double milliwatt) {
+    return 10 * log10(milliwatt);
+}
+
+// How much a network on one channel interferes with another one, from 0 to 1
+static double overlap(const Channel& channel, int frequency) {
+    if (is5GHz(channel.frequency) != is5GHz(frequency)) {
+        return 0;
+    }
+
+    int distance = abs(channel.frequency - frequency);
+    if (is5GHz(frequency)) {
+        // 20 MHz channels do not overlap
+        return distance < 20 ? 1 : 0;
+    }
+
+    // 2.4 GHz channels are 5 MHz apart but about 22 MHz wide
+    return std::max(0.0, 1 - distance / 25.0);
+}
+
+std::vector<Score> scoreChannels(const std::vector<Channel>& channels, const std::vector<Survey>& surveys, const std::vector<Bss>& bssList) {
+    std::vector<Score> scores;
+
+    for (const Channel& channel: channels) {
+        if (!channel.usable) {
+            continue;
+        }
+
+        Score score = {channel, 0, 0, 0, 0};
+
+        double noise = DEFAULT_NOISE_DBM;
+        for (const Survey& survey: surveys) {
+            if (survey.frequency != channel.frequency) {
+                continue;
+            }
+
+            if (survey.noise) {
+                noise = *survey.noise;
+            }
+            if (survey.activeTime && survey.busyTime && *survey.activeTime > 0) {
+                score.busyFraction = std::min(1.0, (double)*survey.busyTime / *survey.activeTime);
+            }
+        }
+
+        double interference = toMilliwatt(noise);
+        for (const Bss& bss: bssList) {
+            if (double weight = overlap(channel, bss.frequency); weight > 0) {
+                interference += weight * toMilliwatt(bss.signal);
+                score.bssCount++;
+            }
+        }
+        score.interference = toDbm(interference);
+
+        score.score = score.interference + score.busyFraction * BUSY_PENALTY_DB;
+        if (is5GHz(channel.frequency)) {
+            score.score -= BAND_5GHZ_BONUS_DB;
+        }
+        else if (channel.number != 1 && channel.number != 6 && channel.number != 11) {
+            score.score += OVERLAPPING_CHANNEL_PENALTY_DB;
+        }
+
+        scores.push_back(score);
+    }
+
+    std::stable_sort(scores.begin(), scores.end(), [](const Score& a, const Score& b) {
+        return a.score < b.score;
+    });
+
+    return scores;
+}
+#pragma endregion Scoring
+
+}
+
+#pragma region IwScanSource
+IwScanSource::IwScanSource(std::string interface): m_interface(interface) {}
+
+/*static*/ std::optional<std::string> IwScanSource::run(const std::string& command) {
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        return std::nullopt;
+    }
+
+    std::string output;
+    char buffer[4096];
+    while (size_t len = fread(buffer, 1, sizeof(buffer), pipe)) {
+        output.append(buffer, len);
+    }
+
+    if (pclose(pipe) != 0) {
+        return std::nullopt;
+    }
+
+    return output;
+}
+
+std::vector<WifiChannel::Channel> IwScanSource::channels() {
+    std::optional<std::string> info = run("iw dev " + m_interface + " info");
+    int phy;
+    const char* wiphy = info ? strstr(info->c_str(), "wiphy ") : nullptr;
+    if (!wiphy || sscanf(wiphy, "wiphy %d", &phy) != 1) {
+        return {};
+    }
+
+    return WifiChannel::parsePhyInfo(run("iw phy phy" + std::to_string(phy) + " info").value_or(""));
+}
+
+std::vector<WifiChannel::Survey> IwScanSource::survey() {
+    return WifiChannel::parseSurveyDump(run("iw dev " + m_interface + " survey dump 2>/dev/null").value_or(""));
+}
+
+std::vector<WifiChannel::Bss> IwScanSource::scan() {
+    return WifiChannel::parseScan(run("iw dev " + m_interface + " scan 2>/dev/null").value_or(""));
+}
+#pragma endregion IwScanSource
+
+#pragma region RecordedScanSource
+RecordedScanSource::RecordedScanSource(std::string directory): m_directory(directory) {}
+
+std::string RecordedScanSource::read(const char* name) {
+    std::ifstream file(m_directory + "/" + name);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+std::vector<WifiChannel::Channel> RecordedScanSource::channels() {
+    return WifiChannel::parsePhyInfo(read("phy.txt"));
+}
+
+std::vector<WifiChannel::Survey> RecordedScanSource::survey() {
+    return WifiChannel::parseSurveyDump(read("survey.txt"));
+}
+
+std::vector<WifiChannel::Bss> RecordedScanSource::scan() {
+    return WifiChannel::parseScan(read("scan.txt"));
+}
+#pragma endregion RecordedScanSource
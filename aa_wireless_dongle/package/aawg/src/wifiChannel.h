@@ -0,0 +1,102 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace WifiChannel {
+    struct Channel {
+        int number;
+        int frequency;      // MHz
+        // The radio can start an access point here for the current regulatory domain
+        bool usable;
+    };
+
+    struct Survey {
+        int frequency;
+        std::optional<int> noise;       // dBm
+        std::optional<long long> activeTime;  // ms
+        std::optional<long long> busyTime;    // ms
+    };
+
+    struct Bss {
+        int frequency;
+        double signal;      // dBm
+    };
+
+    struct Score {
+        Channel channel;
+        int bssCount;
+        double interference;    // dBm, sum of the overlapping networks and the noise floor
+        double busyFraction;
+        double score;           // lower is better
+    };
+
+    bool is5GHz(int frequency);
+
+    // Channel number given by the user, nullopt unless it is a plain positive number.
+    std::optional<int> parseChannelNumber(const std::string& text);
+
+    /**
+     * Whether an access point may be started on the channel, according to the channels the radio reported.
+     * If it reported none, any 20 MHz channel number of 2.4 or 5 GHz is accepted.
+     */
+    bool isAllowed(int number, const std::vector<Channel>& channels);
+
+    // Parsers for the output of iw, shared by the live and recorded sources.
+    std::vector<Channel> parsePhyInfo(const std::string& text);
+    std::vector<Survey> parseSurveyDump(const std::string& text);
+    std::vector<Bss> parseScan(const std::string& text);
+
+    /**
+     * Score every usable channel from the survey and scan results, best first.
+     */
+    std::vector<Score> scoreChannels(const std::vector<Channel>& channels, const std::vector<Survey>& surveys, const std::vector<Bss>& bssList);
+}
+
+/**
+ * Source of the radio capabilities and of a survey of the air around the dongle.
+ */
+class ScanSource {
+public:
+    virtual ~ScanSource() = default;
+
+    virtual std::vector<WifiChannel::Channel> channels() = 0;
+    virtual std::vector<WifiChannel::Survey> survey() = 0;
+    virtual std::vector<WifiChannel::Bss> scan() = 0;
+};
+
+/**
+ * Scans with iw on a live interface.
+ */
+class IwScanSource: public ScanSource {
+public:
+    explicit IwScanSource(std::string interface);
+
+    std::vector<WifiChannel::Channel> channels() override;
+    std::vector<WifiChannel::Survey> survey() override;
+    std::vector<WifiChannel::Bss> scan() override;
+
+private:
+    static std::optional<std::string> run(const std::string& command);
+
+    std::string m_interface;
+};
+
+/**
+ * Reads iw output recorded earlier from a directory, as phy.txt, survey.txt and scan.txt.
+ */
+class RecordedScanSource: public ScanSource {
+public:
+    explicit RecordedScanSource(std::string directory);
+
+    std::vector<WifiChannel::Channel> channels() override;
+    std::vector<WifiChannel::Survey> survey() override;
+    std::vector<WifiChannel::Bss> scan() override;
+
+private:
+    std::string read(const char* name);
+
+    std::string m_directory;
+};
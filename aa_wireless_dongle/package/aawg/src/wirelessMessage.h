@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <google/protobuf/message_lite.h>
+
+/*
+ * Messages of the wireless projection handshake over bluetooth RFCOMM.
+ *
+ *   byte 0-1   payload length, big endian
+ *   byte 2-3   message id, big endian
+ *   byte 4-    protobuf payload
+ */
+namespace WirelessMessage {
+    constexpr size_t HEADER_LENGTH = 4;
+
+    /**
+     * Serialize a message with its header, ready to be written in one call.
+     */
+    inline std::vector<unsigned char> encode(uint16_t messageId, const google::protobuf::MessageLite& message) {
+        size_t payloadLength = message.ByteSizeLong();
+        std::vector<unsigned char> buffer(HEADER_LENGTH + payloadLength);
+
+        buffer[0] = payloadLength >> 8;
+        buffer[1] = payloadLength & 0xFF;
+        buffer[2] = messageId >> 8;
+        buffer[3] = messageId & 0xFF;
+        message.SerializeToArray(buffer.data() + HEADER_LENGTH, payloadLength);
+
+        return buffer;
+    }
+}